@@ -0,0 +1,50 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+#ifndef __MSAUND05_ALLOCATORH
+#define __MSAUND05_ALLOCATORH
+
+#include <stddef.h>
+
+/* Where a Heap, AVLTree or List gets its memory from, given when it is
+   created.  Passing NULL instead of an allocator means malloc(), realloc()
+   and free().  The structure is copied, so it need not outlive the call, but
+   context must outlive everything allocated from it.
+
+   allocate returns a block of at least size bytes, aligned for any type, or
+   NULL on failure.  reallocate works like realloc(): it returns the resized
+   block, which may have moved, or NULL leaving the old block as it was.
+   old_size is never more than the block's size, and at least as much as
+   needs keeping.  release gives a block back; size is as for old_size.  A
+   block is never NULL when passed to reallocate or release.
+
+   All three functions must be set.  A Heap, AVLTree or List will not be
+   created with an allocator that lacks any of them, since a block from
+   allocate cannot be handed to realloc() or free(). */
+struct allocator {
+    void *(*allocate) (void *context, size_t size);
+    void *(*reallocate) (void *context, void *block, size_t old_size, size_t new_size);
+    void (*release) (void *context, void *block, size_t size);
+    void *context;
+};
+
+#endif
@@ -0,0 +1,199 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+/* The blocks of an arena form a list.  Resetting only moves the arena back
+   to the start of the list, so the blocks are reused in the same order. */
+struct __arenablock {
+    struct __arenablock *next;
+    size_t size;           /* Bytes after the header. */
+};
+
+/* The header is padded so that the bytes after it are aligned. */
+#define ARENA_HEADER ((sizeof(struct __arenablock) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+#define ARENA_NO_LAST ((size_t) -1)
+
+struct arena {
+    struct __arenablock *first;
+    struct __arenablock *current; /* Block being handed out, or NULL before the first. */
+    size_t offset;         /* Bytes of current already handed out. */
+    size_t last;           /* Offset of the last allocation in current, or ARENA_NO_LAST. */
+    size_t block_size;
+    size_t used;
+};
+
+/* Internal functions */
+
+char *block_bytes(struct __arenablock *block) {
+    return (char*) block + ARENA_HEADER;
+}
+
+/* Rounds a request up to a multiple of ARENA_ALIGN.  Returns 0 on overflow. */
+size_t arena_round(size_t size) {
+    if (size == 0) size = 1;
+    if (size > SIZE_MAX - ARENA_ALIGN) return 0;
+    return (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+/* Moves on to a block with at least size bytes: the next one in the list if
+   it is big enough, or else a new one put in the list after the current one.
+   Returns 1 if a new block could not be allocated. */
+int next_arena_block(Arena *arena, size_t size) {
+    struct __arenablock *next;
+    struct __arenablock *new;
+    size_t block_size;
+
+    next = arena->current != NULL ? arena->current->next : arena->first;
+    if (next == NULL || next->size < size) {
+        block_size = size > arena->block_size ? size : arena->block_size;
+        if (block_size > SIZE_MAX - ARENA_HEADER) return 1;
+        new = malloc(ARENA_HEADER + block_size);
+        if (new == NULL) return 1;
+        new->size = block_size;
+        new->next = next;
+        if (arena->current != NULL) {
+            arena->current->next = new;
+        } else {
+            arena->first = new;
+        }
+        next = new;
+    }
+    arena->current = next;
+    arena->offset = 0;
+    arena->last = ARENA_NO_LAST;
+    return 0;
+}
+
+/* Tells whether a block was the last one handed out. */
+int is_last_allocation(Arena *arena, void *block) {
+    return arena->last != ARENA_NO_LAST && (char*) block == block_bytes(arena->current) + arena->last;
+}
+
+void *arena_allocate(void *context, size_t size) {
+    return arena_alloc(context, size);
+}
+
+void *arena_reallocate(void *context, void *block, size_t old_size, size_t new_size) {
+    Arena *arena;
+    void *new;
+    size_t rounded;
+
+    arena = context;
+    rounded = arena_round(new_size);
+    if (rounded == 0) return NULL;
+    if (is_last_allocation(arena, block) && rounded <= arena->current->size - arena->last) {
+        arena->used = arena->used - (arena->offset - arena->last) + rounded;
+        arena->offset = arena->last + rounded;
+        return block;
+    }
+
+    new = arena_alloc(arena, new_size);
+    if (new == NULL) return NULL;
+    memcpy(new, block, old_size < new_size ? old_size : new_size);
+    return new;
+}
+
+void arena_release(void *context, void *block, size_t size) {
+    Arena *arena;
+
+    (void) size;
+    arena = context;
+    if (!is_last_allocation(arena, block)) return;
+    arena->used = arena->used - (arena->offset - arena->last);
+    arena->offset = arena->last;
+    arena->last = ARENA_NO_LAST;
+}
+
+/* External functions */
+
+Arena *create_arena(size_t block_size) {
+    Arena *new;
+
+    new = malloc(sizeof(Arena));
+    if (new == NULL) return NULL;
+    new->first = NULL;
+    new->current = NULL;
+    new->offset = 0;
+    new->last = ARENA_NO_LAST;
+    new->block_size = arena_round(block_size != 0 ? block_size : ARENA_DEFAULT_BLOCK);
+    new->used = 0;
+    if (new->block_size == 0) {
+        free(new);
+        return NULL;
+    }
+    return new;
+}
+
+void destroy_arena(Arena *arena) {
+    struct __arenablock *block;
+    struct __arenablock *next;
+
+    if (arena == NULL) return;
+    for (block = arena->first; block != NULL; block = next) {
+        next = block->next;
+        free(block);
+    }
+    free(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size_t rounded;
+
+    if (arena == NULL) return NULL;
+    rounded = arena_round(size);
+    if (rounded == 0) return NULL;
+    if (arena->current == NULL || rounded > arena->current->size - arena->offset) {
+        if (next_arena_block(arena, rounded) != 0) return NULL;
+    }
+
+    arena->last = arena->offset;
+    arena->offset = arena->offset + rounded;
+    arena->used = arena->used + rounded;
+    return block_bytes(arena->current) + arena->last;
+}
+
+void arena_reset(Arena *arena) {
+    if (arena == NULL) return;
+    arena->current = NULL;
+    arena->offset = 0;
+    arena->last = ARENA_NO_LAST;
+    arena->used = 0;
+}
+
+size_t arena_get_used(Arena *arena) {
+    if (arena == NULL) return 0;
+    return arena->used;
+}
+
+struct allocator arena_allocator(Arena *arena) {
+    struct allocator allocator;
+
+    allocator.allocate = arena_allocate;
+    allocator.reallocate = arena_reallocate;
+    allocator.release = arena_release;
+    allocator.context = arena;
+    return allocator;
+}
@@ -0,0 +1,72 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+#ifndef __MSAUND05_ARENAH
+#define __MSAUND05_ARENAH
+
+#include <stddef.h>
+#include "allocator.h"
+
+typedef struct arena Arena;
+
+/* A bump allocator.  Memory is handed out from the front of large blocks,
+   so an allocation is a pointer bump, and nothing is given back one piece at
+   a time: arena_reset() releases everything at once.  Releasing a block only
+   reclaims it if it was the last one handed out, and growing the last block
+   happens in place when there is room, so a single growing array wastes
+   little.  An arena is not safe to use from several threads at once. */
+
+/* Every allocation is aligned to this many bytes. */
+#define ARENA_ALIGN 16
+
+/* The block size used when create_arena() is given 0. */
+#define ARENA_DEFAULT_BLOCK 65536
+
+/* Creates an empty arena that takes memory from malloc() in blocks of
+   block_size bytes (or ARENA_DEFAULT_BLOCK if it is 0); a larger request gets
+   a block of its own.  Returns NULL if the memory could not be allocated.
+   The arena must be freed with destroy_arena(). */
+Arena *create_arena(size_t block_size);
+
+/* Frees every block of an arena, and the arena. */
+void destroy_arena(Arena *arena);
+
+/* Returns size bytes from the arena, aligned to ARENA_ALIGN, or NULL if the
+   arena is invalid or a new block could not be allocated. */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* Releases every allocation at once in O(1), keeping the blocks for reuse.
+   Anything allocated from the arena, including any Heap, AVLTree or List
+   created with its allocator, must not be used afterwards; there is no need
+   to destroy those first. */
+void arena_reset(Arena *arena);
+
+/* Returns the number of bytes handed out since the arena was created or last
+   reset, counting alignment padding and blocks that were grown by moving. */
+size_t arena_get_used(Arena *arena);
+
+/* Returns an allocator that takes its memory from the arena, for passing to
+   create_allocated_heap(), createAVLTreeWithAllocator() or
+   newListWithAllocator(). */
+struct allocator arena_allocator(Arena *arena);
+
+#endif
@@ -0,0 +1,201 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pool.h"
+
+/* The chunks of a pool form a list.  Objects are handed out from the newest
+   chunk until it is used up; after that only freed objects are reused, until
+   the free list runs dry and another chunk is added. */
+struct __poolchunk {
+    struct __poolchunk *next;
+};
+
+/* A free object holds the link to the next free object. */
+struct __poolfree {
+    struct __poolfree *next;
+};
+
+/* The most an object is aligned to, as much as malloc() guarantees. */
+#define POOL_MAX_ALIGN 16
+
+struct pool {
+    struct __poolchunk *chunks;
+    struct __poolfree *free;
+    char *fresh;           /* Next never-used object in the newest chunk. */
+    char *fresh_end;
+    size_t object_size;    /* Requested size, which the allocator matches on. */
+    size_t stride;         /* Object size rounded up to the alignment. */
+    size_t chunk_offset;   /* Header size of a chunk, padded to the alignment. */
+    size_t objects_per_chunk;
+    size_t used;
+};
+
+/* Internal functions */
+
+/* No type is aligned to more than the highest power of two that divides its
+   size, so that is all an object needs, up to POOL_MAX_ALIGN; free objects
+   hold a pointer, so it is never less than a pointer's size. */
+size_t pool_alignment(size_t size) {
+    size_t align;
+
+    align = size & (~size + 1);
+    if (align > POOL_MAX_ALIGN) align = POOL_MAX_ALIGN;
+    if (align < sizeof(struct __poolfree)) align = sizeof(struct __poolfree);
+    return align;
+}
+
+/* Adds a chunk to the pool and makes its objects the fresh ones.  Returns 1
+   if the memory could not be allocated. */
+int add_pool_chunk(Pool *pool) {
+    struct __poolchunk *chunk;
+
+    chunk = malloc(pool->chunk_offset + pool->stride * pool->objects_per_chunk);
+    if (chunk == NULL) return 1;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->fresh = (char*) chunk + pool->chunk_offset;
+    pool->fresh_end = pool->fresh + pool->stride * pool->objects_per_chunk;
+    return 0;
+}
+
+void *pool_allocate(void *context, size_t size) {
+    Pool *pool;
+
+    pool = context;
+    if (size != pool->object_size) return malloc(size);
+    return pool_alloc(pool);
+}
+
+void *pool_reallocate(void *context, void *block, size_t old_size, size_t new_size) {
+    Pool *pool;
+    void *new;
+
+    pool = context;
+    if (old_size == new_size) return block;
+    if (old_size != pool->object_size && new_size != pool->object_size) {
+        return realloc(block, new_size);
+    }
+
+    new = pool_allocate(context, new_size);
+    if (new == NULL) return NULL;
+    memcpy(new, block, old_size < new_size ? old_size : new_size);
+    if (old_size == pool->object_size) {
+        pool_free(pool, block);
+    } else {
+        free(block);
+    }
+    return new;
+}
+
+void pool_release(void *context, void *block, size_t size) {
+    Pool *pool;
+
+    pool = context;
+    if (size != pool->object_size) {
+        free(block);
+        return;
+    }
+    pool_free(pool, block);
+}
+
+/* External functions */
+
+Pool *create_pool(size_t object_size, size_t objects_per_chunk) {
+    Pool *new;
+    size_t align;
+    size_t stride;
+
+    if (object_size == 0) return NULL;
+    if (objects_per_chunk == 0) objects_per_chunk = POOL_DEFAULT_CHUNK;
+    stride = object_size < sizeof(struct __poolfree) ? sizeof(struct __poolfree) : object_size;
+    align = pool_alignment(stride);
+    if (stride > SIZE_MAX - align) return NULL;
+    stride = (stride + align - 1) / align * align;
+    if (objects_per_chunk > (SIZE_MAX - POOL_MAX_ALIGN - sizeof(struct __poolchunk)) / stride) return NULL;
+
+    new = malloc(sizeof(Pool));
+    if (new == NULL) return NULL;
+    new->chunks = NULL;
+    new->free = NULL;
+    new->fresh = new->fresh_end = NULL;
+    new->object_size = object_size;
+    new->stride = stride;
+    new->chunk_offset = (sizeof(struct __poolchunk) + align - 1) / align * align;
+    new->objects_per_chunk = objects_per_chunk;
+    new->used = 0;
+    return new;
+}
+
+void destroy_pool(Pool *pool) {
+    struct __poolchunk *chunk;
+    struct __poolchunk *next;
+
+    if (pool == NULL) return;
+    for (chunk = pool->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(pool);
+}
+
+void *pool_alloc(Pool *pool) {
+    void *object;
+
+    if (pool == NULL) return NULL;
+    if (pool->free != NULL) {
+        object = pool->free;
+        pool->free = pool->free->next;
+    } else {
+        if (pool->fresh == pool->fresh_end && add_pool_chunk(pool) != 0) return NULL;
+        object = pool->fresh;
+        pool->fresh = pool->fresh + pool->stride;
+    }
+    pool->used++;
+    return object;
+}
+
+void pool_free(Pool *pool, void *object) {
+    struct __poolfree *node;
+
+    if (pool == NULL || object == NULL) return;
+    node = object;
+    node->next = pool->free;
+    pool->free = node;
+    pool->used--;
+}
+
+size_t pool_get_used(Pool *pool) {
+    if (pool == NULL) return 0;
+    return pool->used;
+}
+
+struct allocator pool_allocator(Pool *pool) {
+    struct allocator allocator;
+
+    allocator.allocate = pool_allocate;
+    allocator.reallocate = pool_reallocate;
+    allocator.release = pool_release;
+    allocator.context = pool;
+    return allocator;
+}
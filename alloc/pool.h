@@ -0,0 +1,67 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+#ifndef __MSAUND05_POOLH
+#define __MSAUND05_POOLH
+
+#include <stddef.h>
+#include "allocator.h"
+
+typedef struct pool Pool;
+
+/* A slab allocator for objects of one size.  Objects are carved out of large
+   chunks, so they sit next to each other in memory and cost no per-object
+   header, and released objects go on a free list for the next allocation to
+   take.  Chunks are only given back by destroy_pool().  A pool is not safe
+   to use from several threads at once. */
+
+/* The objects per chunk used when create_pool() is given 0. */
+#define POOL_DEFAULT_CHUNK 1024
+
+/* Creates an empty pool of objects of object_size bytes, taking memory from
+   malloc() a chunk of objects_per_chunk objects (or POOL_DEFAULT_CHUNK if it
+   is 0) at a time.  Objects are aligned as any type of their size needs,
+   and packed with no more padding than that takes.
+   Returns NULL if the arguments are invalid or the memory could not be
+   allocated.  The pool must be freed with destroy_pool(). */
+Pool *create_pool(size_t object_size, size_t objects_per_chunk);
+
+/* Frees every chunk of a pool, and the pool. */
+void destroy_pool(Pool *pool);
+
+/* Returns an object from the pool, or NULL if the pool is invalid or a new
+   chunk could not be allocated. */
+void *pool_alloc(Pool *pool);
+
+/* Puts an object back in the pool for reuse.  Does nothing if it is NULL. */
+void pool_free(Pool *pool, void *object);
+
+/* Returns the number of objects handed out and not yet freed. */
+size_t pool_get_used(Pool *pool);
+
+/* Returns an allocator that takes blocks of the pool's object size from the
+   pool, and any other size from malloc(), for passing to
+   create_allocated_heap(), createAVLTreeWithAllocator() or
+   newListWithAllocator(). */
+struct allocator pool_allocator(Pool *pool);
+
+#endif
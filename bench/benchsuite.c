@@ -0,0 +1,537 @@
+/* BENCHSUITE.C: Benchmark suite for the heap and AVL tree libraries.
+
+   Runs every case on sorted, reverse sorted, random and duplicate-heavy keys
+   and prints one record per case, as CSV or as a JSON array, so results can
+   be kept and compared from run to run:
+
+       ./benchsuite [csv|json] [size ...]
+
+   Heap cases push then pop every key, hold the heap at a size while popping
+   and pushing, mix pushes and pops at random, and build a heap in bulk, on
+   binary, 4-ary and 8-ary array heaps and on the pairing and radix engines.
+   Tree cases insert, find, rank and remove every key, scan short ranges
+   starting at each key, and build a tree in bulk from the sorted keys, on
+   trees with malloc()'d and pooled nodes.  Each case runs in a child process
+   of its own, so that its peak RSS is its own, and counts the cache misses of
+   its timed part with perf_event_open() where the kernel allows; otherwise
+   the count is -1 in CSV and null in JSON. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "../heap/heap.h"
+#include "../tree/AVLtree.h"
+
+enum key_order { KEYS_SORTED, KEYS_REVERSE, KEYS_RANDOM, KEYS_DUPLICATES };
+
+static const char *order_names[] = { "sorted", "reverse", "random", "duplicates" };
+
+/* A structure under test: a heap engine and arity, or the AVL tree with its
+   nodes from malloc() or from a pool of its own. */
+struct bench_subject {
+    const char *name;
+    int is_tree;
+    enum heap_engine engine;
+    unsigned int arity;
+    int pooled;
+};
+
+static const struct bench_subject subjects[] = {
+    { "heap-binary", 0, HEAP_ARRAY_ENGINE, 2 },
+    { "heap-4ary", 0, HEAP_ARRAY_ENGINE, 4 },
+    { "heap-8ary", 0, HEAP_ARRAY_ENGINE, 8 },
+    { "heap-pairing", 0, HEAP_PAIRING_ENGINE, 2 },
+    { "heap-radix", 0, HEAP_RADIX_ENGINE, 2 },
+    { "avltree", 1, HEAP_ARRAY_ENGINE, 0, 0 },
+    { "avltree-pooled", 1, HEAP_ARRAY_ENGINE, 0, 1 }
+};
+
+/* What a child process measures and hands back to the parent. */
+struct bench_result {
+    double seconds;
+    size_t ops;
+    long long cache_misses; /* -1 if they could not be counted. */
+    long peak_rss_kb;
+    int failed;
+};
+
+/* The timer and cache miss counter around a case's timed part. */
+struct bench_timer {
+    struct timespec start;
+    int perf_fd;
+};
+
+typedef void (*bench_func) (const struct bench_subject*, const int*, size_t, struct bench_timer*, struct bench_result*);
+
+static unsigned int rng_state;
+
+/* xorshift32, reseeded for every case so that runs are repeatable. */
+static int next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (int) (rng_state & 0x7fffffff);
+}
+
+/* Fills keys with n keys in the given order.  Keys are at least 1, so that
+   they can stand in for non-NULL tree data. */
+static void make_keys(int *keys, size_t n, enum key_order order) {
+    size_t i;
+
+    for (i=0; i<n; i++) {
+        if (order == KEYS_SORTED) {
+            keys[i] = (int) i + 1;
+        } else if (order == KEYS_REVERSE) {
+            keys[i] = (int) (n - i);
+        } else if (order == KEYS_RANDOM) {
+            keys[i] = next_random() % 0x3fffffff + 1;
+        } else {
+            keys[i] = next_random() % 16 + 1;
+        }
+    }
+}
+
+static int open_cache_counter(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void start_timer(struct bench_timer *timer) {
+#ifdef __linux__
+    if (timer->perf_fd >= 0) {
+        ioctl(timer->perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(timer->perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+static void stop_timer(struct bench_timer *timer, struct bench_result *result) {
+    struct timespec end;
+    long long count;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->seconds = (end.tv_sec - timer->start.tv_sec) + (end.tv_nsec - timer->start.tv_nsec) * 1e-9;
+    result->cache_misses = -1;
+#ifdef __linux__
+    if (timer->perf_fd >= 0) {
+        ioctl(timer->perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(timer->perf_fd, &count, sizeof(count)) == (ssize_t) sizeof(count)) {
+            result->cache_misses = count;
+        }
+    }
+#else
+    (void) count;
+#endif
+}
+
+static Heap *create_subject_heap(const struct bench_subject *subject) {
+    if (subject->engine == HEAP_ARRAY_ENGINE) return create_dary_heap(16, subject->arity);
+    return create_engine_heap(16, subject->engine);
+}
+
+/* The tree compares the keys that its data pointers stand for. */
+static int compare_tree_keys(void *a, void *b) {
+    intptr_t x;
+    intptr_t y;
+
+    x = (intptr_t) a;
+    y = (intptr_t) b;
+    return (y > x) - (y < x);
+}
+
+static void keep_tree_data(void *data) {
+    (void) data;
+}
+
+static AVLTree *create_subject_tree(const struct bench_subject *subject) {
+    if (subject->pooled) return createPooledAVLTree(compare_tree_keys, keep_tree_data);
+    return createAVLTree(compare_tree_keys, keep_tree_data);
+}
+
+static AVLTree *fill_tree(const struct bench_subject *subject, const int *keys, size_t n) {
+    AVLTree *tree;
+    size_t i;
+
+    tree = create_subject_tree(subject);
+    for (i=0; i<n; i++) {
+        addToTree(tree, (void*) (intptr_t) keys[i]);
+    }
+    return tree;
+}
+
+/* Pushes every key, then pops them all. */
+static void bench_push_pop(const struct bench_subject *subject, const int *keys, size_t n,
+                           struct bench_timer *timer, struct bench_result *result) {
+    Heap *heap;
+    size_t i;
+
+    heap = create_subject_heap(subject);
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        heap_push(heap, NULL, keys[i]);
+    }
+    while (heap_pop_with_key(heap, NULL, NULL) == 0);
+    stop_timer(timer, result);
+    result->ops = 2 * n;
+    destroy_heap(heap, NULL);
+}
+
+/* Loads every key, then pops one and pushes it back later n times, the way a
+   scheduler or event queue holds its size.  Keys only grow, so every engine
+   can run it. */
+static void bench_hold(const struct bench_subject *subject, const int *keys, size_t n,
+                       struct bench_timer *timer, struct bench_result *result) {
+    Heap *heap;
+    int key;
+    size_t i;
+
+    heap = create_subject_heap(subject);
+    for (i=0; i<n; i++) {
+        heap_push(heap, NULL, keys[i]);
+    }
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        heap_pop_with_key(heap, NULL, &key);
+        heap_push(heap, NULL, key + (keys[i] & 0xff));
+    }
+    stop_timer(timer, result);
+    result->ops = 2 * n;
+    destroy_heap(heap, NULL);
+}
+
+/* Starts from half the keys and then pushes or pops at random, pushing keys
+   above the last one popped. */
+static void bench_mixed(const struct bench_subject *subject, const int *keys, size_t n,
+                        struct bench_timer *timer, struct bench_result *result) {
+    Heap *heap;
+    int last;
+    int key;
+    size_t i;
+
+    heap = create_subject_heap(subject);
+    for (i=0; i<n/2; i++) {
+        heap_push(heap, NULL, keys[i]);
+    }
+    last = 0;
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        if (next_random() & 1) {
+            heap_push(heap, NULL, last + (keys[i] & 0xffff));
+        } else if (heap_pop_with_key(heap, NULL, &key) == 0) {
+            last = key;
+        }
+    }
+    stop_timer(timer, result);
+    result->ops = n;
+    destroy_heap(heap, NULL);
+}
+
+/* Loads every key at once with heap_build(). */
+static void bench_build(const struct bench_subject *subject, const int *keys, size_t n,
+                        struct bench_timer *timer, struct bench_result *result) {
+    Heap *heap;
+    void **data;
+
+    data = calloc(n, sizeof(void*));
+    heap = create_subject_heap(subject);
+    start_timer(timer);
+    if (heap_build(heap, keys, data, n) != 0) result->failed = 1;
+    stop_timer(timer, result);
+    result->ops = n;
+    destroy_heap(heap, NULL);
+    free(data);
+}
+
+static void bench_tree_insert(const struct bench_subject *subject, const int *keys, size_t n,
+                              struct bench_timer *timer, struct bench_result *result) {
+    AVLTree *tree;
+    size_t i;
+
+    tree = create_subject_tree(subject);
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        addToTree(tree, (void*) (intptr_t) keys[i]);
+    }
+    stop_timer(timer, result);
+    result->ops = n;
+    destroyAVLTree(tree);
+}
+
+static void bench_tree_find(const struct bench_subject *subject, const int *keys, size_t n,
+                            struct bench_timer *timer, struct bench_result *result) {
+    AVLTree *tree;
+    size_t i;
+
+    tree = fill_tree(subject, keys, n);
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        if (findInTree(tree, (void*) (intptr_t) keys[n - 1 - i]) == NULL) result->failed = 1;
+    }
+    stop_timer(timer, result);
+    result->ops = n;
+    destroyAVLTree(tree);
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x;
+    int y;
+
+    x = *(const int*) a;
+    y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/* Loads the distinct keys, sorted beforehand, with avl_build_sorted(). */
+static void bench_tree_build(const struct bench_subject *subject, const int *keys, size_t n,
+                             struct bench_timer *timer, struct bench_result *result) {
+    AVLTree *tree;
+    int *sorted;
+    void **data;
+    size_t distinct;
+    size_t i;
+
+    sorted = malloc(sizeof(int) * n);
+    data = malloc(sizeof(void*) * n);
+    memcpy(sorted, keys, sizeof(int) * n);
+    qsort(sorted, n, sizeof(int), compare_ints);
+    distinct = 0;
+    for (i=0; i<n; i++) {
+        if (i > 0 && sorted[i] == sorted[i - 1]) continue;
+        data[distinct++] = (void*) (intptr_t) sorted[i];
+    }
+    tree = create_subject_tree(subject);
+    start_timer(timer);
+    if (avl_build_sorted(tree, data, distinct) != 0) result->failed = 1;
+    stop_timer(timer, result);
+    result->ops = distinct;
+    destroyAVLTree(tree);
+    free(data);
+    free(sorted);
+}
+
+/* Ranks every key and selects the data at each rank. */
+static void bench_tree_rank(const struct bench_subject *subject, const int *keys, size_t n,
+                            struct bench_timer *timer, struct bench_result *result) {
+    AVLTree *tree;
+    size_t rank;
+    size_t i;
+
+    tree = fill_tree(subject, keys, n);
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        rank = avl_rank(tree, (void*) (intptr_t) keys[i]);
+        if (avl_select(tree, rank) != (void*) (intptr_t) keys[i]) result->failed = 1;
+    }
+    stop_timer(timer, result);
+    result->ops = 2 * n;
+    destroyAVLTree(tree);
+}
+
+/* Counts the data a range scan visits. */
+static bool count_tree_data(void *data, void *context) {
+    (void) data;
+    ++*(size_t*) context;
+    return TRUE;
+}
+
+/* Scans the 16 keys from each key up, as a window query would. */
+static void bench_tree_range(const struct bench_subject *subject, const int *keys, size_t n,
+                             struct bench_timer *timer, struct bench_result *result) {
+    AVLTree *tree;
+    size_t visited;
+    size_t i;
+
+    tree = fill_tree(subject, keys, n);
+    visited = 0;
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        avl_visit_range(tree, (void*) (intptr_t) keys[i], (void*) ((intptr_t) keys[i] + 16),
+                        count_tree_data, &visited);
+    }
+    stop_timer(timer, result);
+    if (visited < n) result->failed = 1;
+    result->ops = n;
+    destroyAVLTree(tree);
+}
+
+static void bench_tree_remove(const struct bench_subject *subject, const int *keys, size_t n,
+                              struct bench_timer *timer, struct bench_result *result) {
+    AVLTree *tree;
+    size_t i;
+
+    tree = fill_tree(subject, keys, n);
+    start_timer(timer);
+    for (i=0; i<n; i++) {
+        removeFromTree(tree, (void*) (intptr_t) keys[i]);
+    }
+    stop_timer(timer, result);
+    result->ops = n;
+    destroyAVLTree(tree);
+}
+
+struct bench_case {
+    const char *name;
+    int for_tree;
+    int array_only;
+    bench_func run;
+};
+
+static const struct bench_case cases[] = {
+    { "push_pop", 0, 0, bench_push_pop },
+    { "hold", 0, 0, bench_hold },
+    { "mixed", 0, 0, bench_mixed },
+    { "build", 0, 1, bench_build },
+    { "insert", 1, 0, bench_tree_insert },
+    { "build", 1, 0, bench_tree_build },
+    { "find", 1, 0, bench_tree_find },
+    { "rank", 1, 0, bench_tree_rank },
+    { "range", 1, 0, bench_tree_range },
+    { "remove", 1, 0, bench_tree_remove }
+};
+
+/* Runs one case in a child process and collects its result through a pipe.
+   Returns 1 if the child could not be run or did not report. */
+static int run_case(const struct bench_case *bench, const struct bench_subject *subject,
+                    enum key_order order, size_t n, struct bench_result *result) {
+    struct bench_timer timer;
+    struct rusage usage;
+    int *keys;
+    int fds[2];
+    pid_t child;
+    int status;
+
+    if (pipe(fds) != 0) return 1;
+    fflush(stdout);
+    child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        memset(result, 0, sizeof(*result));
+        rng_state = 2463534242u;
+        keys = malloc(sizeof(int) * (n != 0 ? n : 1));
+        if (keys == NULL) _exit(1);
+        make_keys(keys, n, order);
+        timer.perf_fd = open_cache_counter();
+        bench->run(subject, keys, n, &timer, result);
+        free(keys);
+        getrusage(RUSAGE_SELF, &usage);
+        result->peak_rss_kb = usage.ru_maxrss;
+        if (write(fds[1], result, sizeof(*result)) != (ssize_t) sizeof(*result)) _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    status = read(fds[0], result, sizeof(*result)) == (ssize_t) sizeof(*result) ? 0 : 1;
+    close(fds[0]);
+    waitpid(child, NULL, 0);
+    return status;
+}
+
+static void print_record(int json, int first, const struct bench_case *bench, const struct bench_subject *subject,
+                         enum key_order order, size_t n, const struct bench_result *result) {
+    double ns_per_op;
+
+    ns_per_op = result->ops != 0 ? result->seconds * 1e9 / result->ops : 0;
+    if (!json) {
+        printf("%s,%s,%s,%lu,%lu,%.6f,%.2f,%lld,%ld,%d\n", subject->name, bench->name, order_names[order],
+               (unsigned long) n, (unsigned long) result->ops, result->seconds, ns_per_op,
+               result->cache_misses, result->peak_rss_kb, result->failed);
+        return;
+    }
+    printf("%s  {\"structure\": \"%s\", \"case\": \"%s\", \"keys\": \"%s\", \"n\": %lu, \"ops\": %lu, "
+           "\"seconds\": %.6f, \"ns_per_op\": %.2f, \"cache_misses\": ",
+           first ? "" : ",\n", subject->name, bench->name, order_names[order],
+           (unsigned long) n, (unsigned long) result->ops, result->seconds, ns_per_op);
+    if (result->cache_misses >= 0) {
+        printf("%lld", result->cache_misses);
+    } else {
+        printf("null");
+    }
+    printf(", \"peak_rss_kb\": %ld, \"failed\": %s}", result->peak_rss_kb, result->failed ? "true" : "false");
+}
+
+int main(int argc, char **argv) {
+    size_t default_sizes[] = { 10000, 1000000 };
+    size_t sizes[16];
+    size_t num_sizes;
+    struct bench_result result;
+    int json;
+    int first;
+    int order;
+    size_t c;
+    size_t s;
+    size_t i;
+    int arg;
+
+    json = 0;
+    num_sizes = 0;
+    for (arg=1; arg<argc; arg++) {
+        if (strcmp(argv[arg], "json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[arg], "csv") == 0) {
+            json = 0;
+        } else if (num_sizes < 16) {
+            sizes[num_sizes++] = strtoul(argv[arg], NULL, 10);
+        }
+    }
+    if (num_sizes == 0) {
+        num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        for (i=0; i<num_sizes; i++) sizes[i] = default_sizes[i];
+    }
+
+    if (json) {
+        printf("[\n");
+    } else {
+        printf("structure,case,keys,n,ops,seconds,ns_per_op,cache_misses,peak_rss_kb,failed\n");
+    }
+    first = 1;
+    for (i=0; i<num_sizes; i++) {
+        for (s=0; s<sizeof(subjects)/sizeof(subjects[0]); s++) {
+            for (c=0; c<sizeof(cases)/sizeof(cases[0]); c++) {
+                if (cases[c].for_tree != subjects[s].is_tree) continue;
+                if (cases[c].array_only && subjects[s].engine != HEAP_ARRAY_ENGINE) continue;
+                for (order=KEYS_SORTED; order<=KEYS_DUPLICATES; order++) {
+                    if (run_case(&cases[c], &subjects[s], (enum key_order) order, sizes[i], &result) != 0) {
+                        memset(&result, 0, sizeof(result));
+                        result.cache_misses = -1;
+                        result.failed = 1;
+                    }
+                    print_record(json, first, &cases[c], &subjects[s], (enum key_order) order, sizes[i], &result);
+                    first = 0;
+                }
+            }
+        }
+    }
+    if (json) printf("\n]\n");
+    return 0;
+}
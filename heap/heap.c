@@ -20,127 +20,1220 @@
 */
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-struct __heapnode {
-    int key;
-    void *data;
-};
+#include "heap.h"
+#include "heap_internal.h"
 
-struct heap {
-    struct __heapnode *root;
-    size_t size;
-    size_t alloc_size;
-    size_t init_size;
-    int last_key;
-};
+/* The sift loops are only fast once these helpers are inlined into them and
+   the arity is a constant, so ask the compiler for that where it can. */
+#if defined(__GNUC__)
+#define HEAP_INLINE static inline __attribute__((always_inline))
+#else
+#define HEAP_INLINE static inline
+#endif
 
-#include "heap.h"
+/* On x86 with GCC or Clang, 8-ary heaps pick the smallest child with AVX2 or
+   SSE4.1, chosen when the heap is created from what the CPU supports.  Define
+   HEAP_NO_SIMD to build only the scalar code, or HEAP_NO_AVX2 to never pick
+   the AVX2 loop, so that the SSE4.1 one can be tested on an AVX2 machine. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(HEAP_NO_SIMD)
+#define HEAP_X86_SIMD
+#include <immintrin.h>
+#define HEAP_TARGET(isa) __attribute__((target(isa)))
+#ifdef HEAP_NO_AVX2
+#define HEAP_USE_AVX2 0
+#else
+#define HEAP_USE_AVX2 1
+#endif
+#endif
 
-/* Internal functions */
+/* Fetches a cache line that will be read soon, where the compiler can. */
+#if defined(__GNUC__)
+#define HEAP_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define HEAP_PREFETCH(address) ((void) (address))
+#endif
 
-void destroy_heapnode(struct __heapnode *node, void (*__dest_func) (void*)) {
-    if (node == NULL) return;
+/* Number of nodes from which the vector sift is used.  Below this the keys
+   sit in cache, and the scalar loop is faster because the CPU can run ahead
+   on its branch predictions; above it, loading the next level dominates and
+   the vector loop wins by not mispredicting. */
+#define HEAP_VECTOR_MIN_SIZE 131072
 
+#define HEAP_SCALAR 0
+#define HEAP_SSE41  1
+#define HEAP_AVX2   2
+
+/* Internal functions */
+
+void destroy_heapnode(void *data, void (*__dest_func) (void*)) {
     if (__dest_func != NULL) {
-        __dest_func(node->data);
+        __dest_func(data);
     }
     return;
 }
 
-int increase_heap_size(Heap *heap) {
-    struct __heapnode *new_block;
+/* Returns the key array inside a raw block, placed so that key 1 starts a
+   cache line.  The keys of a node's children are then aligned for vector
+   loads and share as few lines as possible. */
+int *align_keys(void *block) {
+    uintptr_t first_child;
+
+    first_child = (uintptr_t) block + sizeof(int);
+    first_child = (first_child + HEAP_CACHE_LINE - 1) & ~((uintptr_t) HEAP_CACHE_LINE - 1);
+    return (int*) (first_child - sizeof(int));
+}
+
+#ifdef HEAP_STATS
+void record_sift(Heap *heap, size_t comparisons, size_t moves) {
+    HEAP_STAT_ADD(heap, comparisons, comparisons);
+    HEAP_STAT_ADD(heap, moves, moves);
+    HEAP_STAT_ADD(heap, sifts, 1);
+    HEAP_STAT_ADD(heap, sift_depth[moves < HEAP_STATS_DEPTHS ? moves : HEAP_STATS_DEPTHS - 1], 1);
+}
+#endif
+
+/* Every block a heap owns comes from its allocator, or from malloc() if it
+   was not given one. */
+void *allocate_block(Heap *heap, size_t size) {
+    HEAP_STAT_ADD(heap, allocations, 1);
+    if (heap->allocator.allocate == NULL) return malloc(size);
+    return heap->allocator.allocate(heap->allocator.context, size);
+}
+
+void *reallocate_block(Heap *heap, void *block, size_t old_size, size_t new_size) {
+    if (block != NULL) {
+        HEAP_STAT_ADD(heap, reallocs, 1);
+        HEAP_STAT_ADD(heap, realloc_bytes, new_size);
+    }
+    if (heap->allocator.reallocate == NULL) {
+        HEAP_STAT_ADD(heap, allocations, 1);
+        return realloc(block, new_size);
+    }
+    if (block == NULL) return allocate_block(heap, new_size);
+    return heap->allocator.reallocate(heap->allocator.context, block, old_size, new_size);
+}
+
+void release_block(Heap *heap, void *block, size_t size) {
+    if (block == NULL) return;
+    if (heap->allocator.release == NULL) {
+        free(block);
+        return;
+    }
+    heap->allocator.release(heap->allocator.context, block, size);
+}
+
+int resize_heap(Heap *heap, size_t new_size) {
+    int *new_keys;
+    void *new_block;
+    void **new_data;
+    size_t *new_handles;
+    size_t old_offset;
+
+    if (heap == NULL) return -1;
+    if (new_size < heap->size) return 1;
+    if (heap->bounded && new_size > heap->alloc_size) return 1;
+    if (new_size > (SIZE_MAX - HEAP_CACHE_LINE) / sizeof(void*)) return 1;
 
-    if (heap != NULL) {
-        new_block = realloc(heap->root, sizeof(struct __heapnode) * (heap->alloc_size + heap->init_size));
+    /* A heap loaded from a snapshot moves out of the mapped file the first
+       time it is resized. */
+    if (heap->snapshot != NULL) {
+        if (copy_out_snapshot(heap, new_size) != 0) return 1;
+    } else {
+        /* A failed shrink leaves the old, larger block in place, which is fine.
+           realloc() keeps no alignment, so the keys may need to slide over to
+           the aligned spot in the new block. */
+        old_offset = (char*) heap->keys - (char*) heap->key_block;
+        new_block = reallocate_block(heap, heap->key_block, sizeof(int) * heap->alloc_size + HEAP_CACHE_LINE,
+                                     sizeof(int) * new_size + HEAP_CACHE_LINE);
         if (new_block != NULL) {
-            heap->root = new_block;
-            heap->alloc_size = heap->alloc_size + heap->init_size;
-            return 0;
+            new_keys = align_keys(new_block);
+            if ((char*) new_keys != (char*) new_block + old_offset) {
+                memmove(new_keys, (char*) new_block + old_offset, sizeof(int) * heap->size);
+            }
+            heap->key_block = new_block;
+            heap->keys = new_keys;
+        } else if (new_size > heap->alloc_size) {
+            return 1;
+        }
+
+        new_data = reallocate_block(heap, heap->data, sizeof(void*) * heap->alloc_size, sizeof(void*) * new_size);
+        if (new_data != NULL) {
+            heap->data = new_data;
+        } else if (new_size > heap->alloc_size) {
+            return 1;
         }
-        return 1; 
     }
-    return -1;
+
+    if (heap->handle_of != NULL) {
+        new_handles = reallocate_block(heap, heap->handle_of, sizeof(size_t) * heap->alloc_size, sizeof(size_t) * new_size);
+        if (new_handles != NULL) {
+            heap->handle_of = new_handles;
+        } else if (new_size > heap->alloc_size) {
+            return 1;
+        }
+    }
+
+    heap->alloc_size = new_size;
+    return 0;
 }
 
-void heapnode_swap(struct __heapnode *one, struct __heapnode *two) {
-    int key;
-    void *data;
+/* Returns how much to grow an allocation of alloc_size elements by, or 0 if
+   it cannot grow.  Growing geometrically makes n pushes cost O(n) copying in
+   total. */
+size_t growth_step(Heap *heap, size_t alloc_size) {
+    size_t step;
+
+    step = (size_t) ((double) alloc_size * (heap->growth_factor - 1.0));
+    if (step < 1) step = 1;
+    if (heap->max_growth != 0 && step > heap->max_growth) step = heap->max_growth;
+    if (step > SIZE_MAX - alloc_size) return 0;
+    return step;
+}
+
+int increase_heap_size(Heap *heap) {
+    size_t step;
+
+    if (heap == NULL) return -1;
+
+    step = growth_step(heap, heap->alloc_size);
+    if (step == 0) return 1;
+    return resize_heap(heap, heap->alloc_size + step);
+}
+
+/* Resizes the node pool of a pairing or radix heap.  Nodes are never moved
+   to new indices, since their indices are their handles, so the pool cannot
+   shrink below the highest node given out. */
+int resize_pool(Heap *heap, size_t new_size) {
+    struct __poolnode *new_nodes;
+
+    if (new_size < heap->handle_count) return 1;
+    if (new_size > SIZE_MAX / sizeof(struct __poolnode)) return 1;
+
+    new_nodes = reallocate_block(heap, heap->nodes, sizeof(struct __poolnode) * heap->handle_alloc,
+                                 sizeof(struct __poolnode) * new_size);
+    if (new_nodes == NULL) {
+        /* A failed shrink leaves the old, larger pool in place. */
+        return new_size > heap->handle_alloc ? 1 : 0;
+    }
+    heap->nodes = new_nodes;
+    heap->handle_alloc = heap->alloc_size = new_size;
+    return 0;
+}
+
+/* Takes a node from the free list, or from the end of the pool, and fills
+   in its key and data.  Returns HEAP_NO_NODE if the pool could not grow. */
+size_t new_poolnode(Heap *heap, void *data, int key) {
+    size_t node;
+    size_t step;
+
+    if (heap->free_handle != HEAP_NO_NODE) {
+        node = heap->free_handle;
+        heap->free_handle = (heap->nodes)[node].next;
+    } else {
+        if (heap->handle_count == heap->handle_alloc) {
+            step = growth_step(heap, heap->handle_alloc);
+            if (step == 0) return HEAP_NO_NODE;
+            if (resize_pool(heap, heap->handle_alloc + step) != 0) return HEAP_NO_NODE;
+        }
+        node = heap->handle_count++;
+    }
+    (heap->nodes)[node].key = key ^ heap->key_mask;
+    (heap->nodes)[node].data = data;
+    (heap->nodes)[node].child = HEAP_NO_NODE;
+    (heap->nodes)[node].next = HEAP_NO_NODE;
+    (heap->nodes)[node].prev = HEAP_NO_NODE;
+    return node;
+}
+
+/* Puts a node that has left the heap on the free list. */
+void free_poolnode(Heap *heap, size_t node) {
+    (heap->nodes)[node].prev = HEAP_FREE_NODE;
+    (heap->nodes)[node].next = heap->free_handle;
+    heap->free_handle = node;
+}
+
+int is_live_poolnode(Heap *heap, size_t node) {
+    return node < heap->handle_count && (heap->nodes)[node].prev != HEAP_FREE_NODE;
+}
+
+/* The arrays a sift works on, copied out of the heap into a local so that
+   the compiler knows that writing a node cannot move the arrays. */
+struct __heaparrays {
+    int *keys;
+    void **data;
+    size_t *handle_of;
+    size_t *position;
+};
+
+HEAP_INLINE struct __heaparrays heap_arrays(Heap *heap) {
+    struct __heaparrays arrays;
+
+    arrays.keys = heap->keys;
+    arrays.data = heap->data;
+    arrays.handle_of = heap->handle_of;
+    arrays.position = heap->position;
+    return arrays;
+}
+
+/* Copies the node at from into the slot at to, and points the handle of
+   that node (if it has one) at its new slot. */
+HEAP_INLINE void move_heapnode(const struct __heaparrays *arrays, size_t to, size_t from) {
+    size_t handle;
 
-    data = one->data;
-    key = one->key;
-    one->data = two->data;
-    one->key = two->key;
-    two->data = data;
-    two->key = key;
+    arrays->keys[to] = arrays->keys[from];
+    arrays->data[to] = arrays->data[from];
+    if (arrays->handle_of != NULL) {
+        handle = arrays->handle_of[from];
+        arrays->handle_of[to] = handle;
+        if (handle != HEAP_NO_HANDLE) arrays->position[handle] = to;
+    }
 }
 
-void upheap(Heap *heap, int pos) {
-    int parent;
-    struct __heapnode *root;
+/* Writes a node and its handle into the slot at pos. */
+HEAP_INLINE void place_heapnode(const struct __heaparrays *arrays, size_t pos, struct __heapnode node, size_t handle) {
+    arrays->keys[pos] = node.key;
+    arrays->data[pos] = node.data;
+    if (arrays->handle_of != NULL) {
+        arrays->handle_of[pos] = handle;
+        if (handle != HEAP_NO_HANDLE) arrays->position[handle] = pos;
+    }
+}
+
+/* Reads the node at pos, noting its handle. */
+HEAP_INLINE struct __heapnode take_heapnode(const struct __heaparrays *arrays, size_t pos, size_t *handle) {
+    struct __heapnode node;
+
+    node.key = arrays->keys[pos];
+    node.data = arrays->data[pos];
+    *handle = arrays->handle_of != NULL ? arrays->handle_of[pos] : HEAP_NO_HANDLE;
+    return node;
+}
+
+size_t minmax_bubble_up(Heap *heap, size_t pos);
+
+/* Moves the node at pos towards the root until its parent's key is lower.
+   The node is held aside while its ancestors shift down into the hole, so
+   each level costs one copy instead of a full swap. */
+void upheap(Heap *heap, size_t pos) {
+    struct __heaparrays arrays;
+    int *keys;
+    struct __heapnode moving;
+    size_t handle;
+    size_t parent;
+    size_t comparisons;
+    size_t moves;
+    unsigned int shift;
+
     if (heap == NULL) return;
-    if (pos == 0) return;
-    
-    root = heap->root;
-    parent = ( pos + (pos % 2) - 2 ) / 2;
-    if (root[parent].key < root[pos].key) return;
-    heapnode_swap(&(root[parent]), &(root[pos]));
-    upheap(heap, parent);
+    if (pos >= heap->size) return;
+    if (heap->order == HEAP_MIN_MAX_ORDER) {
+        minmax_bubble_up(heap, pos);
+        return;
+    }
+
+    arrays = heap_arrays(heap);
+    keys = arrays.keys;
+    shift = heap->arity_shift;
+    moving = take_heapnode(&arrays, pos, &handle);
+    comparisons = moves = 0;
+    while (pos > 0) {
+        parent = (pos - 1) >> shift;
+        comparisons++;
+        if (keys[parent] < moving.key) break;
+        move_heapnode(&arrays, pos, parent);
+        moves++;
+        pos = parent;
+    }
+    place_heapnode(&arrays, pos, moving, handle);
+    HEAP_STAT_SIFT(heap, comparisons, moves);
 }
 
-void downheap(Heap *heap, int pos) {
-    int lchild;
-    int rchild;
-    int last_element;
+#ifdef HEAP_X86_SIMD
+
+/* Each of these returns the index of the lowest of the full group of child
+   keys starting at child (the first one, if several are equal).  The group
+   is aligned, because key 1 is. */
+
+HEAP_TARGET("sse4.1") static inline size_t min_child8_sse41(const int *keys, size_t child) {
+    __m128i lower;
+    __m128i upper;
+    __m128i low;
+    int mask;
+
+    lower = _mm_load_si128((const __m128i*) (keys + child));
+    upper = _mm_load_si128((const __m128i*) (keys + child + 4));
+    low = _mm_min_epi32(lower, upper);
+    low = _mm_min_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+    low = _mm_min_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+    mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lower, low)))
+         | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(upper, low))) << 4;
+    return child + __builtin_ctz(mask);
+}
+
+HEAP_TARGET("avx2") static inline size_t min_child8_avx2(const int *keys, size_t child) {
+    __m256i group;
+    __m256i low;
+
+    group = _mm256_load_si256((const __m256i*) (keys + child));
+    low = _mm256_min_epi32(group, _mm256_permute2x128_si256(group, group, 1));
+    low = _mm256_min_epi32(low, _mm256_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+    low = _mm256_min_epi32(low, _mm256_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+    return child + __builtin_ctz(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(group, low))));
+}
+
+#endif
+
+/* Moves the node at pos away from the root until none of its children has a
+   lower key, shifting the smallest child up into the hole at each level.  The
+   arity (as a shift) and instruction set are constants in each caller, so
+   every sift_down function gets its own copy of this loop. */
+HEAP_INLINE void downheap_arity(Heap *heap, size_t pos, const unsigned int shift, const int isa) {
+    struct __heaparrays arrays;
+    int *keys;
+    struct __heapnode moving;
+    size_t handle;
+    size_t size;
+    size_t child;
+    size_t last;
+    size_t best;
+    size_t grandchild;
+    size_t offset;
+    size_t comparisons;
+    size_t moves;
+    int best_key;
+
+    arrays = heap_arrays(heap);
+    keys = arrays.keys;
+    size = heap->size;
+    moving = take_heapnode(&arrays, pos, &handle);
+    comparisons = moves = 0;
+    while ((child = (pos << shift) + 1) < size) {
+        best = child;
+        last = child + (1u << shift);
+        /* One comparison per child: all but one pick the best, and the last
+           weighs it against the moving node. */
+        comparisons = comparisons + (last <= size ? last : size) - child;
+        if (shift > 1) {
+            /* The grandchildren's keys are contiguous, so start loading them
+               now; otherwise picking the best child would have to wait for
+               them at the next level. */
+            grandchild = (child << shift) + 1;
+            if (grandchild < size) {
+                for (offset = 0; offset < (1u << (2 * shift)); offset += HEAP_CACHE_LINE / sizeof(int)) {
+                    HEAP_PREFETCH(keys + grandchild + offset);
+                }
+                HEAP_PREFETCH(keys + grandchild + (1u << (2 * shift)) - 1);
+            }
+        }
+        if (shift == 1) {
+            if (child + 1 < size && keys[child + 1] < keys[child]) best++;
+#ifdef HEAP_X86_SIMD
+        } else if (isa == HEAP_SSE41 && shift == 3 && last <= size) {
+            best = min_child8_sse41(keys, child);
+        } else if (isa == HEAP_AVX2 && shift == 3 && last <= size) {
+            best = min_child8_avx2(keys, child);
+#endif
+        } else {
+            if (last > size) last = size;
+            best_key = keys[child];
+            for (child++; child < last; child++) {
+                if (keys[child] < best_key) {
+                    best_key = keys[child];
+                    best = child;
+                }
+            }
+        }
+        if (!(keys[best] < moving.key)) break;
+        move_heapnode(&arrays, pos, best);
+        moves++;
+        pos = best;
+    }
+    place_heapnode(&arrays, pos, moving, handle);
+    HEAP_STAT_SIFT(heap, comparisons, moves);
+}
+
+void downheap_binary(Heap *heap, size_t pos) {
+    downheap_arity(heap, pos, 1, HEAP_SCALAR);
+}
+
+void downheap_4(Heap *heap, size_t pos) {
+    downheap_arity(heap, pos, 2, HEAP_SCALAR);
+}
+
+void downheap_8(Heap *heap, size_t pos) {
+    downheap_arity(heap, pos, 3, HEAP_SCALAR);
+}
+
+#ifdef HEAP_X86_SIMD
+HEAP_TARGET("sse4.1") void downheap_8_sse41(Heap *heap, size_t pos) {
+    downheap_arity(heap, pos, 3, HEAP_SSE41);
+}
+
+HEAP_TARGET("avx2") void downheap_8_avx2(Heap *heap, size_t pos) {
+    downheap_arity(heap, pos, 3, HEAP_AVX2);
+}
+#endif
+
+/* A min-max heap is a binary heap whose levels alternate: a node on an even
+   level (the root is level 0) holds the lowest key of its subtree, and a node
+   on an odd level holds the highest.  The lowest key is at the root and the
+   highest is one of its children.  In the routines below, is_max says which
+   kind of level a node is on, and MINMAX_BEFORE(a, b) is true when key a
+   belongs above key b on that kind of level. */
+#define MINMAX_BEFORE(a, b) (is_max ? (a) > (b) : (a) < (b))
+
+int is_max_level(size_t pos) {
+    int is_max;
+
+    is_max = 0;
+    for (pos = pos + 1; pos > 1; pos >>= 1) is_max = !is_max;
+    return is_max;
+}
+
+/* Moves the node at pos down a min-max heap, comparing it against its
+   children and grandchildren.  Returns where the node came to rest. */
+size_t minmax_trickle_down(Heap *heap, size_t pos) {
+    struct __heaparrays arrays;
+    struct __heapnode moving;
+    struct __heapnode displaced;
+    size_t handle;
+    size_t displaced_handle;
+    size_t size;
+    size_t first;
+    size_t last;
+    size_t best;
+    size_t i;
+    size_t parent;
+    size_t comparisons;
+    size_t moves;
+    int *keys;
+    int is_max;
 
+    arrays = heap_arrays(heap);
+    keys = arrays.keys;
+    size = heap->size;
+    is_max = is_max_level(pos);
+    moving = take_heapnode(&arrays, pos, &handle);
+    comparisons = moves = 0;
+    while (2 * pos + 1 < size) {
+        /* Best of the children, then of the grandchildren. */
+        best = 2 * pos + 1;
+        if (best + 1 < size && MINMAX_BEFORE(keys[best + 1], keys[best])) best++;
+        first = 4 * pos + 3;
+        last = first + 4 < size ? first + 4 : size;
+        for (i=first; i<last; i++) {
+            if (MINMAX_BEFORE(keys[i], keys[best])) best = i;
+        }
+        comparisons = comparisons + (best + 1 < size ? 2 : 1) + (last > first ? last - first : 0);
+
+        if (!MINMAX_BEFORE(keys[best], moving.key)) break;
+        move_heapnode(&arrays, pos, best);
+        moves++;
+        pos = best;
+        if (best < first) break; /* A child; its subtree is the other kind. */
+
+        /* The node dropped two levels.  If it belongs above the grandchild's
+           parent instead, trade places with that parent and carry on down
+           with the parent's node. */
+        parent = (best - 1) / 2;
+        comparisons++;
+        if (MINMAX_BEFORE(keys[parent], moving.key)) {
+            displaced = take_heapnode(&arrays, parent, &displaced_handle);
+            place_heapnode(&arrays, parent, moving, handle);
+            moving = displaced;
+            handle = displaced_handle;
+            moves++;
+        }
+    }
+    place_heapnode(&arrays, pos, moving, handle);
+    HEAP_STAT_SIFT(heap, comparisons, moves);
+    return pos;
+}
+
+/* Moves the node at pos up a min-max heap: first past its parent if the
+   parent is the wrong kind of bound for it, then up through grandparents of
+   the same kind.  A parent that comes down is trickled into the subtree
+   below pos, which it only bounded from the other side.  Returns where the
+   node came to rest. */
+size_t minmax_bubble_up(Heap *heap, size_t pos) {
+    struct __heaparrays arrays;
+    struct __heapnode moving;
+    size_t handle;
+    size_t parent;
+    size_t grandparent;
+    size_t comparisons;
+    size_t moves;
+    int *keys;
+    int is_max;
+
+    arrays = heap_arrays(heap);
+    keys = arrays.keys;
+    moving = take_heapnode(&arrays, pos, &handle);
+    is_max = is_max_level(pos);
+    comparisons = moves = 0;
+    if (pos > 0) {
+        parent = (pos - 1) / 2;
+        comparisons++;
+        if (MINMAX_BEFORE(keys[parent], moving.key)) {
+            move_heapnode(&arrays, pos, parent);
+            moves++;
+            if (2 * pos + 1 < heap->size) minmax_trickle_down(heap, pos);
+            pos = parent;
+            is_max = !is_max;
+        }
+    }
+    while (pos > 2) {
+        grandparent = (pos - 3) / 4;
+        comparisons++;
+        if (!MINMAX_BEFORE(moving.key, keys[grandparent])) break;
+        move_heapnode(&arrays, pos, grandparent);
+        moves++;
+        pos = grandparent;
+    }
+    place_heapnode(&arrays, pos, moving, handle);
+    HEAP_STAT_SIFT(heap, comparisons, moves);
+    return pos;
+}
+
+void downheap_minmax(Heap *heap, size_t pos) {
+    minmax_trickle_down(heap, pos);
+}
+
+/* Picks the downheap loops for an arity: a scalar loop for small heaps, and
+   for large heaps the widest vector loop this CPU can run. */
+void select_downheap(Heap *heap) {
+    if (heap->order == HEAP_MIN_MAX_ORDER) {
+        heap->sift_down = heap->sift_down_large = downheap_minmax;
+        return;
+    }
+    switch (heap->arity_shift) {
+        case 1: heap->sift_down = downheap_binary; break;
+        case 2: heap->sift_down = downheap_4; break;
+        default: heap->sift_down = downheap_8; break;
+    }
+    heap->sift_down_large = heap->sift_down;
+#ifdef HEAP_X86_SIMD
+    __builtin_cpu_init();
+    if (heap->arity_shift == 3 && HEAP_USE_AVX2 && __builtin_cpu_supports("avx2")) {
+        heap->sift_down_large = downheap_8_avx2;
+    } else if (heap->arity_shift == 3 && __builtin_cpu_supports("sse4.1")) {
+        heap->sift_down_large = downheap_8_sse41;
+    }
+#endif
+}
+
+void downheap(Heap *heap, size_t pos) {
     if (heap == NULL) return;
-    last_element = heap->size - 1;
-    lchild = 2 * pos + 1;
-    rchild = 2 * pos + 2;
-    if (lchild > last_element) return; /* Has no children. */
+    if (pos >= heap->size) return;
+    if (heap->size >= HEAP_VECTOR_MIN_SIZE) {
+        heap->sift_down_large(heap, pos);
+    } else {
+        heap->sift_down(heap, pos);
+    }
+}
+
+/* Returns a handle to the free list once its node has left the heap. */
+void release_handle(Heap *heap, size_t handle) {
+    if (handle == HEAP_NO_HANDLE) return;
+    (heap->position)[handle] = heap->free_handle;
+    heap->free_handle = handle;
+}
+
+/* Sifts the node at pos whichever way restores the heap order, after it
+   was put there or had its key changed. */
+void fix_heapnode(Heap *heap, size_t pos) {
+    if (heap->order == HEAP_MIN_MAX_ORDER) {
+        if (minmax_bubble_up(heap, pos) == pos) minmax_trickle_down(heap, pos);
+    } else if (pos > 0 && (heap->keys)[pos] < (heap->keys)[(pos - 1) >> heap->arity_shift]) {
+        upheap(heap, pos);
+    } else {
+        downheap(heap, pos);
+    }
+}
 
-    if ( rchild > last_element || ( (heap->root)[lchild].key < (heap->root)[rchild].key ) ) {
+/* Takes the node at pos out of the heap, fills the hole with the last node
+   and sifts that node into place. */
+void remove_heapnode(Heap *heap, size_t pos) {
+    struct __heaparrays arrays;
+    size_t last;
 
-        if ( (heap->root)[lchild].key < (heap->root)[pos].key ) {
-            heapnode_swap(&((heap->root)[lchild]), &((heap->root)[pos]));
-            downheap(heap, lchild);
-            return;
+    if (heap->handle_of != NULL) release_handle(heap, (heap->handle_of)[pos]);
+
+    last = heap->size - 1;
+    heap->size = last;
+    if (pos == last) return;
+
+    arrays = heap_arrays(heap);
+    move_heapnode(&arrays, pos, last);
+    fix_heapnode(heap, pos);
+}
+
+/* Overwrites the root with a new node and sifts it down, which pops and
+   pushes in a single pass.  The heap must not be empty. */
+void replace_heapnode(Heap *heap, void *data, int key) {
+    struct __heaparrays arrays;
+    struct __heapnode node;
+
+    if (heap->handle_of != NULL) release_handle(heap, (heap->handle_of)[0]);
+
+    node.key = key ^ heap->key_mask;
+    node.data = data;
+    arrays = heap_arrays(heap);
+    place_heapnode(&arrays, 0, node, HEAP_NO_HANDLE);
+    downheap(heap, 0);
+}
+
+/* Returns the position of the node with the highest stored key.  In a
+   min-max heap that is one of the root's children; otherwise it is one of
+   the leaves, which all have to be checked.  The heap must not be empty. */
+size_t find_last_heapnode(Heap *heap) {
+    size_t best;
+    size_t i;
+
+    if (heap->size < 2) return 0;
+    if (heap->order == HEAP_MIN_MAX_ORDER) {
+        if (heap->size > 2 && (heap->keys)[2] > (heap->keys)[1]) return 2;
+        return 1;
+    }
+
+    best = ((heap->size - 2) >> heap->arity_shift) + 1;
+    for (i=best+1; i<heap->size; i++) {
+        if ((heap->keys)[i] > (heap->keys)[best]) best = i;
+    }
+    return best;
+}
+
+/* Allocates the handle index the first time a tracked node is pushed.  Nodes
+   already on the heap are given no handle. */
+int enable_handles(Heap *heap) {
+    size_t i;
+
+    heap->handle_of = allocate_block(heap, sizeof(size_t) * heap->alloc_size);
+    if (heap->handle_of == NULL) return 1;
+    for (i=0; i<heap->size; i++) {
+        (heap->handle_of)[i] = HEAP_NO_HANDLE;
+    }
+    return 0;
+}
+
+/* Finds an unused handle, growing the position index if needed. */
+size_t new_handle(Heap *heap) {
+    size_t handle;
+    size_t new_alloc;
+    size_t *new_block;
+
+    if (heap->free_handle != HEAP_NO_HANDLE) {
+        handle = heap->free_handle;
+        heap->free_handle = (heap->position)[handle];
+        return handle;
+    }
+
+    if (heap->handle_count == heap->handle_alloc) {
+        new_alloc = heap->handle_alloc != 0 ? heap->handle_alloc * 2 : heap->init_size;
+        if (new_alloc > SIZE_MAX / sizeof(size_t)) return HEAP_NO_HANDLE;
+        new_block = reallocate_block(heap, heap->position, sizeof(size_t) * heap->handle_alloc, sizeof(size_t) * new_alloc);
+        if (new_block == NULL) return HEAP_NO_HANDLE;
+        heap->position = new_block;
+        heap->handle_alloc = new_alloc;
+    }
+    return heap->handle_count++;
+}
+
+/* Checks that a handle refers to a node that is still on the heap. */
+int is_live_handle(Heap *heap, heap_handle handle) {
+    size_t pos;
+
+    if (heap->engine != HEAP_ARRAY_ENGINE) return is_live_poolnode(heap, handle);
+    if (heap->handle_of == NULL) return 0;
+    if (handle >= heap->handle_count) return 0;
+    pos = (heap->position)[handle];
+    return pos < heap->size && (heap->handle_of)[pos] == handle;
+}
+
+void heapify(Heap *heap) {
+    size_t i;
+
+    if (heap == NULL) return;
+    if (heap->size < 2) return;
+
+    /* Floyd's method: sift down every internal node, last parent first. */
+    i = ((heap->size - 2) >> heap->arity_shift) + 1;
+    while (i > 0) {
+        i--;
+        downheap(heap, i);
+    }
+}
+
+/* Heapsorts the nodes in place.  Each pass moves the top into the slot
+   freed at the end, which leaves the nodes in reverse pop order, so they are
+   reversed at the end.  A sorted array satisfies the heap order, so the heap
+   stays valid throughout. */
+void sort_heapnodes(Heap *heap) {
+    struct __heaparrays arrays;
+    struct __heapnode top;
+    struct __heapnode other;
+    size_t top_handle;
+    size_t other_handle;
+    size_t size;
+    size_t end;
+    size_t i;
+
+    arrays = heap_arrays(heap);
+    size = heap->size;
+    for (end = size; end > 1; end--) {
+        top = take_heapnode(&arrays, 0, &top_handle);
+        other = take_heapnode(&arrays, end - 1, &other_handle);
+        heap->size = end - 1;
+        place_heapnode(&arrays, 0, other, other_handle);
+        downheap(heap, 0);
+        place_heapnode(&arrays, end - 1, top, top_handle);
+    }
+    heap->size = size;
+
+    for (i = 0; i < size / 2; i++) {
+        top = take_heapnode(&arrays, i, &top_handle);
+        other = take_heapnode(&arrays, size - 1 - i, &other_handle);
+        place_heapnode(&arrays, i, other, other_handle);
+        place_heapnode(&arrays, size - 1 - i, top, top_handle);
+    }
+}
+
+/* Copies n key and data pairs onto the end of the heap without ordering them. */
+int heap_append(Heap *heap, const int *keys, void **data, size_t n) {
+    size_t i;
+
+    if (heap == NULL) return -1;
+    if (n > SIZE_MAX - heap->size) return 1;
+    if (heap->size + n > heap->alloc_size) {
+        if (resize_heap(heap, heap->size + n) != 0) return 1;
+    }
+
+    if (heap->key_mask == 0) {
+        memcpy(heap->keys + heap->size, keys, sizeof(int) * n);
+    } else {
+        for (i=0; i<n; i++) {
+            (heap->keys)[heap->size + i] = keys[i] ^ heap->key_mask;
+        }
+    }
+    memcpy(heap->data + heap->size, data, sizeof(void*) * n);
+    if (heap->handle_of != NULL) {
+        for (i=0; i<n; i++) {
+            (heap->handle_of)[heap->size + i] = HEAP_NO_HANDLE;
+        }
+    }
+    heap->size = heap->size + n;
+    heap->last_key = keys[n - 1];
+    return 0;
+}
+
+/* Puts nodes appended from old_size on into heap order, either by rebuilding
+   the heap bottom-up or by upheaping each new node.  A full heapify touches
+   every node once; sifting each new node up costs at most the depth of the
+   heap.  Pick whichever bound is lower. */
+void order_appended(Heap *heap, size_t old_size) {
+    size_t total;
+    size_t depth;
+    size_t i;
+
+    total = heap->size;
+    depth = 0;
+    while ((total >> depth) > 1) depth++;
+    if ((total - old_size) * depth >= total) {
+        heapify(heap);
+        return;
+    }
+    for (i=old_size; i<total; i++) {
+        upheap(heap, i);
+    }
+}
+
+/* Moves every node of one array heap onto the end of another and orders
+   them.  Returns 1, moving nothing, if the memory could not be allocated. */
+int meld_heapnodes(Heap *dst, Heap *src) {
+    size_t old_size;
+    size_t i;
+    int mask;
+
+    if (src->size > SIZE_MAX - dst->size) return 1;
+    if (dst->size + src->size > dst->alloc_size) {
+        if (resize_heap(dst, dst->size + src->size) != 0) return 1;
+    }
+
+    /* Stored keys only need converting if the heaps are in different
+       orders. */
+    old_size = dst->size;
+    mask = src->key_mask ^ dst->key_mask;
+    if (mask == 0) {
+        memcpy(dst->keys + old_size, src->keys, sizeof(int) * src->size);
+    } else {
+        for (i=0; i<src->size; i++) {
+            (dst->keys)[old_size + i] = (src->keys)[i] ^ mask;
+        }
+    }
+    memcpy(dst->data + old_size, src->data, sizeof(void*) * src->size);
+    if (dst->handle_of != NULL) {
+        for (i=0; i<src->size; i++) {
+            (dst->handle_of)[old_size + i] = HEAP_NO_HANDLE;
         }
+    }
+    dst->size = old_size + src->size;
+    order_appended(dst, old_size);
+
+    src->size = 0;
+    src->handle_count = 0;
+    src->free_handle = HEAP_NO_HANDLE;
+    return 0;
+}
+
+/* Adds a node at the end of the heap and upheaps it. */
+int push_heapnode(Heap *heap, void *data, int key, size_t handle) {
+    struct __heaparrays arrays;
+    struct __heapnode node;
+
+    while (heap->size >= heap->alloc_size) {
+        if (increase_heap_size(heap) != 0) {
+            return 1;
+        }
+    }
+    node.key = key ^ heap->key_mask;
+    node.data = data;
+    arrays = heap_arrays(heap);
+    place_heapnode(&arrays, heap->size, node, handle);
+    heap->size = heap->size + 1;
+    upheap(heap, heap->size - 1);
+    heap->last_key = key;
+    return 0;
+}
+
+/* Adds an element to a pairing or radix heap, storing its handle in handle
+   unless it is NULL.  Every pairing element is a pool node, but a radix
+   element only needs one if it is tracked.  Returns 0 on success, or 1 if the
+   memory could not be allocated or a radix heap was given a key lower than
+   the last one popped. */
+int push_poolnode(Heap *heap, void *data, int key, size_t *handle) {
+    size_t node;
+
+    node = HEAP_NO_NODE;
+    if (heap->engine == HEAP_PAIRING_ENGINE || handle != NULL) {
+        node = new_poolnode(heap, data, key);
+        if (node == HEAP_NO_NODE) return 1;
+    }
+    if (heap->engine == HEAP_PAIRING_ENGINE) {
+        pairing_insert(heap, node);
+    } else if (radix_insert(heap, data, key, node) != 0) {
+        if (node != HEAP_NO_NODE) free_poolnode(heap, node);
+        return 1;
+    }
+    heap->size = heap->size + 1;
+    heap->last_key = key;
+    if (handle != NULL) *handle = node;
+    return 0;
+}
 
-        if (rchild > last_element) return;
-        if ( (heap->root)[rchild].key < (heap->root)[pos].key ) {
-            heapnode_swap( &((heap->root)[rchild]), &((heap->root)[pos]));
-            downheap(heap, rchild);
-            return;
+/* Engines other than the array have no bulk load; they add one node at a
+   time, which is O(1) each for them anyway. */
+int push_poolnodes(Heap *heap, const int *keys, void **data, size_t n) {
+    size_t i;
+
+    for (i=0; i<n; i++) {
+        if (push_poolnode(heap, data[i], keys[i], NULL) != 0) return 1;
+    }
+    return 0;
+}
+
+/* Empties a pairing or radix heap whose elements have all been moved
+   elsewhere, freeing every pool node at once. */
+void clear_pool(Heap *heap) {
+    heap->size = 0;
+    heap->handle_count = 0;
+    heap->free_handle = HEAP_NO_NODE;
+    heap->root = HEAP_NO_NODE;
+}
+
+/* Moves every node of one pairing heap into the pool of another, then links
+   the two roots.  Returns 1, moving nothing, if the pool could not grow. */
+int meld_poolnodes(Heap *dst, Heap *src) {
+    size_t step;
+
+    if (src->handle_count > SIZE_MAX - dst->handle_count) return 1;
+    if (dst->handle_count + src->handle_count > dst->handle_alloc) {
+        step = growth_step(dst, dst->handle_alloc);
+        if (step < dst->handle_count + src->handle_count - dst->handle_alloc) {
+            step = dst->handle_count + src->handle_count - dst->handle_alloc;
         }
-    } else { 
-        if ( (heap->root)[rchild].key < (heap->root)[pos].key ) {
-            heapnode_swap( &((heap->root)[rchild]), &((heap->root)[pos]));
-            downheap(heap, rchild);
-            return;
-        }  
+        if (resize_pool(dst, dst->handle_alloc + step) != 0) return 1;
     }
 
-    return; /* Node is in its proper spot. */
+    pairing_meld(dst, src);
+    dst->size = dst->size + src->size;
+    clear_pool(src);
+    return 0;
+}
+
+/* Moves every entry of one radix heap into another. */
+int meld_radixentries(Heap *dst, Heap *src) {
+    int status;
+
+    status = radix_meld(dst, src);
+    if (status != 0) return status;
+    dst->size = dst->size + src->size;
+    clear_pool(src);
+    return 0;
+}
+
+/* Returns the node of a pairing heap with the highest stored key.  Pool
+   nodes are in no particular order, so all of them have to be checked. */
+size_t find_last_poolnode(Heap *heap) {
+    size_t best;
+    size_t i;
+
+    best = HEAP_NO_NODE;
+    for (i=0; i<heap->handle_count; i++) {
+        if ((heap->nodes)[i].prev == HEAP_FREE_NODE) continue;
+        if (best == HEAP_NO_NODE || (heap->nodes)[i].key > (heap->nodes)[best].key) best = i;
+    }
+    return best;
+}
+
+/* The functions below refer to an element by its spot: its position in the
+   arrays of an array heap, its node in the pool of a pairing heap, or its
+   RADIX_SPOT() in a radix heap. */
+
+/* Returns the spot of the element that pops next.  The heap must not be
+   empty. */
+HEAP_INLINE size_t top_spot(Heap *heap) {
+    if (heap->engine == HEAP_ARRAY_ENGINE) return 0;
+    if (heap->engine == HEAP_PAIRING_ENGINE) return heap->root;
+    return radix_top(heap);
+}
+
+/* Returns the key of the element at a spot, as it was pushed. */
+HEAP_INLINE int spot_key(Heap *heap, size_t spot) {
+    if (heap->engine == HEAP_ARRAY_ENGINE) return (heap->keys)[spot] ^ heap->key_mask;
+    if (heap->engine == HEAP_PAIRING_ENGINE) return (heap->nodes)[spot].key ^ heap->key_mask;
+    return radix_spot_key(heap, spot);
+}
+
+HEAP_INLINE void *spot_data(Heap *heap, size_t spot) {
+    if (heap->engine == HEAP_ARRAY_ENGINE) return (heap->data)[spot];
+    if (heap->engine == HEAP_PAIRING_ENGINE) return (heap->nodes)[spot].data;
+    return radix_spot_data(heap, spot);
+}
+
+/* Returns the spot of the lowest key if want_max is 0, or of the highest
+   key otherwise.  The heap must not be empty. */
+size_t end_spot(Heap *heap, int want_max) {
+    if (want_max == (heap->order == HEAP_MAX_ORDER)) return top_spot(heap);
+    if (heap->engine == HEAP_ARRAY_ENGINE) return find_last_heapnode(heap);
+    if (heap->engine == HEAP_PAIRING_ENGINE) return find_last_poolnode(heap);
+    return radix_find_last(heap);
+}
+
+void remove_spot(Heap *heap, size_t spot) {
+    if (heap->engine == HEAP_ARRAY_ENGINE) {
+        remove_heapnode(heap, spot);
+        return;
+    }
+    if (heap->engine == HEAP_PAIRING_ENGINE) {
+        pairing_remove(heap, spot);
+        free_poolnode(heap, spot);
+    } else {
+        radix_remove(heap, spot);
+    }
+    heap->size = heap->size - 1;
+}
+
+/* Gives the element at a spot a new key and moves it into place.  Returns 0,
+   or -1 if a radix heap was given a key lower than the last one popped or
+   could not grow a bucket for it. */
+int set_spot_key(Heap *heap, size_t spot, int key) {
+    if (heap->engine == HEAP_ARRAY_ENGINE) {
+        (heap->keys)[spot] = key ^ heap->key_mask;
+        fix_heapnode(heap, spot);
+        return 0;
+    }
+    if (heap->engine == HEAP_PAIRING_ENGINE) {
+        pairing_set_key(heap, spot, key ^ heap->key_mask);
+        return 0;
+    }
+    return radix_set_key(heap, spot, key) != 0 ? -1 : 0;
+}
+
+/* Returns the spot of the element a live handle refers to. */
+size_t handle_spot(Heap *heap, heap_handle handle) {
+    if (heap->engine == HEAP_ARRAY_ENGINE) return (heap->position)[handle];
+    if (heap->engine == HEAP_PAIRING_ENGINE) return handle;
+    return radix_node_spot(heap, handle);
 }
 
 #include <stdio.h>
 void print_entire_heap(Heap *heap) {
-    for (int i=0; i<heap_get_size(heap); i++) {
-        printf("%d: %s | ", i, (char*) ((heap->root)+i)->data );
+    unsigned int b;
+    size_t i;
+
+    if (heap->engine == HEAP_RADIX_ENGINE) {
+        for (b=0; b<HEAP_RADIX_BUCKETS; b++) {
+            for (i=0; i<(heap->buckets)[b].size; i++) {
+                printf("%u.%lu: %s | ", b, (unsigned long) i, (char*) (heap->buckets)[b].entries[i].data);
+            }
+        }
+        return;
+    }
+    if (heap->engine == HEAP_PAIRING_ENGINE) {
+        for (i=0; i<heap->handle_count; i++) {
+            if ((heap->nodes)[i].prev == HEAP_FREE_NODE) continue;
+            printf("%lu: %s | ", (unsigned long) i, (char*) (heap->nodes)[i].data);
+        }
+        return;
+    }
+    for (i=0; i<heap->size; i++) {
+        printf("%d: %s | ", (int) i, (char*) (heap->data)[i] );
     }
 }
 
+void set_allocator(Heap *heap, const struct allocator *allocator) {
+    if (allocator != NULL) {
+        heap->allocator = *allocator;
+        return;
+    }
+    heap->allocator.allocate = NULL;
+    heap->allocator.reallocate = NULL;
+    heap->allocator.release = NULL;
+    heap->allocator.context = NULL;
+}
+
+/* Zeroes a new heap's counters, counting the heap itself as an allocation. */
+void clear_stats(Heap *heap) {
+#ifdef HEAP_STATS
+    memset(&heap->stats, 0, sizeof(heap->stats));
+    heap->stats.allocations = 1;
+#else
+    (void) heap;
+#endif
+}
+
 /* External functions */
 
 Heap *create_heap(size_t init_size){
+    return create_dary_heap(init_size, 2);
+}
+
+Heap *create_dary_heap(size_t init_size, unsigned int arity) {
+    return create_ordered_heap(init_size, arity, HEAP_MIN_ORDER);
+}
+
+Heap *create_ordered_heap(size_t init_size, unsigned int arity, enum heap_order order) {
+    return create_allocated_heap(init_size, arity, order, NULL);
+}
+
+Heap *create_allocated_heap(size_t init_size, unsigned int arity, enum heap_order order,
+                            const struct allocator *allocator) {
     Heap *new;
-    
+    unsigned int shift;
+
     if (init_size < 1) return NULL;
-    new = malloc(sizeof(Heap));
+    if (order != HEAP_MIN_ORDER && order != HEAP_MAX_ORDER && order != HEAP_MIN_MAX_ORDER) return NULL;
+    if (order == HEAP_MIN_MAX_ORDER && arity != 2) return NULL;
+    if (init_size > (SIZE_MAX - HEAP_CACHE_LINE) / sizeof(void*)) return NULL;
+    for (shift = 1; shift < 3 && (1u << shift) != arity; shift++);
+    if ((1u << shift) != arity) return NULL;
+    if (allocator != NULL
+        && (allocator->allocate == NULL || allocator->reallocate == NULL || allocator->release == NULL)) {
+        return NULL;
+    }
+
+    if (allocator == NULL) {
+        new = malloc(sizeof(Heap));
+    } else {
+        new = allocator->allocate(allocator->context, sizeof(Heap));
+    }
     if (new != NULL) {
-        new->root = malloc(sizeof(struct __heapnode) * init_size);
+        set_allocator(new, allocator);
+        clear_stats(new);
+        new->key_block = allocate_block(new, sizeof(int) * init_size + HEAP_CACHE_LINE);
+        new->data = allocate_block(new, sizeof(void*) * init_size);
+        if (new->key_block == NULL || new->data == NULL) {
+            release_block(new, new->data, sizeof(void*) * init_size);
+            release_block(new, new->key_block, sizeof(int) * init_size + HEAP_CACHE_LINE);
+            release_block(new, new, sizeof(Heap));
+            return NULL;
+        }
+        new->keys = align_keys(new->key_block);
+        new->handle_of = NULL;
+        new->position = NULL;
+        new->handle_count = new->handle_alloc = 0;
+        new->free_handle = HEAP_NO_HANDLE;
         new->size = 0;
         new->alloc_size = new->init_size = init_size;
+        new->arity = arity;
+        new->arity_shift = shift;
+        new->order = order;
+        new->key_mask = order == HEAP_MAX_ORDER ? -1 : 0;
+        new->engine = HEAP_ARRAY_ENGINE;
+        new->bounded = 0;
+        new->nodes = NULL;
+        new->root = HEAP_NO_NODE;
+        new->buckets = NULL;
+        new->snapshot = NULL;
+        new->snapshot_size = 0;
+        select_downheap(new);
+        new->growth_factor = HEAP_DEFAULT_GROWTH;
+        new->max_growth = 0;
+    }
+
+    return new;
+}
+
+Heap *create_bounded_heap(size_t capacity, unsigned int arity, enum heap_order order) {
+    Heap *new;
+
+    new = create_ordered_heap(capacity, arity, order);
+    if (new != NULL) new->bounded = 1;
+    return new;
+}
+
+Heap *create_engine_heap(size_t init_size, enum heap_engine engine) {
+    Heap *new;
+
+    if (engine == HEAP_ARRAY_ENGINE) return create_heap(init_size);
+    if (engine != HEAP_PAIRING_ENGINE && engine != HEAP_RADIX_ENGINE) return NULL;
+    if (init_size < 1) return NULL;
+
+    new = malloc(sizeof(Heap));
+    if (new == NULL) return NULL;
+    set_allocator(new, NULL);
+    clear_stats(new);
+    new->keys = NULL;
+    new->data = NULL;
+    new->key_block = NULL;
+    new->sift_down = new->sift_down_large = NULL;
+    new->handle_of = NULL;
+    new->position = NULL;
+    new->handle_count = new->handle_alloc = 0;
+    new->free_handle = HEAP_NO_NODE;
+    new->size = 0;
+    new->alloc_size = 0;
+    new->init_size = init_size;
+    new->arity = 2;
+    new->arity_shift = 1;
+    new->order = HEAP_MIN_ORDER;
+    new->key_mask = 0;
+    new->engine = engine;
+    new->bounded = 0;
+    new->nodes = NULL;
+    new->root = HEAP_NO_NODE;
+    new->buckets = NULL;
+    new->snapshot = NULL;
+    new->snapshot_size = 0;
+    new->growth_factor = HEAP_DEFAULT_GROWTH;
+    new->max_growth = 0;
+    if (resize_pool(new, init_size) != 0
+        || (engine == HEAP_RADIX_ENGINE && radix_init(new) != 0)) {
+        destroy_heap(new, NULL);
+        return NULL;
     }
 
     return new;
@@ -150,57 +1243,377 @@ void destroy_heap(Heap *heap, void (*__dest_func) (void*)) {
     size_t i;
 
     if (heap == NULL) return;
-    for (i=0; i<heap->size; i++) {
-        destroy_heapnode(&((heap->root)[i]), __dest_func);
+    if (heap->engine == HEAP_ARRAY_ENGINE) {
+        for (i=0; i<heap->size; i++) {
+            destroy_heapnode((heap->data)[i], __dest_func);
+        }
+    } else if (heap->engine == HEAP_PAIRING_ENGINE) {
+        for (i=0; i<heap->handle_count; i++) {
+            if ((heap->nodes)[i].prev == HEAP_FREE_NODE) continue;
+            destroy_heapnode((heap->nodes)[i].data, __dest_func);
+        }
+    } else {
+        radix_destroy(heap, __dest_func);
+    }
+    if (heap->engine == HEAP_ARRAY_ENGINE) {
+        release_block(heap, heap->position, sizeof(size_t) * heap->handle_alloc);
+        release_block(heap, heap->handle_of, sizeof(size_t) * heap->alloc_size);
+        if (heap->snapshot != NULL) {
+            unmap_snapshot(heap);
+        } else {
+            release_block(heap, heap->data, sizeof(void*) * heap->alloc_size);
+            release_block(heap, heap->key_block, sizeof(int) * heap->alloc_size + HEAP_CACHE_LINE);
+        }
+    } else {
+        release_block(heap, heap->nodes, sizeof(struct __poolnode) * heap->handle_alloc);
     }
-    free(heap->root);
-    free(heap);
+    release_block(heap, heap, sizeof(Heap));
 }
 
 void *heap_peek(Heap *heap) {
+    size_t spot;
+
     if (heap == NULL) return NULL;
     heap->last_key = INT_MAX;
-    if (heap->root == NULL) return NULL;
-    heap->last_key = (heap->root)[0].key;
-    return (heap->root)[0].data;
+    if (heap->size == 0) return NULL;
+
+    spot = top_spot(heap);
+    heap->last_key = spot_key(heap, spot);
+    return spot_data(heap, spot);
 }
 
 void *heap_pop(Heap *heap) {
+    size_t spot;
     void *data;
 
     if (heap == NULL) return NULL;
     heap->last_key = INT_MAX;
     if (heap->size == 0) return NULL;
 
-    heap->size = heap->size - 1;
-    if (heap->size != 0) {
-        heapnode_swap( &((heap->root)[0]), &((heap->root)[heap->size]) );
+    spot = top_spot(heap);
+    heap->last_key = spot_key(heap, spot);
+    data = spot_data(heap, spot);
+    remove_spot(heap, spot);
+    return data;
+}
+
+int heap_peek_with_key(Heap *heap, void **data, int *key) {
+    size_t spot;
+
+    if (heap == NULL) return -1;
+    if (heap->size == 0) return 1;
+
+    spot = top_spot(heap);
+    if (data != NULL) *data = spot_data(heap, spot);
+    if (key != NULL) *key = spot_key(heap, spot);
+    return 0;
+}
+
+int heap_pop_with_key(Heap *heap, void **data, int *key) {
+    size_t spot;
+
+    if (heap == NULL) return -1;
+    if (heap->size == 0) return 1;
+
+    spot = top_spot(heap);
+    if (data != NULL) *data = spot_data(heap, spot);
+    if (key != NULL) *key = spot_key(heap, spot);
+    remove_spot(heap, spot);
+    return 0;
+}
+
+size_t heap_pop_n(Heap *heap, size_t n, int *keys, void **data) {
+    size_t spot;
+    size_t i;
+
+    if (heap == NULL) return 0;
+    if (n > heap->size) n = heap->size;
+
+    for (i=0; i<n; i++) {
+        spot = top_spot(heap);
+        if (keys != NULL) keys[i] = spot_key(heap, spot);
+        if (data != NULL) data[i] = spot_data(heap, spot);
+        remove_spot(heap, spot);
     }
+    return n;
+}
 
-    heap->last_key = (heap->root)[heap->size].key;
-    data = heap->root[heap->size].data;
+void *peek_end(Heap *heap, int want_max) {
+    size_t spot;
 
-    downheap(heap, 0);
+    if (heap == NULL) return NULL;
+    heap->last_key = want_max ? INT_MIN : INT_MAX;
+    if (heap->size == 0) return NULL;
+
+    spot = end_spot(heap, want_max);
+    heap->last_key = spot_key(heap, spot);
+    return spot_data(heap, spot);
+}
+
+void *pop_end(Heap *heap, int want_max) {
+    size_t spot;
+    void *data;
+
+    if (heap == NULL) return NULL;
+    heap->last_key = want_max ? INT_MIN : INT_MAX;
+    if (heap->size == 0) return NULL;
+
+    spot = end_spot(heap, want_max);
+    heap->last_key = spot_key(heap, spot);
+    data = spot_data(heap, spot);
+    remove_spot(heap, spot);
     return data;
 }
 
+void *heap_peek_min(Heap *heap) {
+    return peek_end(heap, 0);
+}
+
+void *heap_peek_max(Heap *heap) {
+    return peek_end(heap, 1);
+}
+
+void *heap_pop_min(Heap *heap) {
+    return pop_end(heap, 0);
+}
+
+void *heap_pop_max(Heap *heap) {
+    return pop_end(heap, 1);
+}
+
 void *heap_push(Heap *heap, void *data, int key) {
-    int new_position;
+    if (heap == NULL) return NULL;
+    if (heap->engine != HEAP_ARRAY_ENGINE) {
+        if (push_poolnode(heap, data, key, NULL) != 0) return NULL;
+        return heap;
+    }
+    if (push_heapnode(heap, data, key, HEAP_NO_HANDLE) != 0) return NULL;
+    return heap;
+}
+
+heap_handle heap_push_tracked(Heap *heap, void *data, int key) {
+    heap_handle handle;
+
+    if (heap == NULL) return HEAP_NO_HANDLE;
+    if (heap->engine != HEAP_ARRAY_ENGINE) {
+        if (push_poolnode(heap, data, key, &handle) != 0) return HEAP_NO_HANDLE;
+        return handle;
+    }
+    if (heap->handle_of == NULL && enable_handles(heap) != 0) return HEAP_NO_HANDLE;
+
+    handle = new_handle(heap);
+    if (handle == HEAP_NO_HANDLE) return HEAP_NO_HANDLE;
+    if (push_heapnode(heap, data, key, handle) != 0) {
+        release_handle(heap, handle);
+        return HEAP_NO_HANDLE;
+    }
+    return handle;
+}
+
+void *heap_replace_top(Heap *heap, void *data, int key) {
+    size_t spot;
+    void *top;
+    int top_key;
 
     if (heap == NULL) return NULL;
+    if (heap->size == 0) {
+        heap_push(heap, data, key);
+        heap->last_key = INT_MAX;
+        return NULL;
+    }
 
-    new_position = heap->size;
-    while (heap->size >= heap->alloc_size) {
-        if (increase_heap_size(heap) != 0) {
+    spot = top_spot(heap);
+    top = spot_data(heap, spot);
+    top_key = spot_key(heap, spot);
+    if (heap->engine == HEAP_ARRAY_ENGINE) {
+        replace_heapnode(heap, data, key);
+    } else {
+        /* The old top keeps its spot while the new element goes in, so it
+           can be taken out afterwards; a failed push leaves the heap as it
+           was. */
+        if (push_poolnode(heap, data, key, NULL) != 0) {
+            heap->last_key = INT_MAX;
             return NULL;
         }
+        remove_spot(heap, spot);
     }
-    (heap->root)[new_position].data = data;
-    (heap->root)[new_position].key = key;
-    heap->size = heap->size + 1;
-    upheap(heap, new_position);
-    heap->last_key = key;
-    return heap;
+    heap->last_key = top_key;
+    return top;
+}
+
+size_t heap_offer_batch(Heap *heap, const int *keys, void **data, size_t n, void (*__evict_func) (void*)) {
+    size_t room;
+    size_t accepted;
+    size_t i;
+    int threshold;
+
+    if (heap == NULL || keys == NULL || data == NULL) return 0;
+
+    /* Fill whatever room is left in one batch push. */
+    room = heap->bounded ? heap->alloc_size - heap->size : SIZE_MAX;
+    accepted = n < room ? n : room;
+    if (accepted > 0 && heap_push_batch(heap, keys, data, accepted) != 0) return 0;
+
+    /* The heap is full, so only the array engine gets here.  The root's
+       stored key is kept in a local, so a rejected item is one comparison
+       and never reads the heap. */
+    if (accepted == n) return n;
+    threshold = (heap->keys)[0];
+    for (i=accepted; i<n; i++) {
+        if ((keys[i] ^ heap->key_mask) <= threshold) {
+            destroy_heapnode(data[i], __evict_func);
+            continue;
+        }
+        destroy_heapnode((heap->data)[0], __evict_func);
+        replace_heapnode(heap, data[i], keys[i]);
+        threshold = (heap->keys)[0];
+        accepted++;
+    }
+    return accepted;
+}
+
+int heap_decrease_key(Heap *heap, heap_handle handle, int key) {
+    size_t pos;
+
+    if (heap == NULL) return -1;
+    if (!is_live_handle(heap, handle)) return -1;
+
+    pos = handle_spot(heap, handle);
+    if (spot_key(heap, pos) < key) return 1;
+    return set_spot_key(heap, pos, key);
+}
+
+int heap_increase_key(Heap *heap, heap_handle handle, int key) {
+    size_t pos;
+
+    if (heap == NULL) return -1;
+    if (!is_live_handle(heap, handle)) return -1;
+
+    pos = handle_spot(heap, handle);
+    if (key < spot_key(heap, pos)) return 1;
+    return set_spot_key(heap, pos, key);
+}
+
+void *heap_remove(Heap *heap, heap_handle handle) {
+    size_t pos;
+    void *data;
+
+    if (heap == NULL) return NULL;
+    heap->last_key = INT_MAX;
+    if (!is_live_handle(heap, handle)) return NULL;
+
+    pos = handle_spot(heap, handle);
+    heap->last_key = spot_key(heap, pos);
+    data = spot_data(heap, pos);
+    remove_spot(heap, pos);
+    return data;
+}
+
+int heap_build(Heap *heap, const int *keys, void **data, size_t n) {
+    int status;
+
+    if (heap == NULL) return -1;
+    if (n == 0) return 0;
+    if (keys == NULL || data == NULL) return -1;
+    if (heap->engine != HEAP_ARRAY_ENGINE) return push_poolnodes(heap, keys, data, n);
+
+    status = heap_append(heap, keys, data, n);
+    if (status != 0) return status;
+    heapify(heap);
+    return 0;
+}
+
+int heap_push_batch(Heap *heap, const int *keys, void **data, size_t n) {
+    size_t old_size;
+    int status;
+
+    if (heap == NULL) return -1;
+    if (n == 0) return 0;
+    if (keys == NULL || data == NULL) return -1;
+    if (heap->engine != HEAP_ARRAY_ENGINE) return push_poolnodes(heap, keys, data, n);
+
+    old_size = heap->size;
+    status = heap_append(heap, keys, data, n);
+    if (status != 0) return status;
+    order_appended(heap, old_size);
+    return 0;
+}
+
+int heap_meld(Heap *dst, Heap *src) {
+    if (dst == NULL || src == NULL || dst == src) return -1;
+    if (dst->engine != src->engine) return -1;
+    if (src->size == 0) return 0;
+
+    if (dst->engine == HEAP_ARRAY_ENGINE) return meld_heapnodes(dst, src);
+    if (dst->engine == HEAP_PAIRING_ENGINE) return meld_poolnodes(dst, src);
+    return meld_radixentries(dst, src);
+}
+
+int heap_sort(Heap *heap, int *keys, void **data) {
+    size_t i;
+
+    if (heap == NULL) return -1;
+    if (heap->engine != HEAP_ARRAY_ENGINE || heap->order == HEAP_MIN_MAX_ORDER) return -1;
+
+    sort_heapnodes(heap);
+    for (i=0; i<heap->size; i++) {
+        if (keys != NULL) keys[i] = (heap->keys)[i] ^ heap->key_mask;
+        if (data != NULL) data[i] = (heap->data)[i];
+    }
+    return 0;
+}
+
+int heap_get_stats(Heap *heap, struct heap_stats *stats) {
+#ifdef HEAP_STATS
+    unsigned int i;
+#endif
+
+    if (heap == NULL || stats == NULL) return -1;
+    memset(stats, 0, sizeof(*stats));
+#ifdef HEAP_STATS
+    stats->comparisons = __atomic_load_n(&heap->stats.comparisons, __ATOMIC_RELAXED);
+    stats->moves = __atomic_load_n(&heap->stats.moves, __ATOMIC_RELAXED);
+    stats->sifts = __atomic_load_n(&heap->stats.sifts, __ATOMIC_RELAXED);
+    for (i=0; i<HEAP_STATS_DEPTHS; i++) {
+        stats->sift_depth[i] = __atomic_load_n(&heap->stats.sift_depth[i], __ATOMIC_RELAXED);
+    }
+    stats->allocations = __atomic_load_n(&heap->stats.allocations, __ATOMIC_RELAXED);
+    stats->reallocs = __atomic_load_n(&heap->stats.reallocs, __ATOMIC_RELAXED);
+    stats->realloc_bytes = __atomic_load_n(&heap->stats.realloc_bytes, __ATOMIC_RELAXED);
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+int heap_set_growth(Heap *heap, double growth_factor, size_t max_growth) {
+    if (heap == NULL) return -1;
+    if (!(growth_factor > 1.0)) return -1;
+
+    heap->growth_factor = growth_factor;
+    heap->max_growth = max_growth;
+    return 0;
+}
+
+int heap_reserve(Heap *heap, size_t capacity) {
+    if (heap == NULL) return -1;
+    if (capacity <= heap->alloc_size) return 0;
+    if (heap->engine != HEAP_ARRAY_ENGINE) return resize_pool(heap, capacity);
+    return resize_heap(heap, capacity);
+}
+
+int heap_shrink_to_fit(Heap *heap) {
+    size_t new_size;
+
+    if (heap == NULL) return -1;
+    if (heap->engine != HEAP_ARRAY_ENGINE) {
+        new_size = heap->handle_count > heap->init_size ? heap->handle_count : heap->init_size;
+        if (new_size >= heap->alloc_size) return 0;
+        return resize_pool(heap, new_size);
+    }
+    new_size = heap->size > heap->init_size ? heap->size : heap->init_size;
+    if (new_size >= heap->alloc_size) return 0;
+    return resize_heap(heap, new_size);
 }
 
 size_t heap_get_size(Heap *heap) {
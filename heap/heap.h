@@ -26,34 +26,293 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "../alloc/allocator.h"
 
 typedef struct heap Heap;
 
+/* Size of a cache line.  Heap keys are aligned so that the children of a
+   node start on a line of this size. */
+#define HEAP_CACHE_LINE 64
+
+/* Refers to one element of a heap for as long as it stays on the heap. */
+typedef size_t heap_handle;
+
+/* Returned in place of a handle when one could not be made. */
+#define HEAP_NO_HANDLE ((heap_handle) -1)
+
+/* Which key comes out of heap_pop() and heap_peek().  A min-max heap keeps
+   both ends at hand: heap_pop() gives the lowest key, and heap_pop_max() the
+   highest, both in O(log n). */
+enum heap_order {
+    HEAP_MIN_ORDER,
+    HEAP_MAX_ORDER,
+    HEAP_MIN_MAX_ORDER
+};
+
+/* How a heap stores its elements.  See create_engine_heap(). */
+enum heap_engine {
+    HEAP_ARRAY_ENGINE,
+    HEAP_PAIRING_ENGINE,
+    HEAP_RADIX_ENGINE
+};
+
+/* The factor by which a full heap multiplies its allocation, unless changed
+   with heap_set_growth(). */
+#define HEAP_DEFAULT_GROWTH 2.0
+
 /* Creates a new heap, given an initial size.  The heap will need to be freed
    with a call to destroy_heap() after use. */
 Heap *create_heap(size_t init_size);
 
+/* Creates a new d-ary heap, where every node has arity children instead of
+   two.  Arity may be 2, 4 or 8.  A wider heap is shallower, and since keys
+   are stored apart from data and aligned to HEAP_CACHE_LINE, the keys of all
+   children of a node sit in one cache line, so large heaps miss the cache
+   less often when popping.  Once an 8-ary heap is large, it compares children
+   with AVX2 or SSE4.1 instructions when the CPU has them.  Pushes get cheaper
+   too, while each downheap level compares more children.  Returns NULL if the
+   arity is not supported.  create_heap(n) is create_dary_heap(n, 2). */
+Heap *create_dary_heap(size_t init_size, unsigned int arity);
+
+/* Creates a new heap with the given arity and order.  A HEAP_MAX_ORDER heap
+   pops its highest key first, and is otherwise the same as a min-heap.  A
+   HEAP_MIN_MAX_ORDER heap must have an arity of 2; its levels alternate
+   between holding the lowest and highest keys below them, so each pop costs
+   a few more comparisons than a plain heap.  Returns NULL if the arity or
+   order is not supported.  create_dary_heap(n, d) is
+   create_ordered_heap(n, d, HEAP_MIN_ORDER). */
+Heap *create_ordered_heap(size_t init_size, unsigned int arity, enum heap_order order);
+
+/* Works like create_ordered_heap(), but takes every block the heap needs,
+   the Heap itself included, from allocator (see allocator.h) rather than
+   malloc().  A heap made with an arena's allocator can be released with the
+   arena instead of destroy_heap().  A NULL allocator means malloc().  Returns
+   NULL as create_ordered_heap() does, or if the allocator lacks any of its
+   functions. */
+Heap *create_allocated_heap(size_t init_size, unsigned int arity, enum heap_order order,
+                            const struct allocator *allocator);
+
+/* Creates a heap like create_ordered_heap() that holds at most capacity
+   elements and never reallocates.  A push, build or meld that would overflow
+   it fails as if memory had run out.  With heap_replace_top() and
+   heap_offer_batch() it keeps the capacity best elements of a stream: a
+   HEAP_MIN_ORDER heap keeps the highest keys, with the lowest of them on top
+   as the bar to beat.  Returns NULL if capacity is 0, the arity or order is
+   not supported, or the memory could not be allocated. */
+Heap *create_bounded_heap(size_t capacity, unsigned int arity, enum heap_order order);
+
+/* Creates a new min-heap that stores its elements with the given engine.
+   Every other function works the same on it, so callers need not know which
+   engine a heap uses.
+
+   HEAP_ARRAY_ENGINE is the binary heap made by create_heap().
+
+   HEAP_PAIRING_ENGINE keeps a tree of nodes.  Pushing and heap_decrease_key()
+   are O(1), and popping is O(log n) amortized, which suits workloads that
+   lower many keys, such as shortest path searches.
+
+   HEAP_RADIX_ENGINE is for monotone keys: once the lowest key has been popped
+   or peeked at, no key lower than it may be pushed, or given by
+   heap_decrease_key().  Keys are sorted into buckets by their highest bit
+   that differs from that key, so every operation is O(1) amortized and pops
+   read each bucket in order.  A push of a key that is too low fails.  Only
+   tracked elements take a node, which records where the element is.
+
+   On both, heap_build() and heap_push_batch() add one element at a time, and
+   heap_peek_max() and heap_pop_max() search every element (every element of
+   the highest bucket, on a radix heap).  Returns NULL if the engine is not
+   supported or the memory could not be allocated. */
+Heap *create_engine_heap(size_t init_size, enum heap_engine engine);
+
 /* Destroys an existing heap and all the data it contains. If your heap is 
    storing pointers to malloc'd data, pass a function that frees your data to
    __dest_func. If __dest_func is NULL, the data will not be freed. */
 void destroy_heap(Heap *heap, void (*__dest_func) (void*));
 
-/* Returns the value of the data with the lowest key. Sets the global variable
-   LAST_KEY with the value associated with that key.  Does not remove from the 
-   heap. If the heap is invalid, or nothing is currently present on the heap,
-   LAST_KEY is set to the system's maximum integer value, INT_MAX, as set in
-   the system header file limits.h. */
+/* Returns the value of the data with the lowest key (the highest, on a
+   HEAP_MAX_ORDER heap). Sets the global variable LAST_KEY with the value
+   associated with that key.  Does not remove from the heap. If the heap is
+   invalid, or nothing is currently present on the heap, LAST_KEY is set to
+   the system's maximum integer value, INT_MAX, as set in the system header
+   file limits.h. */
 void *heap_peek(Heap *heap);
 
-/* Returns the value of the data with the lowest key, and sets the global
-   variable LAST_KEY with the value of the key.  Removes the data from the heap
-   and performs a downheap to rebalance. */
+/* Returns the value of the data with the lowest key (the highest, on a
+   HEAP_MAX_ORDER heap), and sets the global variable LAST_KEY with the value
+   of the key.  Removes the data from the heap and performs a downheap to
+   rebalance. */
 void *heap_pop(Heap *heap);
 
+/* Work like heap_peek() and heap_pop(), but hand back the key along with the
+   data, storing them in whichever of data and key are not NULL.  LAST_KEY is
+   left alone, so nothing is written to the heap when peeking.  Return 0 on
+   success, 1 if the heap is empty, or -1 if the heap is invalid. */
+int heap_peek_with_key(Heap *heap, void **data, int *key);
+int heap_pop_with_key(Heap *heap, void **data, int *key);
+
+/* Pops up to n elements in order, storing their keys and data in the arrays
+   keys and data, either of which may be NULL.  Returns the number of elements
+   popped, which is less than n only if the heap ran out.  LAST_KEY is left
+   alone. */
+size_t heap_pop_n(Heap *heap, size_t n, int *keys, void **data);
+
 /* Adds a new data and key pair to the heap, and performs an upheap to 
    rebalance. */
 void *heap_push(Heap *heap, void *data, int key);
 
+/* Pops the top element and pushes a new one in its place.  On an array heap
+   this overwrites the root and runs a single downheap, about half the work of
+   heap_pop() followed by heap_push().  Returns the popped data and sets
+   LAST_KEY to its key.  If the heap is empty, the new element is just pushed,
+   and NULL is returned with LAST_KEY set to INT_MAX, as it is if the heap is
+   invalid or the push fails. */
+void *heap_replace_top(Heap *heap, void *data, int key);
+
+/* Offers n key and data pairs, given as two parallel arrays, to a bounded
+   heap.  Pairs are pushed while there is room.  After that, a pair whose key
+   would pop after the top replaces the top; any other pair is rejected by a
+   single comparison against a copy of the top key, without touching the
+   heap.  The data of every rejected pair and every replaced top is passed to
+   __evict_func unless it is NULL.  On a heap that is not bounded, every pair
+   is pushed.  Returns the number of pairs accepted, or 0 if the arguments
+   are invalid or the memory for the first pushes could not be allocated. */
+size_t heap_offer_batch(Heap *heap, const int *keys, void **data, size_t n, void (*__evict_func) (void*));
+
+/* Return the data with the lowest or highest key, whatever the order of the
+   heap, and set LAST_KEY to that key.  On a min-max heap both ends are found
+   in O(1) and popped in O(log n).  On a plain heap the far end has to be
+   searched for among the leaves, which takes O(n).  If the heap is invalid
+   or empty, they return NULL and set LAST_KEY to INT_MAX for the lowest end
+   or INT_MIN for the highest. */
+void *heap_peek_min(Heap *heap);
+void *heap_peek_max(Heap *heap);
+void *heap_pop_min(Heap *heap);
+void *heap_pop_max(Heap *heap);
+
+/* Works like heap_push(), but returns a handle that can later be passed to
+   heap_decrease_key(), heap_increase_key() or heap_remove().  The handle stays
+   valid until its element is popped or removed; after that it may be reused
+   for a new element.  Returns HEAP_NO_HANDLE if the push failed.  The first
+   tracked push makes the heap keep a position index, which every later sift
+   keeps up to date. */
+heap_handle heap_push_tracked(Heap *heap, void *data, int key);
+
+/* Lowers the key of a tracked element and sifts it into place, in O(log n).
+   Returns 0 on success, 1 if the new key is higher than the current one, or
+   -1 if the heap or handle is invalid, or if a radix heap could not take the
+   new key because it is too low or the memory could not be allocated. */
+int heap_decrease_key(Heap *heap, heap_handle handle, int key);
+
+/* Raises the key of a tracked element and sifts it into place, in O(log n).
+   Returns 0 on success, 1 if the new key is lower than the current one, or
+   -1 if the heap or handle is invalid, or if a radix heap could not allocate
+   the memory to move it. */
+int heap_increase_key(Heap *heap, heap_handle handle, int key);
+
+/* Removes a tracked element from anywhere in the heap, in O(log n).  Returns
+   its data and sets LAST_KEY to its key, like heap_pop().  Returns NULL if the
+   heap or handle is invalid. */
+void *heap_remove(Heap *heap, heap_handle handle);
+
+/* Adds n key and data pairs, given as two parallel arrays, to the heap and
+   rebuilds it bottom-up in O(size + n) time.  This is much faster than n calls
+   to heap_push() when loading a large heap.  Returns 0 on success, 1 if the
+   memory could not be allocated, or -1 if the arguments are invalid. */
+int heap_build(Heap *heap, const int *keys, void **data, size_t n);
+
+/* Adds n key and data pairs to the heap, either by rebuilding it bottom-up or
+   by upheaping each new pair, whichever is cheaper for the size of the batch.
+   Return values are the same as heap_build(). */
+int heap_push_batch(Heap *heap, const int *keys, void **data, size_t n);
+
+/* Moves every element of src into dst, leaving src empty but still usable.
+   Array heaps append src's elements and then rebuild or upheap, like
+   heap_push_batch(), so the heaps may differ in arity and order.  Pairing
+   heaps copy src's nodes into dst's pool and link the two roots, without
+   comparing any other keys.  Radix heaps re-bucket src's entries in O(n),
+   and fail if src holds a key lower than the last one popped from dst.
+   Handles into src become invalid, and its elements are untracked in dst,
+   while handles into dst stay valid.  Returns 0 on success, 1 if the memory
+   could not be allocated, or -1 if either heap is invalid, they are the same
+   heap or use different engines, or a radix meld is out of order.  On
+   failure neither heap is changed. */
+int heap_meld(Heap *dst, Heap *src);
+
+/* Sorts the elements of an array heap in place, with heapsort, into the
+   order heap_pop() would return them, in O(n log n) time and no extra memory.
+   Since a sorted array is also a heap, the heap stays valid and keeps every
+   element and handle.  The sorted keys and data are copied into whichever of
+   keys and data are not NULL, each of which must have room for
+   heap_get_size() elements.  Returns 0 on success, or -1 if the heap is
+   invalid, not an array heap, or a min-max heap. */
+int heap_sort(Heap *heap, int *keys, void **data);
+
+/* The snapshot format written by heap_save_snapshot(). */
+#define HEAP_SNAPSHOT_VERSION 1
+
+/* Saves an array heap to the file at path, in one writev() of a header, the
+   keys in heap order, and a 64-bit payload id for each key.  Each element's
+   data is passed to __id_func for its id; if __id_func is NULL, the pointer
+   itself is saved, which suits heaps whose data are already ids.  Handles
+   and the bound of a bounded heap are not saved.  Returns 0 on success, 1 if
+   the file could not be written, or -1 if the heap is invalid or not an
+   array heap. */
+int heap_save_snapshot(Heap *heap, const char *path, uint64_t (*__id_func) (void*));
+
+/* Loads a heap saved by heap_save_snapshot().  The file is mapped privately
+   and used as the heap's storage as it stands, so loading costs a few system
+   calls whatever the size, and pages are read in as the heap touches them.
+   Changes go to copy-on-write pages and never reach the file.  Each element's
+   data is its payload id cast to a pointer.  The first push past the saved
+   size, or any other resize, copies the heap out of the mapping.  Returns
+   NULL if the file cannot be read or mapped, or is not a snapshot of this
+   version and byte order.  The heap is freed with destroy_heap() as usual. */
+Heap *heap_load_snapshot(const char *path);
+
+/* Sets the growth policy of a heap.  Whenever the heap runs out of room, its
+   allocation is multiplied by growth_factor, which must be greater than 1.0.
+   If max_growth is not zero, a single growth never adds more than max_growth
+   elements.  Returns 0 on success, or -1 if the heap or factor is invalid. */
+int heap_set_growth(Heap *heap, double growth_factor, size_t max_growth);
+
+/* Makes sure the heap has room for at least capacity elements, so that a bulk
+   load does not need to grow it.  Returns 0 on success, 1 if the memory could
+   not be allocated, or -1 if the heap is invalid. */
+int heap_reserve(Heap *heap, size_t capacity);
+
+/* Gives unused memory back to the system, leaving room for the current
+   elements (and never less than the size given to create_heap()).  Returns 0
+   on success, 1 if the memory could not be reallocated, or -1 if the heap is
+   invalid. */
+int heap_shrink_to_fit(Heap *heap);
+
+/* Counters kept by a heap when the library is built with HEAP_STATS
+   defined.  Without it nothing is counted and the sift loops are unchanged.
+   With it, each sift adds its totals once, with relaxed atomic adds, so
+   another thread may read them while the heap is in use.  A move copies one
+   node into the hole left by another, which is what a swap costs in these
+   hole-based sifts.  sift_depth[d] counts the sifts that moved a node d
+   levels, with the last entry counting every deeper one.  Pairing heaps
+   count the comparisons made linking trees, and radix heaps count only
+   allocations. */
+#define HEAP_STATS_DEPTHS 32
+
+struct heap_stats {
+    unsigned long long comparisons;
+    unsigned long long moves;
+    unsigned long long sifts;
+    unsigned long long sift_depth[HEAP_STATS_DEPTHS];
+    unsigned long long allocations; /* Blocks allocated, reallocations included. */
+    unsigned long long reallocs;
+    unsigned long long realloc_bytes; /* Sum of the new sizes of reallocated blocks. */
+};
+
+/* Copies a snapshot of a heap's counters into stats.  Returns 0 on success,
+   1 if the library was built without HEAP_STATS, in which case stats is
+   zeroed, or -1 if the arguments are invalid. */
+int heap_get_stats(Heap *heap, struct heap_stats *stats);
+
 /* Returns the number of elements inside a heap. If the heap is not a valid
    heap, returns -1. */
 size_t heap_get_size(Heap *heap);
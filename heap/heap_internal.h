@@ -0,0 +1,164 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+/* The layout of a heap, shared by heap.c and the files implementing its
+   other engines.  Nothing outside the library should include this. */
+
+#ifndef __MSAUND05_HEAP_INTERNALH
+#define __MSAUND05_HEAP_INTERNALH
+
+#include <stddef.h>
+#include <stdint.h>
+#include "heap.h"
+
+struct __heapnode {
+    int key;
+    void *data;
+};
+
+/* A node of the pairing engine, or of a tracked radix entry.  Nodes live in
+   one pool and link to each other by index, so that a node's index can be its
+   handle and the pool can grow with realloc().  The radix engine only uses a
+   node to find its entry: child holds the entry's bucket and next its slot. */
+struct __poolnode {
+    int key;               /* Stored XORed with the heap's key_mask. */
+    void *data;
+    size_t child;          /* First child, or HEAP_NO_NODE. */
+    size_t next;           /* Next sibling; next free node. */
+    size_t prev;           /* Previous sibling, or the parent of a first
+                              child; HEAP_FREE_NODE if the node is free. */
+};
+
+#define HEAP_NO_NODE ((size_t) -1)
+#define HEAP_FREE_NODE ((size_t) -2)
+
+/* The radix engine keeps one bucket for keys equal to the last key popped,
+   and one for each bit in which a key can first differ from it. */
+#define HEAP_RADIX_BUCKETS 33
+
+struct __radixentry {
+    unsigned int key;      /* The key with its sign bit flipped. */
+    void *data;
+    size_t node;           /* Pool node of a tracked entry, or HEAP_NO_NODE. */
+};
+
+struct __radixbucket {
+    struct __radixentry *entries;
+    size_t size;
+    size_t alloc;
+};
+
+/* A spot in a radix heap names an entry by its bucket and slot. */
+#define RADIX_SPOT(b, slot) (((size_t) (slot) << 6) | (b))
+#define RADIX_SPOT_BUCKET(s) ((unsigned int) ((s) & 63))
+#define RADIX_SPOT_SLOT(s) ((s) >> 6)
+
+/* Nodes of the array engine are stored as parallel arrays rather than an
+   array of __heapnode, so that comparing children only pulls keys into the
+   cache, and a group of children's keys can be loaded into one vector
+   register. */
+struct heap {
+    int *keys;             /* Key of each node, in heap order. */
+    void **data;           /* Data of each node, parallel to keys. */
+    void *key_block;       /* Allocation that keys is aligned inside of. */
+    void (*sift_down) (struct heap*, size_t);
+    void (*sift_down_large) (struct heap*, size_t); /* Used once the heap outgrows the cache. */
+    size_t *handle_of;     /* Handle of each node, parallel to keys. */
+    size_t *position;      /* Node index of each live handle. */
+    size_t handle_count;   /* Handles (or pool nodes) ever given out. */
+    size_t handle_alloc;   /* Room in position (or in the pool). */
+    size_t free_handle;    /* Head of the list of recycled handles or nodes. */
+    size_t size;
+    size_t alloc_size;
+    size_t init_size;
+    unsigned int arity;
+    unsigned int arity_shift; /* log2(arity); children of i start at (i << shift) + 1. */
+    int order;             /* One of enum heap_order. */
+    int key_mask;          /* Keys are stored XORed with this: ~key orders a max-heap. */
+    int engine;            /* One of enum heap_engine. */
+    int bounded;           /* Nonzero if alloc_size is a fixed capacity. */
+    struct __poolnode *nodes; /* Pairing and radix engines: the node pool. */
+    size_t root;           /* Pairing engine: the node on top, or HEAP_NO_NODE. */
+    struct __radixbucket *buckets; /* Radix engine: the buckets. */
+    unsigned int radix_last; /* Radix engine: the last key popped, biased to unsigned. */
+    struct allocator allocator; /* All NULL to use malloc(). */
+    void *snapshot;        /* Mapped snapshot file holding keys and data, or NULL. */
+    size_t snapshot_size;
+    double growth_factor;
+    size_t max_growth;
+    int last_key;
+#ifdef HEAP_STATS
+    struct heap_stats stats; /* Last, so every other field has the same
+                                offset in sources built without it. */
+#endif
+};
+
+/* Counting for heap_get_stats().  Without HEAP_STATS these only evaluate
+   their arguments, so the counts a sift keeps in locals are optimized away. */
+#ifdef HEAP_STATS
+#define HEAP_STAT_ADD(heap, field, n) \
+    __atomic_add_fetch(&(heap)->stats.field, (unsigned long long) (n), __ATOMIC_RELAXED)
+#define HEAP_STAT_SIFT(heap, comparisons, moves) record_sift((heap), (comparisons), (moves))
+void record_sift(Heap *heap, size_t comparisons, size_t moves);
+#else
+#define HEAP_STAT_ADD(heap, field, n) ((void) (n))
+#define HEAP_STAT_SIFT(heap, comparisons, moves) ((void) (comparisons), (void) (moves))
+#endif
+
+/* Places the keys inside a raw block, in heap.c. */
+int *align_keys(void *block);
+
+/* Memory from the heap's allocator, in heap.c. */
+void *allocate_block(Heap *heap, size_t size);
+void *reallocate_block(Heap *heap, void *block, size_t old_size, size_t new_size);
+void release_block(Heap *heap, void *block, size_t size);
+
+/* Heaps loaded from a snapshot, in heap_snapshot.c.  copy_out_snapshot()
+   moves the keys and data into blocks with room for new_size elements and
+   unmaps the file, returning 1 if the memory could not be allocated. */
+int copy_out_snapshot(Heap *heap, size_t new_size);
+void unmap_snapshot(Heap *heap);
+
+/* The node pool, in heap.c. */
+int resize_pool(Heap *heap, size_t new_size);
+size_t new_poolnode(Heap *heap, void *data, int key);
+void free_poolnode(Heap *heap, size_t node);
+
+/* The pairing engine, in heap_pairing.c. */
+void pairing_insert(Heap *heap, size_t node);
+void pairing_remove(Heap *heap, size_t node);
+void pairing_set_key(Heap *heap, size_t node, int key);
+void pairing_meld(Heap *dst, Heap *src);
+
+/* The radix engine, in heap_radix.c. */
+int radix_init(Heap *heap);
+void radix_destroy(Heap *heap, void (*__dest_func) (void*));
+int radix_insert(Heap *heap, void *data, int key, size_t node);
+size_t radix_top(Heap *heap);
+size_t radix_find_last(Heap *heap);
+int radix_spot_key(Heap *heap, size_t spot);
+void *radix_spot_data(Heap *heap, size_t spot);
+size_t radix_node_spot(Heap *heap, size_t node);
+void radix_remove(Heap *heap, size_t spot);
+int radix_set_key(Heap *heap, size_t spot, int key);
+int radix_meld(Heap *dst, Heap *src);
+
+#endif
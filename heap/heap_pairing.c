@@ -0,0 +1,189 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+/* The pairing engine.  The heap is a tree of pool nodes in which no node has
+   a lower key than its parent; each node links to its first child and to its
+   siblings on either side.  Pushing and lowering a key link a single tree to
+   the root in O(1).  Popping merges the root's children in two passes, which
+   is O(log n) amortized.  Melding two heaps links their roots as well, once
+   one pool has been copied into the other.  heap.c takes care of the pool
+   and the size. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "heap.h"
+#include "heap_internal.h"
+
+/* Makes the root with the higher key the first child of the other, and
+   returns the one left on top.  Either may be HEAP_NO_NODE. */
+size_t link_pairnodes(Heap *heap, size_t a, size_t b) {
+    struct __poolnode *nodes;
+    size_t winner;
+    size_t loser;
+
+    if (a == HEAP_NO_NODE) return b;
+    if (b == HEAP_NO_NODE) return a;
+
+    nodes = heap->nodes;
+    HEAP_STAT_ADD(heap, comparisons, 1);
+
+    if (nodes[b].key < nodes[a].key) {
+        winner = b;
+        loser = a;
+    } else {
+        winner = a;
+        loser = b;
+    }
+    nodes[loser].next = nodes[winner].child;
+    if (nodes[winner].child != HEAP_NO_NODE) nodes[nodes[winner].child].prev = loser;
+    nodes[loser].prev = winner;
+    nodes[winner].child = loser;
+    nodes[winner].next = nodes[winner].prev = HEAP_NO_NODE;
+    return winner;
+}
+
+/* Merges a list of sibling trees into one and returns its root.  The first
+   pass links the siblings in pairs from left to right, and the second links
+   the pairs from right to left; the pairs are kept in a list through next,
+   last pair first, so that neither pass needs a stack. */
+size_t merge_pairnodes(Heap *heap, size_t first) {
+    struct __poolnode *nodes;
+    size_t pairs;
+    size_t a;
+    size_t b;
+    size_t merged;
+
+    nodes = heap->nodes;
+    pairs = HEAP_NO_NODE;
+    while (first != HEAP_NO_NODE) {
+        a = first;
+        b = nodes[a].next;
+        if (b == HEAP_NO_NODE) {
+            merged = a;
+            first = HEAP_NO_NODE;
+        } else {
+            first = nodes[b].next;
+            merged = link_pairnodes(heap, a, b);
+        }
+        nodes[merged].next = pairs;
+        pairs = merged;
+    }
+    if (pairs == HEAP_NO_NODE) return HEAP_NO_NODE;
+
+    merged = pairs;
+    pairs = nodes[merged].next;
+    while (pairs != HEAP_NO_NODE) {
+        a = pairs;
+        pairs = nodes[a].next;
+        merged = link_pairnodes(heap, merged, a);
+    }
+    nodes[merged].next = nodes[merged].prev = HEAP_NO_NODE;
+    return merged;
+}
+
+/* Detaches the tree under a node that is not the root from its parent and
+   siblings. */
+void cut_pairnode(struct __poolnode *nodes, size_t node) {
+    size_t prev;
+    size_t next;
+
+    prev = nodes[node].prev;
+    next = nodes[node].next;
+    if (nodes[prev].child == node) {
+        nodes[prev].child = next;
+    } else {
+        nodes[prev].next = next;
+    }
+    if (next != HEAP_NO_NODE) nodes[next].prev = prev;
+    nodes[node].next = nodes[node].prev = HEAP_NO_NODE;
+}
+
+/* Adds a new node, whose key and data are set, to the heap. */
+void pairing_insert(Heap *heap, size_t node) {
+    struct __poolnode *nodes;
+
+    nodes = heap->nodes;
+    nodes[node].child = nodes[node].next = nodes[node].prev = HEAP_NO_NODE;
+    heap->root = link_pairnodes(heap, heap->root, node);
+}
+
+/* Takes a node out of the heap.  The node is not freed. */
+void pairing_remove(Heap *heap, size_t node) {
+    struct __poolnode *nodes;
+    size_t children;
+
+    nodes = heap->nodes;
+    children = merge_pairnodes(heap, nodes[node].child);
+    nodes[node].child = HEAP_NO_NODE;
+    if (node == heap->root) {
+        heap->root = children;
+    } else {
+        cut_pairnode(nodes, node);
+        heap->root = link_pairnodes(heap, heap->root, children);
+    }
+}
+
+/* Gives a node a new stored key.  A lower key only needs the node's tree cut
+   off and linked to the root; a higher one may put the node below its own
+   children, so it is taken out and pushed again. */
+void pairing_set_key(Heap *heap, size_t node, int key) {
+    struct __poolnode *nodes;
+
+    nodes = heap->nodes;
+    if (key <= nodes[node].key) {
+        nodes[node].key = key;
+        if (node == heap->root) return;
+        cut_pairnode(nodes, node);
+        heap->root = link_pairnodes(heap, heap->root, node);
+        return;
+    }
+    pairing_remove(heap, node);
+    nodes[node].key = key;
+    pairing_insert(heap, node);
+}
+
+/* Copies the pool of src onto the end of the pool of dst, which must have
+   room for it, and links the two roots.  Copied links are shifted by where
+   the copy starts, and copied free nodes join the free list of dst.  Only
+   the copy is O(n); no keys are compared but the roots'.  heap.c empties
+   src afterwards. */
+void pairing_meld(Heap *dst, Heap *src) {
+    struct __poolnode *nodes;
+    size_t offset;
+    size_t i;
+
+    nodes = dst->nodes;
+    offset = dst->handle_count;
+    memcpy(nodes + offset, src->nodes, sizeof(struct __poolnode) * src->handle_count);
+    for (i=offset; i<offset + src->handle_count; i++) {
+        if (nodes[i].prev == HEAP_FREE_NODE) {
+            nodes[i].next = dst->free_handle;
+            dst->free_handle = i;
+            continue;
+        }
+        if (nodes[i].child != HEAP_NO_NODE) nodes[i].child += offset;
+        if (nodes[i].next != HEAP_NO_NODE) nodes[i].next += offset;
+        if (nodes[i].prev != HEAP_NO_NODE) nodes[i].prev += offset;
+    }
+    dst->handle_count = offset + src->handle_count;
+    dst->root = link_pairnodes(dst, dst->root, src->root + offset);
+}
@@ -0,0 +1,329 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+/* The radix engine, for monotone keys: no key pushed may be lower than the
+   last key popped, or peeked at.  Every entry sits in the bucket numbered by
+   the highest bit in which its key differs from that last key, or in bucket
+   0 if it is equal.  A pop takes the last entry of bucket 0.  When bucket 0
+   is empty, the lowest key in the first bucket that is not becomes the last
+   key, and that bucket's entries all fall into lower buckets.  An entry can
+   only fall 32 times, so each operation is O(1) amortized.
+
+   Buckets are plain arrays of entries, so that pops and refills read memory
+   in order.  Only tracked entries have a pool node, which records where the
+   entry is so that its handle can find it.  heap.c takes care of the pool
+   and the size. */
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "heap.h"
+#include "heap_internal.h"
+
+/* Keys are compared as unsigned numbers with the sign bit flipped, which
+   sorts them the same way as ints. */
+#define RADIX_BIAS 0x80000000u
+
+/* The smallest allocation a bucket grows to. */
+#define RADIX_MIN_ALLOC 8
+
+unsigned int radix_key(int key) {
+    return (unsigned int) key ^ RADIX_BIAS;
+}
+
+/* Returns the bucket for a key: 0 if it equals last, otherwise one more than
+   the index of the highest bit in which the two differ. */
+unsigned int radix_bucket(unsigned int key, unsigned int last) {
+    unsigned int diff;
+    unsigned int bucket;
+
+    diff = key ^ last;
+    if (diff == 0) return 0;
+#if defined(__GNUC__)
+    bucket = 32 - __builtin_clz(diff);
+#else
+    for (bucket = 0; diff != 0; diff >>= 1) bucket++;
+#endif
+    return bucket;
+}
+
+struct __radixentry *radix_entry(Heap *heap, size_t spot) {
+    return &(heap->buckets)[RADIX_SPOT_BUCKET(spot)].entries[RADIX_SPOT_SLOT(spot)];
+}
+
+/* Makes room for at least capacity entries in a bucket.  Returns 1 if the
+   memory could not be allocated. */
+int reserve_radixbucket(Heap *heap, struct __radixbucket *bucket, size_t capacity) {
+    struct __radixentry *new_entries;
+    size_t new_alloc;
+
+    if (capacity <= bucket->alloc) return 0;
+    new_alloc = bucket->alloc * 2;
+    if (new_alloc < capacity) new_alloc = capacity;
+    if (new_alloc < RADIX_MIN_ALLOC) new_alloc = RADIX_MIN_ALLOC;
+    if (new_alloc > SIZE_MAX / sizeof(struct __radixentry)) return 1;
+
+    new_entries = reallocate_block(heap, bucket->entries, sizeof(struct __radixentry) * bucket->alloc,
+                                   sizeof(struct __radixentry) * new_alloc);
+    if (new_entries == NULL) return 1;
+    bucket->entries = new_entries;
+    bucket->alloc = new_alloc;
+    return 0;
+}
+
+/* Appends an entry to a bucket that has room for it, and tells its pool
+   node, if it has one, where it went. */
+void place_radixentry(Heap *heap, unsigned int b, struct __radixentry entry) {
+    struct __radixbucket *bucket;
+
+    bucket = &(heap->buckets)[b];
+    if (entry.node != HEAP_NO_NODE) {
+        (heap->nodes)[entry.node].child = b;
+        (heap->nodes)[entry.node].next = bucket->size;
+    }
+    bucket->entries[bucket->size++] = entry;
+}
+
+/* Removes the entry in a slot of a bucket by moving the bucket's last entry
+   into it, and returns the removed entry. */
+struct __radixentry take_radixentry(Heap *heap, unsigned int b, size_t slot) {
+    struct __radixbucket *bucket;
+    struct __radixentry entry;
+    struct __radixentry last;
+
+    bucket = &(heap->buckets)[b];
+    entry = bucket->entries[slot];
+    last = bucket->entries[--bucket->size];
+    if (slot != bucket->size) {
+        bucket->entries[slot] = last;
+        if (last.node != HEAP_NO_NODE) (heap->nodes)[last.node].next = slot;
+    }
+    return entry;
+}
+
+/* Allocates the buckets, which start out empty, with the last key popped
+   taken to be INT_MIN.  Returns 1 if they could not be allocated. */
+int radix_init(Heap *heap) {
+    unsigned int i;
+
+    heap->buckets = allocate_block(heap, sizeof(struct __radixbucket) * HEAP_RADIX_BUCKETS);
+    if (heap->buckets == NULL) return 1;
+    for (i=0; i<HEAP_RADIX_BUCKETS; i++) {
+        (heap->buckets)[i].entries = NULL;
+        (heap->buckets)[i].size = (heap->buckets)[i].alloc = 0;
+    }
+    heap->radix_last = 0;
+    return 0;
+}
+
+void radix_destroy(Heap *heap, void (*__dest_func) (void*)) {
+    unsigned int b;
+    size_t i;
+
+    if (heap->buckets == NULL) return;
+    for (b=0; b<HEAP_RADIX_BUCKETS; b++) {
+        if (__dest_func != NULL) {
+            for (i=0; i<(heap->buckets)[b].size; i++) {
+                __dest_func((heap->buckets)[b].entries[i].data);
+            }
+        }
+        release_block(heap, (heap->buckets)[b].entries, sizeof(struct __radixentry) * (heap->buckets)[b].alloc);
+    }
+    release_block(heap, heap->buckets, sizeof(struct __radixbucket) * HEAP_RADIX_BUCKETS);
+    heap->buckets = NULL;
+}
+
+/* Adds an entry, with the given pool node if it is tracked.  Returns 0 on
+   success, 1 if the memory could not be allocated, or -1 if the key is lower
+   than the last key popped. */
+int radix_insert(Heap *heap, void *data, int key, size_t node) {
+    struct __radixentry entry;
+    unsigned int b;
+
+    entry.key = radix_key(key);
+    if (entry.key < heap->radix_last) return -1;
+    entry.data = data;
+    entry.node = node;
+    b = radix_bucket(entry.key, heap->radix_last);
+    if (reserve_radixbucket(heap, &(heap->buckets)[b], (heap->buckets)[b].size + 1) != 0) return 1;
+    place_radixentry(heap, b, entry);
+    return 0;
+}
+
+/* Moves every entry of a bucket into the lower buckets it belongs in once
+   lowest is the last key.  They are all empty, since the bucket was the first
+   one in use.  Returns 1, moving nothing, if the lower buckets could not be
+   given room for the entries. */
+int refill_radixbuckets(Heap *heap, unsigned int from, unsigned int lowest) {
+    struct __radixbucket *buckets;
+    size_t counts[HEAP_RADIX_BUCKETS];
+    size_t i;
+    unsigned int b;
+
+    buckets = heap->buckets;
+    for (b=0; b<from; b++) counts[b] = 0;
+    for (i=0; i<buckets[from].size; i++) {
+        counts[radix_bucket(buckets[from].entries[i].key, lowest)]++;
+    }
+    for (b=0; b<from; b++) {
+        if (reserve_radixbucket(heap, &buckets[b], counts[b]) != 0) return 1;
+    }
+
+    heap->radix_last = lowest;
+    for (i=0; i<buckets[from].size; i++) {
+        place_radixentry(heap, radix_bucket(buckets[from].entries[i].key, lowest), buckets[from].entries[i]);
+    }
+    buckets[from].size = 0;
+    return 0;
+}
+
+/* Returns the spot of an entry with the lowest key, without moving any
+   entries.  The heap must not be empty. */
+size_t radix_find_first(Heap *heap) {
+    struct __radixbucket *bucket;
+    unsigned int b;
+    size_t best;
+    size_t i;
+
+    for (b = 0; (heap->buckets)[b].size == 0; b++);
+    bucket = &(heap->buckets)[b];
+    best = 0;
+    for (i=1; i<bucket->size; i++) {
+        if (bucket->entries[i].key < bucket->entries[best].key) best = i;
+    }
+    return RADIX_SPOT(b, best);
+}
+
+/* Returns the spot of an entry with the lowest key, refilling bucket 0 first
+   if it is empty.  The heap must not be empty. */
+size_t radix_top(Heap *heap) {
+    unsigned int b;
+    unsigned int lowest;
+    size_t best;
+    size_t spot;
+
+    if ((heap->buckets)[0].size > 0) return RADIX_SPOT(0, (heap->buckets)[0].size - 1);
+
+    spot = radix_find_first(heap);
+    b = RADIX_SPOT_BUCKET(spot);
+    best = RADIX_SPOT_SLOT(spot);
+    lowest = radix_entry(heap, spot)->key;
+
+    /* If the refill cannot get memory, the lowest entry is still right where
+       it was found, and the last key can simply stay behind it. */
+    if (refill_radixbuckets(heap, b, lowest) != 0) return RADIX_SPOT(b, best);
+    return RADIX_SPOT(0, (heap->buckets)[0].size - 1);
+}
+
+/* Returns the spot of an entry with the highest key.  Higher buckets hold
+   higher keys, so only the highest bucket in use needs searching. */
+size_t radix_find_last(Heap *heap) {
+    struct __radixbucket *bucket;
+    unsigned int b;
+    size_t best;
+    size_t i;
+
+    for (b = HEAP_RADIX_BUCKETS - 1; (heap->buckets)[b].size == 0; b--);
+    bucket = &(heap->buckets)[b];
+    best = 0;
+    for (i=1; i<bucket->size; i++) {
+        if (bucket->entries[i].key > bucket->entries[best].key) best = i;
+    }
+    return RADIX_SPOT(b, best);
+}
+
+int radix_spot_key(Heap *heap, size_t spot) {
+    return (int) (radix_entry(heap, spot)->key ^ RADIX_BIAS);
+}
+
+void *radix_spot_data(Heap *heap, size_t spot) {
+    return radix_entry(heap, spot)->data;
+}
+
+/* Returns the spot of the entry a tracked pool node belongs to. */
+size_t radix_node_spot(Heap *heap, size_t node) {
+    return RADIX_SPOT((heap->nodes)[node].child, (heap->nodes)[node].next);
+}
+
+/* Takes an entry out of the heap, freeing its pool node if it has one. */
+void radix_remove(Heap *heap, size_t spot) {
+    struct __radixentry entry;
+
+    entry = take_radixentry(heap, RADIX_SPOT_BUCKET(spot), RADIX_SPOT_SLOT(spot));
+    if (entry.node != HEAP_NO_NODE) free_poolnode(heap, entry.node);
+}
+
+/* Gives an entry a new key and moves it to the bucket for that key.  Returns
+   0 on success, 1 if the new bucket could not grow, or -1 if the new key is
+   lower than the last key popped.  On failure the entry is left as it was. */
+int radix_set_key(Heap *heap, size_t spot, int key) {
+    struct __radixentry entry;
+    unsigned int new_key;
+    unsigned int b;
+
+    new_key = radix_key(key);
+    if (new_key < heap->radix_last) return -1;
+    b = radix_bucket(new_key, heap->radix_last);
+    if (b == RADIX_SPOT_BUCKET(spot)) {
+        radix_entry(heap, spot)->key = new_key;
+        return 0;
+    }
+    if (reserve_radixbucket(heap, &(heap->buckets)[b], (heap->buckets)[b].size + 1) != 0) return 1;
+
+    entry = take_radixentry(heap, RADIX_SPOT_BUCKET(spot), RADIX_SPOT_SLOT(spot));
+    entry.key = new_key;
+    place_radixentry(heap, b, entry);
+    return 0;
+}
+
+/* Moves every entry of src into dst.  The entries lose their pool nodes, so
+   they are no longer tracked; heap.c empties the pool and size of src.
+   Returns 0 on success, 1, moving nothing, if the buckets of dst could not
+   grow, or -1, moving nothing, if src holds a key lower than the last key
+   popped from dst. */
+int radix_meld(Heap *dst, Heap *src) {
+    size_t counts[HEAP_RADIX_BUCKETS];
+    struct __radixentry entry;
+    unsigned int b;
+    size_t i;
+
+    if (radix_entry(src, radix_find_first(src))->key < dst->radix_last) return -1;
+
+    for (b=0; b<HEAP_RADIX_BUCKETS; b++) counts[b] = (dst->buckets)[b].size;
+    for (b=0; b<HEAP_RADIX_BUCKETS; b++) {
+        for (i=0; i<(src->buckets)[b].size; i++) {
+            counts[radix_bucket((src->buckets)[b].entries[i].key, dst->radix_last)]++;
+        }
+    }
+    for (b=0; b<HEAP_RADIX_BUCKETS; b++) {
+        if (reserve_radixbucket(dst, &(dst->buckets)[b], counts[b]) != 0) return 1;
+    }
+
+    for (b=0; b<HEAP_RADIX_BUCKETS; b++) {
+        for (i=0; i<(src->buckets)[b].size; i++) {
+            entry = (src->buckets)[b].entries[i];
+            entry.node = HEAP_NO_NODE;
+            place_radixentry(dst, radix_bucket(entry.key, dst->radix_last), entry);
+        }
+        (src->buckets)[b].size = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+/* Saving an array heap to a file, and loading it back by mapping the file
+   straight into the heap's storage. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "heap_internal.h"
+
+/* A snapshot is a header, the stored keys in heap order, and then one 64-bit
+   payload id per key, aligned to 8 bytes.  The header takes HEAP_SNAPSHOT_KEYS
+   bytes so that, with the file mapped on a page boundary, the keys land where
+   align_keys() would put them. */
+#define HEAP_SNAPSHOT_MAGIC "HEAPSNAP"
+#define HEAP_SNAPSHOT_BYTE_ORDER 0x01020304u
+#define HEAP_SNAPSHOT_KEYS (HEAP_CACHE_LINE - sizeof(int))
+
+struct __snapshotheader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;   /* HEAP_SNAPSHOT_BYTE_ORDER as written. */
+    uint32_t arity;
+    uint32_t order;
+    uint64_t size;
+    uint64_t ids;          /* File offset of the payload ids. */
+};
+
+/* Returns the file offset of the payload ids of a snapshot of size keys. */
+static uint64_t snapshot_ids(uint64_t size) {
+    return (HEAP_SNAPSHOT_KEYS + sizeof(int) * size + 7) & ~(uint64_t) 7;
+}
+
+/* Writes every vector in full, picking up after short writes.  Returns 1 if
+   the write failed. */
+static int write_vectors(int fd, struct iovec *iov, int count) {
+    ssize_t written;
+
+    while (count > 0) {
+        written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written = written - (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + written;
+            iov->iov_len = iov->iov_len - (size_t) written;
+        }
+    }
+    return 0;
+}
+
+/* Internal functions */
+
+int copy_out_snapshot(Heap *heap, size_t new_size) {
+    void *new_block;
+    void **new_data;
+
+    new_block = allocate_block(heap, sizeof(int) * new_size + HEAP_CACHE_LINE);
+    new_data = allocate_block(heap, sizeof(void*) * new_size);
+    if (new_block == NULL || new_data == NULL) {
+        release_block(heap, new_data, sizeof(void*) * new_size);
+        release_block(heap, new_block, sizeof(int) * new_size + HEAP_CACHE_LINE);
+        return 1;
+    }
+    memcpy(align_keys(new_block), heap->keys, sizeof(int) * heap->size);
+    memcpy(new_data, heap->data, sizeof(void*) * heap->size);
+    unmap_snapshot(heap);
+
+    heap->key_block = new_block;
+    heap->keys = align_keys(new_block);
+    heap->data = new_data;
+    return 0;
+}
+
+void unmap_snapshot(Heap *heap) {
+    if (heap->snapshot == NULL) return;
+    if ((char*) heap->data < (char*) heap->snapshot
+        || (char*) heap->data >= (char*) heap->snapshot + heap->snapshot_size) {
+        release_block(heap, heap->data, sizeof(void*) * heap->alloc_size);
+    }
+    munmap(heap->snapshot, heap->snapshot_size);
+    heap->snapshot = NULL;
+    heap->snapshot_size = 0;
+}
+
+/* External functions */
+
+int heap_save_snapshot(Heap *heap, const char *path, uint64_t (*__id_func) (void*)) {
+    static const char padding[HEAP_CACHE_LINE] = { 0 };
+    struct __snapshotheader header;
+    struct iovec iov[5];
+    uint64_t *ids;
+    size_t i;
+    int fd;
+    int failed;
+
+    if (heap == NULL || path == NULL) return -1;
+    if (heap->engine != HEAP_ARRAY_ENGINE) return -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HEAP_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = HEAP_SNAPSHOT_VERSION;
+    header.byte_order = HEAP_SNAPSHOT_BYTE_ORDER;
+    header.arity = heap->arity;
+    header.order = (uint32_t) heap->order;
+    header.size = heap->size;
+    header.ids = snapshot_ids(heap->size);
+
+    /* Without an id function, a pointer is its own id, so on 64-bit systems
+       the data array can be written as it stands. */
+    ids = NULL;
+    if (__id_func != NULL || sizeof(void*) != sizeof(uint64_t)) {
+        ids = malloc(sizeof(uint64_t) * (heap->size != 0 ? heap->size : 1));
+        if (ids == NULL) return 1;
+        for (i=0; i<heap->size; i++) {
+            ids[i] = __id_func != NULL ? __id_func((heap->data)[i]) : (uint64_t) (uintptr_t) (heap->data)[i];
+        }
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(ids);
+        return 1;
+    }
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*) padding;
+    iov[1].iov_len = HEAP_SNAPSHOT_KEYS - sizeof(header);
+    iov[2].iov_base = heap->keys;
+    iov[2].iov_len = sizeof(int) * heap->size;
+    iov[3].iov_base = (void*) padding;
+    iov[3].iov_len = (size_t) header.ids - HEAP_SNAPSHOT_KEYS - iov[2].iov_len;
+    iov[4].iov_base = ids != NULL ? (void*) ids : (void*) heap->data;
+    iov[4].iov_len = sizeof(uint64_t) * heap->size;
+
+    failed = write_vectors(fd, iov, 5);
+    if (!failed) failed = fsync(fd) != 0;
+    if (close(fd) != 0) failed = 1;
+    free(ids);
+    return failed;
+}
+
+Heap *heap_load_snapshot(const char *path) {
+    struct __snapshotheader header;
+    struct stat info;
+    Heap *new;
+    char *map;
+    uint64_t *ids;
+    void **data;
+    size_t length;
+    size_t i;
+    int fd;
+
+    if (path == NULL) return NULL;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &info) != 0 || (uintmax_t) info.st_size < HEAP_SNAPSHOT_KEYS
+        || (uintmax_t) info.st_size > SIZE_MAX) {
+        close(fd);
+        return NULL;
+    }
+    length = (size_t) info.st_size;
+
+    /* A private mapping is copy-on-write: pops and pushes change the heap's
+       pages in memory, never the file. */
+    map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, HEAP_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != HEAP_SNAPSHOT_VERSION
+        || header.byte_order != HEAP_SNAPSHOT_BYTE_ORDER
+        || header.size > (length - HEAP_SNAPSHOT_KEYS) / (sizeof(int) + sizeof(uint64_t))
+        || header.ids != snapshot_ids(header.size)
+        || header.ids + sizeof(uint64_t) * header.size != length) {
+        munmap(map, length);
+        return NULL;
+    }
+
+    new = create_ordered_heap(1, header.arity, (enum heap_order) header.order);
+    if (new == NULL) {
+        munmap(map, length);
+        return NULL;
+    }
+
+    ids = (uint64_t*) (map + header.ids);
+    release_block(new, new->key_block, sizeof(int) + HEAP_CACHE_LINE);
+    new->key_block = NULL;
+    new->keys = (int*) (map + HEAP_SNAPSHOT_KEYS);
+    new->snapshot = map;
+    new->snapshot_size = length;
+    /* The ids of an empty snapshot would start at the very end of the
+       mapping, where unmap_snapshot() could not tell them from a block of
+       its own, so such a heap keeps the data block it was made with. */
+    if (sizeof(void*) == sizeof(uint64_t) && header.size > 0) {
+        release_block(new, new->data, sizeof(void*));
+        new->data = (void**) ids;
+    } else {
+        /* Pointers are too narrow to map the ids in place; convert them. */
+        if (header.size > 1) {
+            data = reallocate_block(new, new->data, sizeof(void*), sizeof(void*) * (size_t) header.size);
+            if (data == NULL) {
+                destroy_heap(new, NULL);
+                return NULL;
+            }
+            new->data = data;
+        }
+        for (i=0; i<header.size; i++) {
+            (new->data)[i] = (void*) (uintptr_t) ids[i];
+        }
+    }
+    new->size = (size_t) header.size;
+    new->alloc_size = new->size;
+    return new;
+}
@@ -0,0 +1,219 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+#ifndef __MSAUND05_HEAP_TYPEH
+#define __MSAUND05_HEAP_TYPEH
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Typed heaps.  HEAP_DEFINE_TYPE() writes out a heap for one key type, one
+   value type and one ordering, using the same algorithms as heap.c: hole-based
+   sifts, geometric growth and a bottom-up build.  Keys and values are stored
+   by value in parallel arrays, and the ordering is expanded inline, so there
+   are no function pointers and no void* casts.  Everything is static inline
+   and lives in this header; nothing needs to be linked.
+
+   For example:
+
+       #define NS_BEFORE(a, b) ((a) < (b))
+       HEAP_DEFINE_TYPE(timer_heap, uint64_t, struct timer*, NS_BEFORE, 4)
+
+   defines the type timer_heap, a 4-ary min-heap of uint64_t keys holding
+   struct timer pointers, along with these functions:
+
+       int    timer_heap_init(timer_heap *heap, size_t init_size);
+       void   timer_heap_free(timer_heap *heap);
+       int    timer_heap_push(timer_heap *heap, uint64_t key, struct timer *value);
+       int    timer_heap_pop(timer_heap *heap, uint64_t *key, struct timer **value);
+       int    timer_heap_peek(const timer_heap *heap, uint64_t *key, struct timer **value);
+       int    timer_heap_build(timer_heap *heap, const uint64_t *keys, struct timer *const *values, size_t n);
+       int    timer_heap_reserve(timer_heap *heap, size_t capacity);
+       size_t timer_heap_size(const timer_heap *heap);
+
+   before(a, b) must be true when key a has to come out of the heap before key
+   b; HEAP_LESS gives a min-heap and HEAP_GREATER a max-heap.  It may be a
+   macro or a function, and it may evaluate its arguments more than once.
+   Arity may be any constant of 2 or more.
+
+   init, push, build and reserve return 0 on success or 1 if memory could not
+   be allocated.  pop and peek return 0 and fill in whichever of key and value
+   are not NULL, or return 1 if the heap is empty. */
+
+#define HEAP_LESS(a, b) ((a) < (b))
+#define HEAP_GREATER(a, b) ((a) > (b))
+
+#define HEAP_DEFINE_TYPE(name, key_type, value_type, before, arity)           \
+                                                                              \
+typedef struct name {                                                         \
+    key_type *keys;                                                           \
+    value_type *values;                                                       \
+    size_t size;                                                              \
+    size_t alloc_size;                                                        \
+} name;                                                                       \
+                                                                              \
+static inline int name##_resize(name *heap, size_t new_size) {                \
+    key_type *new_keys;                                                       \
+    value_type *new_values;                                                   \
+                                                                              \
+    if (new_size > SIZE_MAX / sizeof(key_type)) return 1;                     \
+    if (new_size > SIZE_MAX / sizeof(value_type)) return 1;                   \
+    new_keys = (key_type*) realloc(heap->keys, sizeof(key_type) * new_size);  \
+    if (new_keys == NULL) return 1;                                           \
+    heap->keys = new_keys;                                                    \
+    new_values = (value_type*) realloc(heap->values, sizeof(value_type) * new_size); \
+    if (new_values == NULL) return 1;                                         \
+    heap->values = new_values;                                                \
+    heap->alloc_size = new_size;                                              \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline int name##_init(name *heap, size_t init_size) {                 \
+    heap->keys = NULL;                                                        \
+    heap->values = NULL;                                                      \
+    heap->size = 0;                                                           \
+    heap->alloc_size = 0;                                                     \
+    if (init_size < 1) init_size = 1;                                         \
+    if (name##_resize(heap, init_size) != 0) {                                \
+        free(heap->keys);                                                     \
+        heap->keys = NULL;                                                    \
+        return 1;                                                             \
+    }                                                                         \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline void name##_free(name *heap) {                                  \
+    free(heap->keys);                                                         \
+    free(heap->values);                                                       \
+    heap->keys = NULL;                                                        \
+    heap->values = NULL;                                                      \
+    heap->size = heap->alloc_size = 0;                                        \
+}                                                                             \
+                                                                              \
+static inline size_t name##_size(const name *heap) {                          \
+    return heap->size;                                                        \
+}                                                                             \
+                                                                              \
+static inline int name##_reserve(name *heap, size_t capacity) {               \
+    if (capacity <= heap->alloc_size) return 0;                               \
+    return name##_resize(heap, capacity);                                     \
+}                                                                             \
+                                                                              \
+static inline void name##_upheap(name *heap, size_t pos) {                    \
+    key_type key;                                                             \
+    value_type value;                                                         \
+    size_t parent;                                                            \
+                                                                              \
+    key = heap->keys[pos];                                                    \
+    value = heap->values[pos];                                                \
+    while (pos > 0) {                                                         \
+        parent = (pos - 1) / (arity);                                         \
+        if (!(before(key, heap->keys[parent]))) break;                        \
+        heap->keys[pos] = heap->keys[parent];                                 \
+        heap->values[pos] = heap->values[parent];                             \
+        pos = parent;                                                         \
+    }                                                                         \
+    heap->keys[pos] = key;                                                    \
+    heap->values[pos] = value;                                                \
+}                                                                             \
+                                                                              \
+static inline void name##_downheap(name *heap, size_t pos) {                  \
+    key_type key;                                                             \
+    value_type value;                                                         \
+    size_t child;                                                             \
+    size_t last;                                                              \
+    size_t best;                                                              \
+                                                                              \
+    key = heap->keys[pos];                                                    \
+    value = heap->values[pos];                                                \
+    while ((child = (arity) * pos + 1) < heap->size) {                        \
+        last = child + (arity);                                               \
+        if (last > heap->size) last = heap->size;                             \
+        for (best = child++; child < last; child++) {                         \
+            if (before(heap->keys[child], heap->keys[best])) best = child;    \
+        }                                                                     \
+        if (!(before(heap->keys[best], key))) break;                          \
+        heap->keys[pos] = heap->keys[best];                                   \
+        heap->values[pos] = heap->values[best];                               \
+        pos = best;                                                           \
+    }                                                                         \
+    heap->keys[pos] = key;                                                    \
+    heap->values[pos] = value;                                                \
+}                                                                             \
+                                                                              \
+static inline int name##_push(name *heap, key_type key, value_type value) {   \
+    size_t step;                                                              \
+                                                                              \
+    if (heap->size >= heap->alloc_size) {                                     \
+        step = heap->alloc_size > 0 ? heap->alloc_size : 1;                   \
+        if (step > SIZE_MAX - heap->alloc_size) return 1;                     \
+        if (name##_resize(heap, heap->alloc_size + step) != 0) return 1;      \
+    }                                                                         \
+    heap->keys[heap->size] = key;                                             \
+    heap->values[heap->size] = value;                                         \
+    heap->size++;                                                             \
+    name##_upheap(heap, heap->size - 1);                                      \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline int name##_peek(const name *heap, key_type *key, value_type *value) { \
+    if (heap->size == 0) return 1;                                            \
+    if (key != NULL) *key = heap->keys[0];                                    \
+    if (value != NULL) *value = heap->values[0];                              \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline int name##_pop(name *heap, key_type *key, value_type *value) {  \
+    if (heap->size == 0) return 1;                                            \
+    if (key != NULL) *key = heap->keys[0];                                    \
+    if (value != NULL) *value = heap->values[0];                              \
+    heap->size--;                                                             \
+    if (heap->size > 0) {                                                     \
+        heap->keys[0] = heap->keys[heap->size];                               \
+        heap->values[0] = heap->values[heap->size];                           \
+        name##_downheap(heap, 0);                                             \
+    }                                                                         \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline int name##_build(name *heap, const key_type *keys, value_type const *values, size_t n) { \
+    size_t i;                                                                 \
+                                                                              \
+    if (n == 0) return 0;                                                     \
+    if (n > SIZE_MAX - heap->size) return 1;                                  \
+    if (name##_reserve(heap, heap->size + n) != 0) return 1;                  \
+    for (i=0; i<n; i++) {                                                     \
+        heap->keys[heap->size + i] = keys[i];                                 \
+        heap->values[heap->size + i] = values[i];                             \
+    }                                                                         \
+    heap->size += n;                                                          \
+    if (heap->size < 2) return 0;                                             \
+    i = (heap->size - 2) / (arity) + 1;                                       \
+    while (i > 0) {                                                           \
+        i--;                                                                  \
+        name##_downheap(heap, i);                                             \
+    }                                                                         \
+    return 0;                                                                 \
+}
+
+#endif
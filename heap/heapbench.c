@@ -0,0 +1,347 @@
+/* HEAPBENCH.C: Push/pop throughput benchmark for the heap library.
+
+   Runs every workload for binary, 4-ary and 8-ary heaps, then compares the
+   array, pairing and radix engines on monotone keys and on melding two
+   heaps, keeps the top k of a stream, and builds short-lived heaps with
+   malloc() and with an arena, and restores a heap from a snapshot.  Heap sizes can be given on the
+   command line, eg. "./bench 1000 1000000 100000000"; the largest of those
+   needs about 2GB of memory. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "./heap.h"
+#include "../alloc/arena.h"
+
+static unsigned int rng_state = 2463534242u;
+
+/* xorshift32, so every run sees the same key sequence. */
+static int next_key(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (int) (rng_state & 0x7fffffff);
+}
+
+static double seconds_since(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Pushes n random keys, then pops them all. */
+static void bench_fill_drain(size_t n, unsigned int arity) {
+    Heap *heap;
+    clock_t start;
+    double push_time;
+    double pop_time;
+    size_t i;
+
+    heap = create_dary_heap(16, arity);
+    start = clock();
+    for (i=0; i<n; i++) {
+        heap_push(heap, NULL, next_key());
+    }
+    push_time = seconds_since(start);
+
+    start = clock();
+    while (heap_get_size(heap) > 0) {
+        heap_pop(heap);
+    }
+    pop_time = seconds_since(start);
+
+    printf("fill/drain  d=%u n=%-9lu push %8.2f ns/op   pop %8.2f ns/op\n",
+           arity, (unsigned long) n, push_time * 1e9 / n, pop_time * 1e9 / n);
+    destroy_heap(heap, NULL);
+}
+
+/* Keeps the heap at n elements and alternates pop and push, the way a
+   scheduler or event queue uses it. */
+static void bench_hold(size_t n, unsigned int arity, size_t ops) {
+    Heap *heap;
+    clock_t start;
+    double hold_time;
+    size_t i;
+
+    heap = create_dary_heap(16, arity);
+    heap_reserve(heap, n);
+    for (i=0; i<n; i++) {
+        heap_push(heap, NULL, next_key());
+    }
+
+    start = clock();
+    for (i=0; i<ops; i++) {
+        heap_pop(heap);
+        heap_push(heap, NULL, next_key());
+    }
+    hold_time = seconds_since(start);
+
+    printf("hold        d=%u n=%-9lu pop+push %8.2f ns/op\n",
+           arity, (unsigned long) n, hold_time * 1e9 / ops);
+    destroy_heap(heap, NULL);
+}
+
+/* Keeps the heap at n elements, pushing each popped key back with a random
+   amount added, so that keys only grow.  Shortest path searches and event
+   simulations use a heap this way. */
+static void bench_monotone(size_t n, enum heap_engine engine, size_t ops) {
+    static const char *names[] = { "array", "pairing", "radix" };
+    Heap *heap;
+    clock_t start;
+    double hold_time;
+    int key;
+    size_t i;
+
+    heap = create_engine_heap(16, engine);
+    heap_reserve(heap, n);
+    for (i=0; i<n; i++) {
+        heap_push(heap, NULL, next_key() & 0xfffff);
+    }
+
+    start = clock();
+    for (i=0; i<ops; i++) {
+        heap_pop_with_key(heap, NULL, &key);
+        heap_push(heap, NULL, key + (next_key() & 0xfff));
+    }
+    hold_time = seconds_since(start);
+
+    printf("monotone    %-7s n=%-9lu pop+push %8.2f ns/op\n",
+           names[engine], (unsigned long) n, hold_time * 1e9 / ops);
+    destroy_heap(heap, NULL);
+}
+
+/* Moves a heap of n random keys into another of the same size, once with
+   heap_meld() and once by popping and pushing every element. */
+static void bench_meld(size_t n, enum heap_engine engine) {
+    static const char *names[] = { "array", "pairing", "radix" };
+    Heap *dst;
+    Heap *src;
+    clock_t start;
+    double meld_time;
+    double move_time;
+    void *data;
+    int key;
+    int pass;
+    size_t i;
+
+    meld_time = move_time = 0;
+    for (pass=0; pass<2; pass++) {
+        dst = create_engine_heap(n, engine);
+        src = create_engine_heap(n, engine);
+        for (i=0; i<n; i++) {
+            heap_push(dst, NULL, next_key());
+            heap_push(src, NULL, next_key());
+        }
+
+        start = clock();
+        if (pass == 0) {
+            heap_meld(dst, src);
+            meld_time = seconds_since(start);
+        } else {
+            while (heap_pop_with_key(src, &data, &key) == 0) {
+                heap_push(dst, data, key);
+            }
+            move_time = seconds_since(start);
+        }
+        destroy_heap(dst, NULL);
+        destroy_heap(src, NULL);
+    }
+
+    printf("meld        %-7s n=%-9lu meld  %8.2f ns/elem   pop+push %8.2f ns/elem\n",
+           names[engine], (unsigned long) n, meld_time * 1e9 / n, move_time * 1e9 / n);
+}
+
+/* Keeps the k highest of a stream of random keys, once with pop and push on
+   an ordinary heap, and once with heap_offer_batch() on a bounded one. */
+static void bench_topk(size_t k, size_t stream) {
+    Heap *heap;
+    clock_t start;
+    double naive_time;
+    double offer_time;
+    int *keys;
+    void **data;
+    size_t i;
+
+    keys = malloc(sizeof(int) * stream);
+    data = malloc(sizeof(void*) * stream);
+    for (i=0; i<stream; i++) {
+        keys[i] = next_key();
+        data[i] = NULL;
+    }
+
+    heap = create_heap(k);
+    start = clock();
+    for (i=0; i<stream; i++) {
+        if (heap_get_size(heap) < k) {
+            heap_push(heap, data[i], keys[i]);
+            continue;
+        }
+        heap_peek(heap);
+        if (keys[i] <= heap_get_last_key(heap)) continue;
+        heap_pop(heap);
+        heap_push(heap, data[i], keys[i]);
+    }
+    naive_time = seconds_since(start);
+    destroy_heap(heap, NULL);
+
+    heap = create_bounded_heap(k, 2, HEAP_MIN_ORDER);
+    start = clock();
+    for (i=0; i<stream; i+=4096) {
+        heap_offer_batch(heap, keys + i, data + i, stream - i < 4096 ? stream - i : 4096, NULL);
+    }
+    offer_time = seconds_since(start);
+    destroy_heap(heap, NULL);
+
+    printf("top-k       k=%-9lu stream=%-9lu pop+push %8.2f ns/item   offer %8.2f ns/item\n",
+           (unsigned long) k, (unsigned long) stream,
+           naive_time * 1e9 / stream, offer_time * 1e9 / stream);
+    free(keys);
+    free(data);
+}
+
+/* Builds many small heaps of n keys, each pushed, drained and thrown away the
+   way a heap that lives for one request is, once with malloc() and once with
+   an arena reset after every heap. */
+static void bench_arena(size_t n, size_t rounds) {
+    Arena *arena;
+    struct allocator allocator;
+    Heap *heap;
+    clock_t start;
+    double malloc_time;
+    double arena_time;
+    size_t r;
+    size_t i;
+
+    start = clock();
+    for (r=0; r<rounds; r++) {
+        heap = create_heap(16);
+        for (i=0; i<n; i++) {
+            heap_push(heap, NULL, next_key());
+        }
+        while (heap_get_size(heap) > 0) {
+            heap_pop(heap);
+        }
+        destroy_heap(heap, NULL);
+    }
+    malloc_time = seconds_since(start);
+
+    arena = create_arena(0);
+    allocator = arena_allocator(arena);
+    start = clock();
+    for (r=0; r<rounds; r++) {
+        heap = create_allocated_heap(16, 2, HEAP_MIN_ORDER, &allocator);
+        for (i=0; i<n; i++) {
+            heap_push(heap, NULL, next_key());
+        }
+        while (heap_get_size(heap) > 0) {
+            heap_pop(heap);
+        }
+        arena_reset(arena);
+    }
+    arena_time = seconds_since(start);
+    destroy_arena(arena);
+
+    printf("short-lived n=%-9lu rounds=%-9lu malloc %8.2f ns/heap   arena %8.2f ns/heap\n",
+           (unsigned long) n, (unsigned long) rounds,
+           malloc_time * 1e9 / rounds, arena_time * 1e9 / rounds);
+}
+
+/* Restores a heap of n random keys, once by rebuilding it with heap_build()
+   and once by loading a snapshot, then pops from the loaded heap to show
+   the cost of faulting its pages in. */
+static void bench_snapshot(size_t n) {
+    static const char *path = "heapbench.snapshot";
+    Heap *heap;
+    clock_t start;
+    double save_time;
+    double build_time;
+    double load_time;
+    double pop_time;
+    int *keys;
+    void **data;
+    size_t i;
+
+    keys = malloc(sizeof(int) * n);
+    data = malloc(sizeof(void*) * n);
+    for (i=0; i<n; i++) {
+        keys[i] = next_key();
+        data[i] = (void*) (i + 1);
+    }
+
+    heap = create_heap(16);
+    start = clock();
+    heap_build(heap, keys, data, n);
+    build_time = seconds_since(start);
+    start = clock();
+    if (heap_save_snapshot(heap, path, NULL) != 0) {
+        printf("snapshot    n=%-9lu could not write %s\n", (unsigned long) n, path);
+        destroy_heap(heap, NULL);
+        free(keys);
+        free(data);
+        return;
+    }
+    save_time = seconds_since(start);
+    destroy_heap(heap, NULL);
+
+    start = clock();
+    heap = heap_load_snapshot(path);
+    load_time = seconds_since(start);
+    start = clock();
+    for (i=0; i<n && i<1000; i++) {
+        heap_pop(heap);
+    }
+    pop_time = seconds_since(start);
+    destroy_heap(heap, NULL);
+    remove(path);
+
+    printf("snapshot    n=%-9lu build %8.3f ms   save %8.3f ms   load %8.3f ms   first 1000 pops %8.3f ms\n",
+           (unsigned long) n, build_time * 1e3, save_time * 1e3, load_time * 1e3, pop_time * 1e3);
+    free(keys);
+    free(data);
+}
+
+int main(int argc, char **argv) {
+    size_t default_sizes[] = { 1000, 100000, 1000000, 10000000 };
+    size_t sizes[16];
+    size_t num_sizes;
+    unsigned int arity;
+    int engine;
+    size_t i;
+
+    num_sizes = 0;
+    for (i=1; i<(size_t) argc && num_sizes < 16; i++) {
+        sizes[num_sizes++] = strtoul(argv[i], NULL, 10);
+    }
+    if (num_sizes == 0) {
+        num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        for (i=0; i<num_sizes; i++) sizes[i] = default_sizes[i];
+    }
+
+    for (i=0; i<num_sizes; i++) {
+        for (arity=2; arity<=8; arity*=2) {
+            bench_fill_drain(sizes[i], arity);
+        }
+    }
+    for (i=0; i<num_sizes; i++) {
+        for (arity=2; arity<=8; arity*=2) {
+            bench_hold(sizes[i], arity, 5000000);
+        }
+    }
+    for (i=0; i<num_sizes; i++) {
+        for (engine=HEAP_ARRAY_ENGINE; engine<=HEAP_RADIX_ENGINE; engine++) {
+            bench_monotone(sizes[i], (enum heap_engine) engine, 5000000);
+        }
+    }
+    for (i=0; i<num_sizes; i++) {
+        for (engine=HEAP_ARRAY_ENGINE; engine<=HEAP_RADIX_ENGINE; engine++) {
+            bench_meld(sizes[i], (enum heap_engine) engine);
+        }
+    }
+    for (i=0; i<num_sizes; i++) {
+        bench_topk(sizes[i], 20000000);
+    }
+    bench_arena(64, 1000000);
+    bench_arena(1024, 100000);
+    for (i=0; i<num_sizes; i++) {
+        bench_snapshot(sizes[i]);
+    }
+    return 0;
+}
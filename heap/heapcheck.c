@@ -0,0 +1,1185 @@
+/* HEAPCHECK.C: Correctness checks for the heap library.
+
+   Runs each operation on random keys and compares what comes out against a
+   brute-force reference, so a wrong order or a lost element is caught, not
+   just timed.  Prints each failed check and exits with status 1 if any
+   failed.  Build and run it with "make check"; adding
+   -fsanitize=address,undefined to that line checks memory use too. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "./heap.h"
+#include "./multiqueue.h"
+#include "./timerwheel.h"
+#include "./stagedqueue.h"
+#include "./heapmerge.h"
+
+#define CHECK_ELEMENTS 4000
+#define CHECK_SNAPSHOT "heapcheck.snapshot"
+
+static unsigned int rng_state = 2463534242u;
+static int failures = 0;
+
+#define CHECK(cond) check_that((cond), #cond, __FILE__, __LINE__)
+
+static void check_that(int cond, const char *text, const char *file, int line) {
+    if (cond) return;
+    failures++;
+    if (failures <= 20) fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+}
+
+static void report(const char *name, int failures_before) {
+    printf("%-16s %s\n", name, failures == failures_before ? "ok" : "FAILED");
+}
+
+/* xorshift32, so every run sees the same key sequence. */
+static int next_key(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (int) (rng_state & 0x7fffffff);
+}
+
+static int compare_keys(const void *a, const void *b) {
+    int x;
+    int y;
+
+    x = *(const int*) a;
+    y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_keys_desc(const void *a, const void *b) {
+    return compare_keys(b, a);
+}
+
+/* The elements a heap should hold, checked against it by brute force.  An
+   element's data is its index in the model plus one, so data never needs
+   looking up.  live lists the indices of the elements still on the heap. */
+struct model {
+    int keys[CHECK_ELEMENTS];
+    heap_handle handles[CHECK_ELEMENTS];
+    size_t live[CHECK_ELEMENTS];
+    size_t slot[CHECK_ELEMENTS];   /* Where each live element sits in live. */
+    size_t count;
+    size_t live_count;
+};
+
+static void *element_data(size_t id) {
+    return (void*) (intptr_t) (id + 1);
+}
+
+/* Returns the index of the element whose data this is, or CHECK_ELEMENTS
+   if the data belongs to no live element. */
+static size_t element_id(const struct model *model, void *data) {
+    size_t id;
+
+    id = (size_t) (intptr_t) data - 1;
+    if (id >= model->count) return CHECK_ELEMENTS;
+    if (model->slot[id] >= model->live_count || model->live[model->slot[id]] != id) return CHECK_ELEMENTS;
+    return id;
+}
+
+static size_t add_element(struct model *model, int key, heap_handle handle) {
+    size_t id;
+
+    id = model->count++;
+    model->keys[id] = key;
+    model->handles[id] = handle;
+    model->slot[id] = model->live_count;
+    model->live[model->live_count++] = id;
+    return id;
+}
+
+static void kill_element(struct model *model, size_t id) {
+    size_t moved;
+
+    moved = model->live[--model->live_count];
+    model->live[model->slot[id]] = moved;
+    model->slot[moved] = model->slot[id];
+    model->slot[id] = CHECK_ELEMENTS;
+}
+
+/* Returns the lowest live key, or the highest if want_max is not 0. */
+static int end_key(const struct model *model, int want_max) {
+    size_t i;
+    int key;
+
+    key = want_max ? INT_MIN : INT_MAX;
+    for (i=0; i<model->live_count; i++) {
+        if (want_max ? model->keys[model->live[i]] > key : model->keys[model->live[i]] < key) {
+            key = model->keys[model->live[i]];
+        }
+    }
+    return key;
+}
+
+/* Pops every element, checking that each comes out at its turn and that the
+   heap ends up empty. */
+static void drain_model(Heap *heap, struct model *model, int want_max) {
+    void *data;
+    size_t id;
+    int key;
+
+    while (model->live_count > 0) {
+        CHECK(heap_get_size(heap) == model->live_count);
+        CHECK(heap_pop_with_key(heap, &data, &key) == 0);
+        CHECK(key == end_key(model, want_max));
+        id = element_id(model, data);
+        CHECK(id != CHECK_ELEMENTS);
+        if (id == CHECK_ELEMENTS) return;
+        CHECK(model->keys[id] == key);
+        kill_element(model, id);
+    }
+    CHECK(heap_get_size(heap) == 0);
+    CHECK(heap_pop_with_key(heap, &data, &key) == 1);
+}
+
+/* Runs a random mix of tracked pushes, key changes, removals and pops from
+   both ends on a heap, checking every result against the model.  On a radix
+   heap no key goes below the last one popped. */
+static void check_handles(Heap *heap, enum heap_order order, int radix) {
+    struct model *model;
+    void *data;
+    size_t ops;
+    size_t id;
+    int want_max;
+    int floor;
+    int key;
+
+    model = calloc(1, sizeof(struct model));
+    want_max = order == HEAP_MAX_ORDER;
+    floor = 0;
+    for (ops=0; ops<20000 && model->count < CHECK_ELEMENTS; ops++) {
+        id = model->live_count > 0 ? model->live[(size_t) next_key() % model->live_count] : 0;
+        switch (model->live_count > 0 ? next_key() % 10 : 0) {
+        case 0: case 1: case 2: case 3:
+            key = floor + next_key() % 1000;
+            id = add_element(model, key, heap_push_tracked(heap, element_data(model->count), key));
+            CHECK(model->handles[id] != HEAP_NO_HANDLE);
+            break;
+        case 4:
+            key = model->keys[id] - next_key() % 50;
+            if (key < floor) key = floor;
+            CHECK(heap_decrease_key(heap, model->handles[id], model->keys[id] + 1) == 1);
+            CHECK(heap_decrease_key(heap, model->handles[id], key) == 0);
+            model->keys[id] = key;
+            break;
+        case 5:
+            key = model->keys[id] + next_key() % 50;
+            if (model->keys[id] > floor) {
+                CHECK(heap_increase_key(heap, model->handles[id], model->keys[id] - 1) == 1);
+            }
+            CHECK(heap_increase_key(heap, model->handles[id], key) == 0);
+            model->keys[id] = key;
+            break;
+        case 6:
+            CHECK(heap_remove(heap, model->handles[id]) == element_data(id));
+            CHECK(heap_get_last_key(heap) == model->keys[id]);
+            kill_element(model, id);
+            break;
+        case 7: case 8:
+            CHECK(heap_peek_with_key(heap, NULL, &key) == 0);
+            CHECK(key == end_key(model, want_max));
+            CHECK(heap_pop_with_key(heap, &data, &key) == 0);
+            CHECK(key == end_key(model, want_max));
+            id = element_id(model, data);
+            CHECK(id != CHECK_ELEMENTS && model->keys[id] == key);
+            if (id != CHECK_ELEMENTS) kill_element(model, id);
+            if (radix) floor = key;
+            break;
+        default:
+            key = end_key(model, !want_max);
+            data = want_max ? heap_pop_min(heap) : heap_pop_max(heap);
+            CHECK(heap_get_last_key(heap) == key);
+            id = element_id(model, data);
+            CHECK(id != CHECK_ELEMENTS && model->keys[id] == key);
+            if (id != CHECK_ELEMENTS) kill_element(model, id);
+            break;
+        }
+        CHECK(heap_get_size(heap) == model->live_count);
+    }
+    drain_model(heap, model, want_max);
+    CHECK(heap_remove(heap, model->handles[0]) == NULL);
+    CHECK(heap_decrease_key(heap, model->handles[0], 0) == -1);
+    destroy_heap(heap, NULL);
+    free(model);
+}
+
+/* Loads n random keys into a heap of the given arity and order, half by
+   heap_build() and half by heap_push(), and checks that they pop in the
+   order qsort() puts them in.  For n of HEAP_VECTOR_MIN_SIZE or more, the
+   pops of an 8-ary heap run the vector downheap. */
+static void check_large_heap(size_t n, unsigned int arity, enum heap_order order) {
+    Heap *heap;
+    int *keys;
+    int *expect;
+    void **data;
+    void *top;
+    size_t i;
+    int key;
+
+    heap = create_ordered_heap(4, arity, order);
+    keys = malloc(sizeof(int) * n);
+    expect = malloc(sizeof(int) * n);
+    data = malloc(sizeof(void*) * n);
+    for (i=0; i<n; i++) {
+        keys[i] = next_key() - (1 << 30);
+        expect[i] = keys[i];
+        data[i] = (void*) (intptr_t) (i + 1);
+    }
+    CHECK(heap_build(heap, keys, data, n / 2) == 0);
+    for (i=n/2; i<n; i++) {
+        CHECK(heap_push(heap, data[i], keys[i]) != NULL);
+    }
+    qsort(expect, n, sizeof(int), order == HEAP_MAX_ORDER ? compare_keys_desc : compare_keys);
+
+    CHECK(heap_get_size(heap) == n);
+    for (i=0; i<n; i++) {
+        CHECK(heap_pop_with_key(heap, &top, &key) == 0);
+        CHECK(key == expect[i]);
+        CHECK(top != NULL && keys[(intptr_t) top - 1] == key);
+    }
+    CHECK(heap_get_size(heap) == 0);
+
+    destroy_heap(heap, NULL);
+    free(keys);
+    free(expect);
+    free(data);
+}
+
+#define MQ_THREADS 4
+#define MQ_PUSHES 20000
+
+/* One thread's share of a MultiQueue check.  Element ids run from first to
+   first + MQ_PUSHES - 1; an element's data is its id plus one.  Every pop
+   is recorded, so the main thread can check that no element was lost or
+   popped twice. */
+struct mq_worker {
+    MultiQueue *queue;
+    unsigned int rng;
+    int pushes;            /* Whether this pass pushes. */
+    int pops;              /* Whether it pops: between pushes, or until empty. */
+    size_t first;
+    int *keys;             /* The key of each element, by id. */
+    size_t *popped;        /* Ids of the elements this thread popped. */
+    int *popped_keys;
+    size_t popped_count;
+    size_t out_of_order;   /* Pops that came out below the one before. */
+    int failed;
+};
+
+static int mq_take(struct mq_worker *worker) {
+    void *data;
+    int key;
+
+    if (multiqueue_pop(worker->queue, &data, &key) != 0) return 1;
+    if (worker->popped_count > 0 && key < worker->popped_keys[worker->popped_count - 1]) {
+        worker->out_of_order++;
+    }
+    worker->popped[worker->popped_count] = (size_t) (intptr_t) data - 1;
+    worker->popped_keys[worker->popped_count] = key;
+    worker->popped_count++;
+    return 0;
+}
+
+static void *mq_work(void *arg) {
+    struct mq_worker *worker;
+    size_t id;
+    int key;
+
+    worker = arg;
+    if (worker->pushes) {
+        for (id=worker->first; id<worker->first+MQ_PUSHES; id++) {
+            worker->rng ^= worker->rng << 13;
+            worker->rng ^= worker->rng >> 17;
+            worker->rng ^= worker->rng << 5;
+            key = (int) (worker->rng % 100000);
+            worker->keys[id] = key;
+            if (multiqueue_push(worker->queue, (void*) (intptr_t) (id + 1), key) != 0) worker->failed = 1;
+            if (worker->pops && (worker->rng & 0x100) != 0) mq_take(worker);
+        }
+    } else if (worker->pops) {
+        while (mq_take(worker) == 0);
+    }
+    return NULL;
+}
+
+/* Runs one pass of MQ_THREADS workers at once, pushing, popping or both. */
+static void mq_run(struct mq_worker *workers, int pushes, int pops) {
+    pthread_t threads[MQ_THREADS];
+    size_t i;
+
+    for (i=0; i<MQ_THREADS; i++) {
+        workers[i].pushes = pushes;
+        workers[i].pops = pops;
+        CHECK(pthread_create(&threads[i], NULL, mq_work, &workers[i]) == 0);
+    }
+    for (i=0; i<MQ_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/* Has MQ_THREADS threads push and pop on a queue at once, then drains it,
+   and checks that every element came out exactly once with its own key.  A
+   strict queue is filled by all the threads first and then emptied by all
+   of them, and each thread's pops must come out in order. */
+static void check_multiqueue(int mode) {
+    struct mq_worker workers[MQ_THREADS];
+    struct mq_worker drain;
+    struct mq_worker *worker;
+    unsigned char *seen;
+    int *keys;
+    size_t total;
+    size_t id;
+    size_t i;
+    size_t j;
+
+    total = (size_t) MQ_THREADS * MQ_PUSHES;
+    keys = malloc(sizeof(int) * total);
+    seen = calloc(total, 1);
+    memset(workers, 0, sizeof(workers));
+    memset(&drain, 0, sizeof(drain));
+    for (i=0; i<=MQ_THREADS; i++) {
+        worker = i < MQ_THREADS ? &workers[i] : &drain;
+        worker->rng = 2463534242u + (unsigned int) i * 7919;
+        worker->first = i * MQ_PUSHES;
+        worker->keys = keys;
+        worker->popped = malloc(sizeof(size_t) * total);
+        worker->popped_keys = malloc(sizeof(int) * total);
+    }
+    drain.queue = create_multiqueue(MQ_THREADS, 0, mode);
+    CHECK(drain.queue != NULL);
+    for (i=0; i<MQ_THREADS; i++) workers[i].queue = drain.queue;
+
+    if (mode == MULTIQUEUE_STRICT) {
+        mq_run(workers, 1, 0);
+        CHECK(multiqueue_get_size(drain.queue) == total);
+        mq_run(workers, 0, 1);
+        for (i=0; i<MQ_THREADS; i++) CHECK(workers[i].out_of_order == 0);
+    } else {
+        mq_run(workers, 1, 1);
+    }
+    while (mq_take(&drain) == 0);
+    if (mode == MULTIQUEUE_STRICT) CHECK(drain.popped_count == 0);
+    CHECK(multiqueue_get_size(drain.queue) == 0);
+
+    for (i=0; i<=MQ_THREADS; i++) {
+        worker = i < MQ_THREADS ? &workers[i] : &drain;
+        CHECK(worker->failed == 0);
+        for (j=0; j<worker->popped_count; j++) {
+            id = worker->popped[j];
+            CHECK(id < total);
+            if (id >= total) continue;
+            CHECK(seen[id] == 0);
+            CHECK(keys[id] == worker->popped_keys[j]);
+            seen[id] = 1;
+        }
+        free(worker->popped);
+        free(worker->popped_keys);
+    }
+    for (id=0; id<total; id++) {
+        CHECK(seen[id] == 1);
+    }
+    destroy_multiqueue(drain.queue, NULL);
+    free(keys);
+    free(seen);
+}
+
+/* Pushes n random keys below range onto a heap, tracked or not, recording
+   them in the model. */
+static void fill_model(Heap *heap, struct model *model, size_t n, int low, int range, int tracked) {
+    size_t i;
+    int key;
+
+    for (i=0; i<n; i++) {
+        key = low + next_key() % range;
+        if (tracked) {
+            add_element(model, key, heap_push_tracked(heap, element_data(model->count), key));
+        } else {
+            add_element(model, key, HEAP_NO_HANDLE);
+            CHECK(heap_push(heap, element_data(model->count - 1), key) != NULL);
+        }
+    }
+}
+
+/* Melds src into dst, which must both be filled from the same model, and
+   checks that dst then holds everything, its handles still work, and src
+   is empty but usable. */
+static void check_meld_into(Heap *dst, Heap *src, struct model *model, size_t tracked, int want_max) {
+    size_t size;
+    size_t i;
+
+    size = heap_get_size(dst) + heap_get_size(src);
+    CHECK(heap_meld(dst, src) == 0);
+    CHECK(heap_get_size(dst) == size);
+    CHECK(heap_get_size(src) == 0);
+    for (i=0; i<tracked; i++) {
+        if (i % 3 != 0) continue;
+        CHECK(heap_increase_key(dst, model->handles[i], model->keys[i] + 7) == 0);
+        model->keys[i] += 7;
+    }
+    CHECK(heap_push(src, NULL, 1 << 30) != NULL);
+    CHECK(heap_get_size(src) == 1);
+    CHECK(heap_pop(src) == NULL && heap_get_last_key(src) == 1 << 30);
+    drain_model(dst, model, want_max);
+}
+
+static void check_meld(void) {
+    static const struct {
+        unsigned int dst_arity;
+        enum heap_order dst_order;
+        unsigned int src_arity;
+        enum heap_order src_order;
+    } pairs[] = {
+        { 2, HEAP_MIN_ORDER, 2, HEAP_MIN_ORDER },
+        { 4, HEAP_MIN_ORDER, 2, HEAP_MAX_ORDER },
+        { 8, HEAP_MAX_ORDER, 4, HEAP_MIN_ORDER },
+        { 2, HEAP_MIN_MAX_ORDER, 8, HEAP_MIN_ORDER }
+    };
+    struct model *model;
+    Heap *dst;
+    Heap *src;
+    Heap *other;
+    size_t i;
+    size_t n;
+
+    model = calloc(2, sizeof(struct model));
+    for (i=0; i<sizeof(pairs) / sizeof(pairs[0]); i++) {
+        for (n=1; n<=1000; n*=10) {
+            memset(model, 0, sizeof(struct model));
+            dst = create_ordered_heap(4, pairs[i].dst_arity, pairs[i].dst_order);
+            src = create_ordered_heap(4, pairs[i].src_arity, pairs[i].src_order);
+            fill_model(dst, model, 300, 0, 1000, 1);
+            fill_model(src, model, n, 0, 1000, 0);
+            check_meld_into(dst, src, model, 300, pairs[i].dst_order == HEAP_MAX_ORDER);
+            destroy_heap(dst, NULL);
+            destroy_heap(src, NULL);
+        }
+    }
+
+    memset(model, 0, sizeof(struct model));
+    dst = create_engine_heap(4, HEAP_PAIRING_ENGINE);
+    src = create_engine_heap(4, HEAP_PAIRING_ENGINE);
+    fill_model(dst, model, 500, 0, 1000, 1);
+    fill_model(src, model, 700, 0, 1000, 1);
+    check_meld_into(dst, src, model, 500, 0);
+    destroy_heap(dst, NULL);
+    destroy_heap(src, NULL);
+
+    /* A radix heap takes only keys at or above the last one it popped, and
+       is left alone by a meld that would break that.  The rejected elements
+       are kept in a model of their own. */
+    memset(model, 0, sizeof(struct model));
+    dst = create_engine_heap(4, HEAP_RADIX_ENGINE);
+    src = create_engine_heap(4, HEAP_RADIX_ENGINE);
+    fill_model(dst, model, 500, 100, 1000, 1);
+    drain_model(dst, model, 0);
+    memset(model, 0, sizeof(struct model));
+    fill_model(dst, model, 200, 1100, 1000, 1);
+    fill_model(src, &model[1], 10, 0, 1000, 0);
+    CHECK(heap_meld(dst, src) == -1);
+    CHECK(heap_get_size(dst) == 200 && heap_get_size(src) == 10);
+    while (heap_get_size(src) > 0) heap_pop(src);
+    fill_model(src, model, 300, 1100, 1000, 0);
+    check_meld_into(dst, src, model, 200, 0);
+    destroy_heap(dst, NULL);
+    destroy_heap(src, NULL);
+
+    /* Heaps that cannot be melded are left as they were. */
+    dst = create_heap(4);
+    other = create_engine_heap(4, HEAP_PAIRING_ENGINE);
+    heap_push(dst, NULL, 1);
+    heap_push(other, NULL, 2);
+    CHECK(heap_meld(dst, other) == -1);
+    CHECK(heap_meld(dst, dst) == -1);
+    CHECK(heap_meld(NULL, dst) == -1);
+    src = create_bounded_heap(2, 2, HEAP_MIN_ORDER);
+    heap_push(src, NULL, 3);
+    heap_push(src, NULL, 4);
+    CHECK(heap_meld(src, dst) == 1);
+    CHECK(heap_get_size(src) == 2 && heap_get_size(dst) == 1 && heap_get_size(other) == 1);
+    destroy_heap(src, NULL);
+    destroy_heap(dst, NULL);
+    destroy_heap(other, NULL);
+    free(model);
+}
+
+static size_t evictions = 0;
+
+static void count_eviction(void *data) {
+    (void) data;
+    evictions++;
+}
+
+/* Offers n random keys to a bounded heap of capacity k, in batches of
+   random sizes, and checks that it keeps the k best keys by qsort() and
+   hands every other element to the evict function exactly once. */
+static void check_top_k(size_t n, size_t k, enum heap_order order) {
+    Heap *heap;
+    int *keys;
+    int *expect;
+    void **data;
+    void *top;
+    size_t accepted;
+    size_t batch;
+    size_t i;
+    int key;
+
+    heap = create_bounded_heap(k, 4, order);
+    CHECK(heap != NULL);
+    if (heap == NULL) return;
+    keys = malloc(sizeof(int) * n);
+    expect = malloc(sizeof(int) * n);
+    data = malloc(sizeof(void*) * n);
+    for (i=0; i<n; i++) {
+        keys[i] = next_key() % 50000;
+        expect[i] = keys[i];
+        data[i] = (void*) (intptr_t) (i + 1);
+    }
+    qsort(expect, n, sizeof(int), compare_keys);
+
+    evictions = 0;
+    accepted = 0;
+    for (i=0; i<n; i+=batch) {
+        batch = 1 + (size_t) next_key() % 2000;
+        if (batch > n - i) batch = n - i;
+        accepted += heap_offer_batch(heap, &keys[i], &data[i], batch, count_eviction);
+    }
+    CHECK(evictions == n - k);
+    CHECK(accepted >= k && accepted <= n);
+    CHECK(heap_get_size(heap) == k);
+    CHECK(heap_push(heap, NULL, 0) == NULL);
+
+    /* A min-heap keeps the highest keys and pops them lowest first; a
+       max-heap keeps the lowest and pops them highest first. */
+    for (i=0; i<k; i++) {
+        CHECK(heap_pop_with_key(heap, &top, &key) == 0);
+        CHECK(key == (order == HEAP_MIN_ORDER ? expect[n - k + i] : expect[k - 1 - i]));
+        CHECK(top != NULL && keys[(intptr_t) top - 1] == key);
+    }
+    CHECK(heap_get_size(heap) == 0);
+
+    destroy_heap(heap, NULL);
+    free(keys);
+    free(expect);
+    free(data);
+}
+
+static uint64_t snapshot_id(void *data) {
+    return (uint64_t) (uintptr_t) data * 3;
+}
+
+/* Saves a heap of n random keys, loads it back, and checks that the loaded
+   heap pops the same elements, both before and after pushes copy it out of
+   the mapping.  With by_id set, ids are made by snapshot_id() and data comes
+   back as the id. */
+static void check_snapshot(size_t n, unsigned int arity, enum heap_order order, int by_id) {
+    struct model *model;
+    Heap *heap;
+    Heap *loaded;
+    void *data;
+    size_t id;
+    size_t i;
+    int want_max;
+    int key;
+
+    model = calloc(1, sizeof(struct model));
+    want_max = order == HEAP_MAX_ORDER;
+    heap = create_ordered_heap(4, arity, order);
+    fill_model(heap, model, n, -500, 1000, 0);
+    CHECK(heap_save_snapshot(heap, CHECK_SNAPSHOT, by_id ? snapshot_id : NULL) == 0);
+    destroy_heap(heap, NULL);
+
+    loaded = heap_load_snapshot(CHECK_SNAPSHOT);
+    CHECK(loaded != NULL);
+    if (loaded == NULL) {
+        free(model);
+        return;
+    }
+    CHECK(heap_get_size(loaded) == n);
+    for (i=0; i<n/2; i++) {
+        CHECK(heap_pop_with_key(loaded, &data, &key) == 0);
+        CHECK(key == end_key(model, want_max));
+        if (by_id) data = (void*) (uintptr_t) ((uint64_t) (uintptr_t) data / 3);
+        id = element_id(model, data);
+        CHECK(id != CHECK_ELEMENTS && model->keys[id] == key);
+        if (id != CHECK_ELEMENTS) kill_element(model, id);
+    }
+    if (order == HEAP_MIN_MAX_ORDER && model->live_count > 0) {
+        key = end_key(model, 1);
+        data = heap_pop_max(loaded);
+        CHECK(heap_get_last_key(loaded) == key);
+        if (by_id) data = (void*) (uintptr_t) ((uint64_t) (uintptr_t) data / 3);
+        id = element_id(model, data);
+        CHECK(id != CHECK_ELEMENTS);
+        if (id != CHECK_ELEMENTS) kill_element(model, id);
+    }
+    if (by_id) {
+        for (i=0; i<model->live_count; i++) model->keys[model->live[i]] = INT_MIN;
+        while (heap_get_size(loaded) > 0) heap_pop(loaded);
+        model->live_count = 0;
+    }
+    fill_model(loaded, model, n + 10, -500, 1000, 0);
+    drain_model(loaded, model, want_max);
+    destroy_heap(loaded, NULL);
+    free(model);
+}
+
+static void check_snapshots(void) {
+    static const size_t sizes[] = { 0, 1, 15, 16, 17, 1000 };
+    Heap *heap;
+    FILE *file;
+    size_t i;
+
+    for (i=0; i<sizeof(sizes) / sizeof(sizes[0]); i++) {
+        check_snapshot(sizes[i], 2, HEAP_MIN_ORDER, 0);
+        check_snapshot(sizes[i], 4, HEAP_MAX_ORDER, 0);
+        check_snapshot(sizes[i], 8, HEAP_MIN_ORDER, 1);
+        check_snapshot(sizes[i], 2, HEAP_MIN_MAX_ORDER, 0);
+    }
+
+    heap = create_engine_heap(4, HEAP_PAIRING_ENGINE);
+    CHECK(heap_save_snapshot(heap, CHECK_SNAPSHOT, NULL) == -1);
+    destroy_heap(heap, NULL);
+
+    /* Files that are not snapshots, or are cut short, are refused. */
+    file = fopen(CHECK_SNAPSHOT, "w");
+    if (file != NULL) {
+        fputs("not a heap snapshot, just some text that is long enough to pass for a header", file);
+        fclose(file);
+    }
+    CHECK(heap_load_snapshot(CHECK_SNAPSHOT) == NULL);
+    heap = create_heap(4);
+    for (i=0; i<100; i++) heap_push(heap, NULL, (int) i);
+    CHECK(heap_save_snapshot(heap, CHECK_SNAPSHOT, NULL) == 0);
+    destroy_heap(heap, NULL);
+    CHECK(truncate(CHECK_SNAPSHOT, 200) == 0);
+    CHECK(heap_load_snapshot(CHECK_SNAPSHOT) == NULL);
+    remove(CHECK_SNAPSHOT);
+    CHECK(heap_load_snapshot(CHECK_SNAPSHOT) == NULL);
+}
+
+/* Pushes, cancels and fires timers due from a little before the clock to
+   well past the wheel's span, and checks that each advance returns every
+   timer due by then, in order of their keys, and nothing else.  Small
+   values of max make the wheel hand back its due timers over several
+   calls. */
+static void check_timerwheel(int start, size_t max) {
+    struct model *model;
+    TimerWheel *wheel;
+    int keys[64];
+    void *data[64];
+    size_t last;
+    size_t got;
+    size_t id;
+    size_t i;
+    int clock;
+    int now;
+    int due;
+
+    model = calloc(1, sizeof(struct model));
+    wheel = create_timerwheel(start);
+    clock = start;
+    while (model->count < CHECK_ELEMENTS - 8 || model->live_count > 0) {
+        for (i=0; i<8 && model->count < CHECK_ELEMENTS; i++) {
+            switch (next_key() % 4) {
+            case 0:
+                due = clock - 5 + next_key() % 100;
+                break;
+            case 1:
+                due = clock + next_key() % 5000;
+                break;
+            case 2:
+                due = clock + next_key() % (TIMERWHEEL_SPAN / 64);
+                break;
+            default:
+                due = clock + next_key() % (TIMERWHEEL_SPAN * 3);
+                break;
+            }
+            id = add_element(model, due, timerwheel_push(wheel, element_data(model->count), due));
+            CHECK(model->handles[id] != TIMER_NO_HANDLE);
+        }
+        for (i=0; i<3 && model->live_count > 0; i++) {
+            id = model->live[(size_t) next_key() % model->live_count];
+            CHECK(timerwheel_cancel(wheel, model->handles[id]) == element_data(id));
+            kill_element(model, id);
+        }
+        CHECK(timerwheel_get_size(wheel) == model->live_count);
+
+        now = clock + next_key() % (model->count < CHECK_ELEMENTS - 8 ? 3000 : TIMERWHEEL_SPAN / 4);
+        if (next_key() % 16 == 0) now = clock - 10;
+        if (now > clock) clock = now;
+        last = CHECK_ELEMENTS;
+        do {
+            got = timerwheel_advance(wheel, now, keys, data, max);
+            CHECK(got <= max);
+            for (i=0; i<got; i++) {
+                CHECK(keys[i] <= clock);
+                id = element_id(model, data[i]);
+                CHECK(id != CHECK_ELEMENTS && model->keys[id] == keys[i]);
+                if (id == CHECK_ELEMENTS) continue;
+                if (last != CHECK_ELEMENTS) CHECK(model->keys[last] <= keys[i]);
+                last = id;
+                kill_element(model, id);
+            }
+        } while (got == max);
+        for (i=0; i<model->live_count; i++) {
+            CHECK(model->keys[model->live[i]] > clock);
+        }
+        CHECK(timerwheel_get_size(wheel) == model->live_count);
+    }
+    CHECK(timerwheel_cancel(wheel, model->handles[0]) == NULL);
+    destroy_timerwheel(wheel, NULL);
+    free(model);
+}
+
+/* An allocator over malloc() that counts the blocks it has out, so a heap
+   can be seen to give back everything it took. */
+static void *counted_allocate(void *context, size_t size) {
+    void *block;
+
+    block = malloc(size);
+    if (block != NULL) (*(long*) context)++;
+    return block;
+}
+
+static void *counted_reallocate(void *context, void *block, size_t old_size, size_t new_size) {
+    (void) context;
+    (void) old_size;
+    return realloc(block, new_size);
+}
+
+static void counted_release(void *context, void *block, size_t size) {
+    (void) size;
+    (*(long*) context)--;
+    free(block);
+}
+
+/* Runs a heap on a counting allocator, and checks that an allocator
+   missing any of its functions is refused. */
+static void check_allocators(void) {
+    struct allocator allocator;
+    struct allocator partial;
+    Heap *heap;
+    long blocks;
+    size_t i;
+
+    blocks = 0;
+    allocator.allocate = counted_allocate;
+    allocator.reallocate = counted_reallocate;
+    allocator.release = counted_release;
+    allocator.context = &blocks;
+    heap = create_allocated_heap(2, 4, HEAP_MIN_ORDER, &allocator);
+    CHECK(heap != NULL);
+    for (i=0; i<1000; i++) heap_push_tracked(heap, NULL, next_key());
+    CHECK(heap_shrink_to_fit(heap) == 0);
+    for (i=0; i<1000; i++) heap_pop(heap);
+    CHECK(heap_shrink_to_fit(heap) == 0);
+    CHECK(blocks > 0);
+    destroy_heap(heap, NULL);
+    CHECK(blocks == 0);
+
+    partial = allocator;
+    partial.reallocate = NULL;
+    CHECK(create_allocated_heap(2, 2, HEAP_MIN_ORDER, &partial) == NULL);
+    partial = allocator;
+    partial.allocate = NULL;
+    CHECK(create_allocated_heap(2, 2, HEAP_MIN_ORDER, &partial) == NULL);
+    partial = allocator;
+    partial.release = NULL;
+    CHECK(create_allocated_heap(2, 2, HEAP_MIN_ORDER, &partial) == NULL);
+    CHECK(blocks == 0);
+}
+
+#define SQ_PRODUCERS 4
+#define SQ_PUSHES 20000
+
+/* A producer for check_stagedqueue(): pushes ids first to first +
+   SQ_PUSHES - 1, with data of the id plus one, retrying while the ring is
+   full. */
+struct sq_producer {
+    StagedQueue *queue;
+    unsigned int rng;
+    size_t first;
+    int *keys;
+    size_t full;           /* Pushes refused because the ring was full. */
+    int failed;
+};
+
+static void *sq_produce(void *arg) {
+    struct sq_producer *producer;
+    size_t id;
+    int result;
+    int key;
+
+    producer = arg;
+    for (id=producer->first; id<producer->first+SQ_PUSHES; id++) {
+        producer->rng ^= producer->rng << 13;
+        producer->rng ^= producer->rng >> 17;
+        producer->rng ^= producer->rng << 5;
+        key = (int) (producer->rng % 100000);
+        producer->keys[id] = key;
+        while ((result = stagedqueue_push(producer->queue, (void*) (intptr_t) (id + 1), key)) == 1) {
+            producer->full++;
+            sched_yield();
+        }
+        if (result != 0) producer->failed = 1;
+    }
+    return NULL;
+}
+
+/* Runs SQ_PRODUCERS producer threads against a consumer on this one, through
+   a ring small enough to fill up, and checks that every element is popped
+   exactly once with its own key. */
+static void check_staged_producers(void) {
+    struct sq_producer producers[SQ_PRODUCERS];
+    pthread_t threads[SQ_PRODUCERS];
+    StagedQueue *queue;
+    unsigned char *seen;
+    int *keys;
+    void *data;
+    size_t total;
+    size_t popped;
+    size_t id;
+    size_t i;
+    int key;
+
+    total = (size_t) SQ_PRODUCERS * SQ_PUSHES;
+    keys = malloc(sizeof(int) * total);
+    seen = calloc(total, 1);
+    queue = create_stagedqueue(256, 32);
+    CHECK(queue != NULL);
+    for (i=0; i<SQ_PRODUCERS; i++) {
+        producers[i].queue = queue;
+        producers[i].rng = 2463534242u + (unsigned int) i * 7919;
+        producers[i].first = i * SQ_PUSHES;
+        producers[i].keys = keys;
+        producers[i].full = 0;
+        producers[i].failed = 0;
+        CHECK(pthread_create(&threads[i], NULL, sq_produce, &producers[i]) == 0);
+    }
+
+    popped = 0;
+    while (popped < total) {
+        if (stagedqueue_pop(queue, &data, &key) != 0) {
+            sched_yield();
+            continue;
+        }
+        id = (size_t) (intptr_t) data - 1;
+        CHECK(id < total);
+        if (id >= total) break;
+        CHECK(seen[id] == 0);
+        CHECK(keys[id] == key);
+        seen[id] = 1;
+        popped++;
+    }
+    for (i=0; i<SQ_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(producers[i].failed == 0);
+    }
+    CHECK(stagedqueue_get_size(queue) == 0);
+    CHECK(stagedqueue_pop(queue, NULL, NULL) == 1);
+    for (id=0; id<total; id++) {
+        CHECK(seen[id] == 1);
+    }
+    destroy_stagedqueue(queue, NULL);
+    free(keys);
+    free(seen);
+}
+
+/* With a single producer, every pop must return the lowest key pushed so
+   far, as a plain heap would; and a full ring must refuse pushes until the
+   consumer drains it. */
+static void check_staged_order(void) {
+    struct model *model;
+    StagedQueue *queue;
+    void *data;
+    size_t id;
+    size_t i;
+    int key;
+
+    model = calloc(1, sizeof(struct model));
+    queue = create_stagedqueue(0, 0);
+    while (model->count < CHECK_ELEMENTS) {
+        if (model->live_count == 0 || next_key() % 5 < 3) {
+            key = next_key() % 1000;
+            add_element(model, key, HEAP_NO_HANDLE);
+            CHECK(stagedqueue_push(queue, element_data(model->count - 1), key) == 0);
+        } else {
+            CHECK(stagedqueue_pop(queue, &data, &key) == 0);
+            CHECK(key == end_key(model, 0));
+            id = element_id(model, data);
+            CHECK(id != CHECK_ELEMENTS && model->keys[id] == key);
+            if (id != CHECK_ELEMENTS) kill_element(model, id);
+        }
+        CHECK(stagedqueue_get_size(queue) == model->live_count);
+    }
+    while (model->live_count > 0) {
+        CHECK(stagedqueue_pop(queue, &data, &key) == 0);
+        CHECK(key == end_key(model, 0));
+        id = element_id(model, data);
+        CHECK(id != CHECK_ELEMENTS);
+        if (id == CHECK_ELEMENTS) break;
+        kill_element(model, id);
+    }
+    CHECK(stagedqueue_pop(queue, &data, &key) == 1);
+    destroy_stagedqueue(queue, NULL);
+
+    /* A ring of 16 takes 16 pushes, then refuses more until a pop or a
+       drain moves them into the heap. */
+    queue = create_stagedqueue(16, 4);
+    for (i=0; i<16; i++) {
+        CHECK(stagedqueue_push(queue, NULL, (int) (100 - i)) == 0);
+    }
+    CHECK(stagedqueue_push(queue, NULL, 0) == 1);
+    CHECK(stagedqueue_get_size(queue) == 16);
+    CHECK(stagedqueue_pop(queue, NULL, &key) == 0 && key == 85);
+    CHECK(stagedqueue_push(queue, NULL, 0) == 0);
+    CHECK(stagedqueue_drain(queue) == 1);
+    for (i=0; i<16; i++) {
+        CHECK(stagedqueue_push(queue, NULL, (int) (200 + i)) == 0);
+    }
+    CHECK(stagedqueue_push(queue, NULL, 1) == 1);
+    CHECK(stagedqueue_drain(queue) == 16);
+    CHECK(stagedqueue_get_size(queue) == 32);
+    CHECK(stagedqueue_pop(queue, NULL, &key) == 0 && key == 0);
+    for (i=0; i<15; i++) {
+        CHECK(stagedqueue_pop(queue, NULL, &key) == 0 && key == (int) (86 + i));
+    }
+    for (i=0; i<16; i++) {
+        CHECK(stagedqueue_pop(queue, NULL, &key) == 0 && key == (int) (200 + i));
+    }
+    CHECK(stagedqueue_pop(queue, NULL, &key) == 1);
+    destroy_stagedqueue(queue, NULL);
+    free(model);
+}
+
+/* Sorts n random keys below range with heap_sort() and compares them, and
+   the heap left behind, against qsort(). */
+static void check_heap_sort(size_t n, unsigned int arity, enum heap_order order, int range) {
+    Heap *heap;
+    int *keys;
+    int *sorted;
+    int *expect;
+    void **data;
+    int key;
+    void *top;
+    size_t i;
+
+    heap = create_ordered_heap(4, arity, order);
+    keys = malloc(sizeof(int) * (n + 1));
+    sorted = malloc(sizeof(int) * (n + 1));
+    expect = malloc(sizeof(int) * (n + 1));
+    data = malloc(sizeof(void*) * (n + 1));
+    for (i=0; i<n; i++) {
+        keys[i] = next_key() % range;
+        expect[i] = keys[i];
+        data[i] = (void*) (intptr_t) keys[i];
+    }
+    CHECK(heap_build(heap, keys, data, n) == 0);
+    qsort(expect, n, sizeof(int), order == HEAP_MAX_ORDER ? compare_keys_desc : compare_keys);
+
+    CHECK(heap_sort(heap, sorted, data) == 0);
+    CHECK(heap_get_size(heap) == n);
+    for (i=0; i<n; i++) {
+        CHECK(sorted[i] == expect[i]);
+        CHECK(data[i] == (void*) (intptr_t) expect[i]);
+    }
+    for (i=0; i<n; i++) {
+        CHECK(heap_pop_with_key(heap, &top, &key) == 0);
+        CHECK(key == expect[i] && top == (void*) (intptr_t) key);
+    }
+    CHECK(heap_pop_with_key(heap, &top, &key) == 1);
+
+    destroy_heap(heap, NULL);
+    free(keys);
+    free(sorted);
+    free(expect);
+    free(data);
+}
+
+/* Merges k sorted runs of n keys in all, the longest n / 2 keys long and
+   drawn from keys below range, with every method and thread count, and
+   compares the output with a single-threaded loser-tree merge and with
+   qsort().  Each datum records where its pair sat in the input, so a merge
+   that is not stable, or loses or repeats a pair, is caught. */
+static void check_merge(size_t k, size_t n, int range) {
+    static const unsigned int threads[] = { 2, 3, 4, 7, 16, 64, 1500 };
+    struct merge_array *runs;
+    struct merge_cursor *cursors;
+    HeapMerge *merge;
+    int *keys;
+    int *expect;
+    int *out_keys;
+    int *ref_keys;
+    void **data;
+    void **out_data;
+    void **ref_data;
+    size_t offset;
+    size_t i;
+    size_t t;
+    int method;
+
+    runs = malloc(sizeof(struct merge_array) * k);
+    cursors = malloc(sizeof(struct merge_cursor) * k);
+    keys = malloc(sizeof(int) * n);
+    expect = malloc(sizeof(int) * n);
+    out_keys = malloc(sizeof(int) * n);
+    ref_keys = malloc(sizeof(int) * n);
+    data = malloc(sizeof(void*) * n);
+    out_data = malloc(sizeof(void*) * n);
+    ref_data = malloc(sizeof(void*) * n);
+
+    offset = 0;
+    for (i=0; i<k; i++) {
+        runs[i].size = i + 1 < k ? (size_t) next_key() % (n / k + 1) : n - offset;
+        if (i == 0 && k > 1) runs[i].size = n / 2;
+        if (runs[i].size > n - offset) runs[i].size = n - offset;
+        runs[i].keys = keys + offset;
+        runs[i].data = data + offset;
+        offset = offset + runs[i].size;
+    }
+    for (i=0; i<n; i++) {
+        keys[i] = range > 0 ? next_key() % range : (int) i;
+        data[i] = (void*) (intptr_t) (i + 1);
+    }
+    for (i=0; i<k; i++) {
+        qsort((int*) runs[i].keys, runs[i].size, sizeof(int), compare_keys);
+    }
+    memcpy(expect, keys, sizeof(int) * n);
+    qsort(expect, n, sizeof(int), compare_keys);
+
+    CHECK(heapmerge_arrays(runs, k, ref_keys, ref_data, 1) == 0);
+    for (i=0; i<n; i++) {
+        CHECK(ref_keys[i] == expect[i]);
+        if (i > 0 && ref_keys[i] == ref_keys[i - 1]) CHECK(ref_data[i] > ref_data[i - 1]);
+    }
+
+    for (t=0; t<sizeof(threads) / sizeof(threads[0]); t++) {
+        memset(out_data, 0, sizeof(void*) * n);
+        CHECK(heapmerge_arrays(runs, k, out_keys, out_data, threads[t]) == 0);
+        CHECK(memcmp(out_keys, ref_keys, sizeof(int) * n) == 0);
+        CHECK(memcmp(out_data, ref_data, sizeof(void*) * n) == 0);
+    }
+
+    for (method = HEAPMERGE_HEAP; method <= HEAPMERGE_LOSER_TREE; method++) {
+        for (i=0; i<k; i++) {
+            runs[i].pos = 0;
+            cursors[i].next = merge_array_next;
+            cursors[i].state = &runs[i];
+        }
+        merge = create_heapmerge(cursors, k, method);
+        CHECK(merge != NULL);
+        if (merge == NULL) continue;
+        CHECK(heapmerge_next_n(merge, n + 1, out_keys, out_data) == n);
+        CHECK(memcmp(out_keys, expect, sizeof(int) * n) == 0);
+        if (method == HEAPMERGE_LOSER_TREE) CHECK(memcmp(out_data, ref_data, sizeof(void*) * n) == 0);
+        CHECK(heapmerge_next(merge, NULL, NULL) == 1);
+        destroy_heapmerge(merge);
+    }
+
+    free(runs);
+    free(cursors);
+    free(keys);
+    free(expect);
+    free(out_keys);
+    free(ref_keys);
+    free(data);
+    free(out_data);
+    free(ref_data);
+}
+
+int main(void) {
+    static const size_t merge_sizes[] = { 1000, 65536, 65537, 66042, 70000, 90000 };
+    static const unsigned int arities[] = { 2, 4, 8 };
+    size_t i;
+    size_t j;
+    int before;
+
+    before = failures;
+    for (i=0; i<3; i++) {
+        check_handles(create_ordered_heap(4, arities[i], HEAP_MIN_ORDER), HEAP_MIN_ORDER, 0);
+        check_handles(create_ordered_heap(4, arities[i], HEAP_MAX_ORDER), HEAP_MAX_ORDER, 0);
+    }
+    check_handles(create_ordered_heap(4, 2, HEAP_MIN_MAX_ORDER), HEAP_MIN_MAX_ORDER, 0);
+    check_handles(create_engine_heap(4, HEAP_PAIRING_ENGINE), HEAP_MIN_ORDER, 0);
+    check_handles(create_engine_heap(4, HEAP_RADIX_ENGINE), HEAP_MIN_ORDER, 1);
+    report("handles", before);
+
+    before = failures;
+    for (i=0; i<3; i++) {
+        check_large_heap(200000, arities[i], HEAP_MIN_ORDER);
+        check_large_heap(200000, arities[i], HEAP_MAX_ORDER);
+    }
+    report("large heaps", before);
+
+    before = failures;
+    check_multiqueue(MULTIQUEUE_RELAXED);
+    check_multiqueue(MULTIQUEUE_STRICT);
+    report("multiqueue", before);
+
+    before = failures;
+    check_allocators();
+    report("allocators", before);
+
+    before = failures;
+    check_meld();
+    report("heap_meld", before);
+
+    before = failures;
+    check_top_k(100000, 100, HEAP_MIN_ORDER);
+    check_top_k(100000, 100, HEAP_MAX_ORDER);
+    check_top_k(5000, 1, HEAP_MIN_ORDER);
+    check_top_k(1000, 1000, HEAP_MAX_ORDER);
+    report("bounded heaps", before);
+
+    before = failures;
+    check_snapshots();
+    report("snapshots", before);
+
+    before = failures;
+    check_timerwheel(0, 64);
+    check_timerwheel(-100000, 3);
+    check_timerwheel(INT_MAX - TIMERWHEEL_SPAN * 8, 1);
+    report("timerwheel", before);
+
+    before = failures;
+    check_staged_order();
+    check_staged_producers();
+    report("stagedqueue", before);
+
+    before = failures;
+    for (i=0; i<3; i++) {
+        for (j=0; j<3; j++) {
+            check_heap_sort(j * 2000 + 1, arities[i], HEAP_MIN_ORDER, 1000);
+            check_heap_sort(j * 2000 + 1, arities[i], HEAP_MAX_ORDER, 1 << 30);
+        }
+    }
+    check_heap_sort(200000, 8, HEAP_MIN_ORDER, 1 << 30);
+    check_heap_sort(200000, 8, HEAP_MAX_ORDER, 1000);
+    report("heap_sort", before);
+
+    before = failures;
+    for (i=0; i<sizeof(merge_sizes) / sizeof(merge_sizes[0]); i++) {
+        check_merge(1, merge_sizes[i], 0);
+        check_merge(3, merge_sizes[i], 100);
+        check_merge(40, merge_sizes[i], 1 << 30);
+    }
+    check_merge(1000, 70000, 50);
+    report("heapmerge", before);
+
+    if (failures > 0) {
+        printf("%d checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}
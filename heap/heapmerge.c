@@ -0,0 +1,422 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include "heap.h"
+#include "heapmerge.h"
+
+#define MERGE_NO_RUN ((size_t) -1)
+
+/* Parallel merges below this many pairs in total run on one thread. */
+#define MERGE_PARALLEL_MIN 65536
+
+/* Keys sampled from the runs for each range when choosing the splits. */
+#define MERGE_SAMPLES_PER_RANGE 32
+
+struct __mergerun {
+    int key;
+    void *data;
+    int done;              /* Nonzero once the run is exhausted. */
+};
+
+struct heapmerge {
+    struct __mergerun *runs;
+    struct merge_cursor *cursors;
+    size_t *tree;          /* Loser tree: tree[0] is the winner, tree[1..k-1]
+                              the losers, and run i is leaf k + i. */
+    Heap *heap;            /* Heap method: one entry per live run, whose
+                              data is the run's index. */
+    size_t k;
+    int method;
+};
+
+/* One key range of a parallel merge. */
+struct __mergetask {
+    pthread_t thread;
+    const struct merge_array *runs;
+    size_t k;
+    const size_t *starts;  /* Index in each run where the range starts. */
+    const size_t *ends;
+    int *out_keys;
+    void **out_data;
+    int started;           /* Nonzero if the range has a thread of its own. */
+    int status;
+};
+
+/* Internal functions */
+
+/* Reads the next pair of a run into its slot. */
+void advance_mergerun(HeapMerge *merge, size_t run) {
+    struct __mergerun *slot;
+
+    slot = &(merge->runs)[run];
+    if (slot->done) return;
+    if ((merge->cursors)[run].next((merge->cursors)[run].state, &slot->key, &slot->data) != 0) {
+        slot->done = 1;
+        slot->data = NULL;
+    }
+}
+
+/* Tells whether run a's current pair comes out before run b's.  An
+   exhausted run loses to every other, and ties go to the lower run. */
+static inline int run_beats(const struct __mergerun *runs, size_t a, size_t b) {
+    if (runs[a].done) return 0;
+    if (runs[b].done) return 1;
+    if (runs[a].key != runs[b].key) return runs[a].key < runs[b].key;
+    return a < b;
+}
+
+/* Plays run's leaf up to the root, leaving the loser of every match on the
+   way and the overall winner in tree[0]. */
+static inline void replay_losertree(HeapMerge *merge, size_t run) {
+    size_t *tree;
+    size_t winner;
+    size_t node;
+    size_t other;
+
+    tree = merge->tree;
+    winner = run;
+    for (node = (merge->k + run) >> 1; node > 0; node >>= 1) {
+        other = tree[node];
+        if (run_beats(merge->runs, other, winner)) {
+            tree[node] = winner;
+            winner = other;
+        }
+    }
+    tree[0] = winner;
+}
+
+/* Builds the loser tree.  Each leaf climbs until it finds an empty node,
+   where it waits for the winner of the sibling subtree; the second arrival
+   plays the match and carries on.  Every internal node has two children, so
+   the k - 1 of them fill up and exactly one leaf reaches the root. */
+void build_losertree(HeapMerge *merge) {
+    size_t *tree;
+    size_t winner;
+    size_t other;
+    size_t node;
+    size_t i;
+
+    tree = merge->tree;
+    for (i=0; i<merge->k; i++) tree[i] = MERGE_NO_RUN;
+    i = merge->k;
+    while (i > 0) {
+        i--;
+        winner = i;
+        for (node = (merge->k + i) >> 1; node > 0; node >>= 1) {
+            if (tree[node] == MERGE_NO_RUN) break;
+            other = tree[node];
+            if (run_beats(merge->runs, other, winner)) {
+                tree[node] = winner;
+                winner = other;
+            }
+        }
+        if (node > 0) {
+            tree[node] = winner;
+        } else {
+            tree[0] = winner;
+        }
+    }
+}
+
+/* Returns the first index in a run whose key is not below key. */
+size_t run_lower_bound(const struct merge_array *run, int key) {
+    size_t low;
+    size_t high;
+    size_t mid;
+
+    low = 0;
+    high = run->size;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (run->keys[mid] < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int compare_ints(const void *a, const void *b) {
+    int x;
+    int y;
+
+    x = *(const int*) a;
+    y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/* Merges one key range of every run into the task's slice of the output. */
+void *run_mergetask(void *arg) {
+    struct __mergetask *task;
+    struct merge_array *parts;
+    struct merge_cursor *cursors;
+    HeapMerge *merge;
+    size_t total;
+    size_t i;
+
+    task = arg;
+    task->status = 1;
+    parts = malloc(sizeof(struct merge_array) * task->k);
+    cursors = calloc(task->k, sizeof(struct merge_cursor));
+    if (parts == NULL || cursors == NULL) {
+        free(cursors);
+        free(parts);
+        return NULL;
+    }
+
+    total = 0;
+    for (i=0; i<task->k; i++) {
+        parts[i].keys = (task->runs)[i].keys + task->starts[i];
+        parts[i].data = (task->runs)[i].data != NULL ? (task->runs)[i].data + task->starts[i] : NULL;
+        parts[i].size = task->ends[i] - task->starts[i];
+        parts[i].pos = 0;
+        cursors[i].next = merge_array_next;
+        cursors[i].state = &parts[i];
+        total = total + parts[i].size;
+    }
+    merge = create_heapmerge(cursors, task->k, HEAPMERGE_LOSER_TREE);
+    if (merge != NULL) {
+        heapmerge_next_n(merge, total, task->out_keys, task->out_data);
+        task->status = 0;
+    }
+    destroy_heapmerge(merge);
+    free(cursors);
+    free(parts);
+    return NULL;
+}
+
+/* External functions */
+
+HeapMerge *create_heapmerge(const struct merge_cursor *cursors, size_t k, enum heapmerge_method method) {
+    HeapMerge *new;
+    size_t i;
+
+    if (cursors == NULL || k == 0) return NULL;
+    if (method == HEAPMERGE_AUTO) method = HEAPMERGE_LOSER_TREE;
+    if (method != HEAPMERGE_HEAP && method != HEAPMERGE_LOSER_TREE) return NULL;
+    if (k > SIZE_MAX / sizeof(struct __mergerun)) return NULL;
+
+    new = malloc(sizeof(HeapMerge));
+    if (new == NULL) return NULL;
+    new->runs = malloc(sizeof(struct __mergerun) * k);
+    new->cursors = malloc(sizeof(struct merge_cursor) * k);
+    new->tree = NULL;
+    new->heap = NULL;
+    if (method == HEAPMERGE_LOSER_TREE) {
+        new->tree = malloc(sizeof(size_t) * k);
+    } else {
+        new->heap = create_heap(k);
+    }
+    new->k = k;
+    new->method = method;
+    if (new->runs == NULL || new->cursors == NULL || (new->tree == NULL && new->heap == NULL)) {
+        destroy_heapmerge(new);
+        return NULL;
+    }
+
+    for (i=0; i<k; i++) {
+        (new->cursors)[i] = cursors[i];
+        (new->runs)[i].done = 0;
+        advance_mergerun(new, i);
+    }
+    if (method == HEAPMERGE_LOSER_TREE) {
+        build_losertree(new);
+        return new;
+    }
+    for (i=0; i<k; i++) {
+        if ((new->runs)[i].done) continue;
+        heap_push(new->heap, (void*) (uintptr_t) i, (new->runs)[i].key);
+    }
+    return new;
+}
+
+void destroy_heapmerge(HeapMerge *merge) {
+    if (merge == NULL) return;
+    destroy_heap(merge->heap, NULL);
+    free(merge->tree);
+    free(merge->cursors);
+    free(merge->runs);
+    free(merge);
+}
+
+int heapmerge_next(HeapMerge *merge, int *key, void **data) {
+    struct __mergerun *slot;
+    void *top;
+    size_t run;
+
+    if (merge == NULL) return -1;
+
+    if (merge->method == HEAPMERGE_LOSER_TREE) {
+        run = (merge->tree)[0];
+    } else {
+        if (heap_peek_with_key(merge->heap, &top, NULL) != 0) return 1;
+        run = (size_t) (uintptr_t) top;
+    }
+    slot = &(merge->runs)[run];
+    if (slot->done) return 1;
+    if (key != NULL) *key = slot->key;
+    if (data != NULL) *data = slot->data;
+
+    advance_mergerun(merge, run);
+    if (merge->method == HEAPMERGE_LOSER_TREE) {
+        replay_losertree(merge, run);
+    } else if (slot->done) {
+        heap_pop(merge->heap);
+    } else {
+        heap_replace_top(merge->heap, top, slot->key);
+    }
+    return 0;
+}
+
+size_t heapmerge_next_n(HeapMerge *merge, size_t n, int *keys, void **data) {
+    size_t i;
+
+    for (i=0; i<n; i++) {
+        if (heapmerge_next(merge, keys != NULL ? &keys[i] : NULL, data != NULL ? &data[i] : NULL) != 0) break;
+    }
+    return i;
+}
+
+int merge_array_next(void *state, int *key, void **data) {
+    struct merge_array *run;
+
+    run = state;
+    if (run->pos >= run->size) return 1;
+    *key = run->keys[run->pos];
+    *data = run->data != NULL ? run->data[run->pos] : NULL;
+    run->pos++;
+    return 0;
+}
+
+int heapmerge_arrays(const struct merge_array *runs, size_t k, int *out_keys, void **out_data,
+                     unsigned int threads) {
+    struct __mergetask *tasks;
+    size_t *bounds;
+    int *samples;
+    int *splits;
+    size_t num_samples;
+    size_t total;
+    size_t parts;
+    size_t offset;
+    size_t step;
+    size_t p;
+    size_t i;
+    size_t j;
+    int status;
+
+    if (runs == NULL || k == 0 || out_keys == NULL) return -1;
+    total = 0;
+    for (i=0; i<k; i++) {
+        if (runs[i].keys == NULL && runs[i].size != 0) return -1;
+        if (runs[i].size > SIZE_MAX - total) return -1;
+        total = total + runs[i].size;
+    }
+
+    parts = threads > 0 ? threads : 1;
+    if (total < MERGE_PARALLEL_MIN) parts = 1;
+    if (k > SIZE_MAX / (parts + 1) / sizeof(size_t)) return 1;
+
+    /* bounds holds parts + 1 rows of k run indices; range p covers
+       [bounds[p * k + i], bounds[(p + 1) * k + i]) of run i. */
+    bounds = malloc(sizeof(size_t) * k * (parts + 1));
+    tasks = malloc(sizeof(struct __mergetask) * parts);
+    samples = malloc(sizeof(int) * (parts * MERGE_SAMPLES_PER_RANGE + k));
+    splits = malloc(sizeof(int) * parts);
+    if (bounds == NULL || tasks == NULL || samples == NULL || splits == NULL) {
+        free(bounds);
+        free(tasks);
+        free(samples);
+        free(splits);
+        return 1;
+    }
+
+    /* Split the key range at evenly spaced keys of a sample taken with the
+       same stride from every run, so each run is sampled in proportion to
+       its size.  The stride is rounded up, so the runs give at most
+       total / step <= parts * MERGE_SAMPLES_PER_RANGE samples between them,
+       plus at most one more each. */
+    num_samples = 0;
+    if (parts > 1) {
+        step = (total + parts * MERGE_SAMPLES_PER_RANGE - 1) / (parts * MERGE_SAMPLES_PER_RANGE);
+        if (step < 1) step = 1;
+        for (i=0; i<k; i++) {
+            for (j = step / 2; j < runs[i].size; j += step) {
+                samples[num_samples++] = runs[i].keys[j];
+            }
+        }
+        qsort(samples, num_samples, sizeof(int), compare_ints);
+    }
+    for (p=1; p<parts; p++) {
+        splits[p] = num_samples > 0 ? samples[num_samples * p / parts] : INT_MIN;
+    }
+
+    for (i=0; i<k; i++) {
+        bounds[i] = 0;
+        bounds[parts * k + i] = runs[i].size;
+        for (p=1; p<parts; p++) {
+            bounds[p * k + i] = run_lower_bound(&runs[i], splits[p]);
+        }
+    }
+
+    offset = 0;
+    for (p=0; p<parts; p++) {
+        tasks[p].runs = runs;
+        tasks[p].k = k;
+        tasks[p].starts = &bounds[p * k];
+        tasks[p].ends = &bounds[(p + 1) * k];
+        tasks[p].out_keys = out_keys + offset;
+        tasks[p].out_data = out_data != NULL ? out_data + offset : NULL;
+        tasks[p].started = 0;
+        tasks[p].status = 1;
+        for (i=0; i<k; i++) {
+            offset = offset + (tasks[p].ends[i] - tasks[p].starts[i]);
+        }
+    }
+
+    /* Range 0 runs on this thread; a range whose thread cannot be started
+       runs here too, once range 0 is done. */
+    for (p=1; p<parts; p++) {
+        tasks[p].started = pthread_create(&tasks[p].thread, NULL, run_mergetask, &tasks[p]) == 0;
+    }
+    run_mergetask(&tasks[0]);
+    status = tasks[0].status;
+    for (p=1; p<parts; p++) {
+        if (tasks[p].started) {
+            pthread_join(tasks[p].thread, NULL);
+        } else {
+            run_mergetask(&tasks[p]);
+        }
+        if (tasks[p].status != 0) status = 1;
+    }
+
+    free(bounds);
+    free(tasks);
+    free(samples);
+    free(splits);
+    return status;
+}
@@ -0,0 +1,103 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+
+#ifndef __MSAUND05_HEAPMERGEH
+#define __MSAUND05_HEAPMERGEH
+
+#include <stddef.h>
+
+typedef struct heapmerge HeapMerge;
+
+/* Merges k sorted runs of key and data pairs into one sorted stream.  Each
+   run is read through a cursor, so runs can be arrays, spill files or
+   anything else that yields pairs in ascending key order.  Only the current
+   pair of each run is held, so memory is O(k) however long the runs are. */
+
+/* A run to merge.  next stores the run's next key and data and returns 0, or
+   returns 1 once the run is exhausted.  state is passed to it unchanged. */
+struct merge_cursor {
+    int (*next) (void *state, int *key, void **data);
+    void *state;
+};
+
+/* How the current pairs of the runs are kept in order.
+
+   HEAPMERGE_HEAP keeps them on a Heap and replaces the top for each pair
+   taken, costing up to about 2 log2 k comparisons per pair.
+
+   HEAPMERGE_LOSER_TREE keeps a tournament tree whose nodes remember the
+   loser of each match.  Replacing the winner replays only its path to the
+   root, one comparison per level, about log2 k per pair, and reads no
+   siblings, so it is the faster of the two once k is more than a few.  Ties
+   between runs go to the run given first, so its output is stable.
+
+   HEAPMERGE_AUTO picks the loser tree. */
+enum heapmerge_method {
+    HEAPMERGE_AUTO,
+    HEAPMERGE_HEAP,
+    HEAPMERGE_LOSER_TREE
+};
+
+/* Creates a merge of k runs, reading the first pair of each.  The cursors
+   are copied.  Returns NULL if k is 0, the method is not supported, or the
+   memory could not be allocated.  The merge must be freed with
+   destroy_heapmerge(). */
+HeapMerge *create_heapmerge(const struct merge_cursor *cursors, size_t k, enum heapmerge_method method);
+
+/* Frees a merge.  Its cursors are left alone. */
+void destroy_heapmerge(HeapMerge *merge);
+
+/* Takes the lowest pair left in any run, storing it in whichever of key and
+   data are not NULL.  Returns 0 on success, 1 once every run is exhausted,
+   or -1 if the merge is invalid. */
+int heapmerge_next(HeapMerge *merge, int *key, void **data);
+
+/* Takes up to n pairs in order into the arrays keys and data, either of
+   which may be NULL.  Returns the number taken, which is less than n only
+   once every run is exhausted. */
+size_t heapmerge_next_n(HeapMerge *merge, size_t n, int *keys, void **data);
+
+/* A run held in memory as parallel arrays, for use with merge_array_next().
+   pos is the index of the next pair to read; start it at 0. */
+struct merge_array {
+    const int *keys;
+    void *const *data;     /* May be NULL, in which case data comes out NULL. */
+    size_t size;
+    size_t pos;
+};
+
+/* A cursor function that reads a struct merge_array. */
+int merge_array_next(void *state, int *key, void **data);
+
+/* Merges k sorted runs held in memory into out_keys and out_data, which must
+   have room for the total size of the runs (out_data may be NULL).  The key
+   range is split at threads - 1 keys sampled from the runs, every run is
+   binary searched for each split, and each of up to threads threads merges
+   its range of every run with a loser tree straight into its own slice of
+   the output.  Equal keys always fall in the same range, so the result is
+   the same as a single loser-tree merge.  Returns 0 on success, 1 if the
+   memory or threads could not be had, or -1 if the arguments are invalid. */
+int heapmerge_arrays(const struct merge_array *runs, size_t k, int *out_keys, void **out_data,
+                     unsigned int threads);
+
+#endif
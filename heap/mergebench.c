@@ -0,0 +1,165 @@
+/* MERGEBENCH.C: Sorting and k-way merge benchmark for the heap library.
+
+   Sorts n random keys with heap_sort() and with qsort(), then merges k sorted
+   runs of random keys, the way an external sort merges its spill files, with
+   a Heap, with a loser tree, and with heapmerge_arrays() on 1 up to 8
+   threads.  Sizes can be given on the command line, eg. "./mergebench
+   1000000 10000000". */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "./heap.h"
+#include "./heapmerge.h"
+
+static unsigned int rng_state = 2463534242u;
+
+/* xorshift32, so every run sees the same key sequence. */
+static int next_key(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (int) (rng_state & 0x7fffffff);
+}
+
+/* Wall-clock time, since the parallel merge runs on several CPUs. */
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    int x;
+    int y;
+
+    x = *(const int*) a;
+    y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts n random keys, once by loading a heap and calling heap_sort(), and
+   once with qsort() on a plain array. */
+static void bench_sort(size_t n) {
+    Heap *heap;
+    int *keys;
+    void **data;
+    double start;
+    double sort_time;
+    double qsort_time;
+    size_t i;
+
+    keys = malloc(sizeof(int) * n);
+    data = malloc(sizeof(void*) * n);
+    for (i=0; i<n; i++) {
+        keys[i] = next_key();
+        data[i] = NULL;
+    }
+
+    heap = create_heap(n);
+    heap_build(heap, keys, data, n);
+    start = now_seconds();
+    heap_sort(heap, keys, NULL);
+    sort_time = now_seconds() - start;
+    destroy_heap(heap, NULL);
+
+    for (i=0; i<n; i++) {
+        keys[i] = next_key();
+    }
+    start = now_seconds();
+    qsort(keys, n, sizeof(int), compare_keys);
+    qsort_time = now_seconds() - start;
+
+    printf("sort        n=%-9lu heap_sort %8.2f ns/elem   qsort %8.2f ns/elem\n",
+           (unsigned long) n, sort_time * 1e9 / n, qsort_time * 1e9 / n);
+    free(keys);
+    free(data);
+}
+
+/* Merges k sorted runs of n keys in all with each method. */
+static void bench_merge(size_t n, size_t k) {
+    static const char *names[] = { "auto", "heap", "loser" };
+    struct merge_array *runs;
+    struct merge_cursor *cursors;
+    HeapMerge *merge;
+    int *keys;
+    int *out;
+    double start;
+    double elapsed;
+    unsigned int threads;
+    int method;
+    size_t i;
+
+    keys = malloc(sizeof(int) * n);
+    out = malloc(sizeof(int) * n);
+    runs = malloc(sizeof(struct merge_array) * k);
+    cursors = malloc(sizeof(struct merge_cursor) * k);
+    for (i=0; i<n; i++) {
+        keys[i] = next_key();
+    }
+    for (i=0; i<k; i++) {
+        runs[i].keys = keys + n / k * i;
+        runs[i].data = NULL;
+        runs[i].size = i + 1 < k ? n / k : n - n / k * i;
+        runs[i].pos = 0;
+        qsort((int*) runs[i].keys, runs[i].size, sizeof(int), compare_keys);
+    }
+
+    for (method=HEAPMERGE_HEAP; method<=HEAPMERGE_LOSER_TREE; method++) {
+        for (i=0; i<k; i++) {
+            runs[i].pos = 0;
+            cursors[i].next = merge_array_next;
+            cursors[i].state = &runs[i];
+        }
+        start = now_seconds();
+        merge = create_heapmerge(cursors, k, (enum heapmerge_method) method);
+        heapmerge_next_n(merge, n, out, NULL);
+        elapsed = now_seconds() - start;
+        destroy_heapmerge(merge);
+        printf("merge       n=%-9lu k=%-5lu %-6s       %8.2f ns/elem\n",
+               (unsigned long) n, (unsigned long) k, names[method], elapsed * 1e9 / n);
+    }
+
+    for (threads=1; threads<=8; threads*=2) {
+        start = now_seconds();
+        heapmerge_arrays(runs, k, out, NULL, threads);
+        elapsed = now_seconds() - start;
+        printf("merge       n=%-9lu k=%-5lu threads=%-4u %8.2f ns/elem\n",
+               (unsigned long) n, (unsigned long) k, threads, elapsed * 1e9 / n);
+    }
+
+    free(keys);
+    free(out);
+    free(runs);
+    free(cursors);
+}
+
+int main(int argc, char **argv) {
+    size_t default_sizes[] = { 1000000, 10000000 };
+    size_t sizes[16];
+    size_t num_sizes;
+    size_t k;
+    size_t i;
+
+    num_sizes = 0;
+    for (i=1; i<(size_t) argc && num_sizes < 16; i++) {
+        sizes[num_sizes++] = strtoul(argv[i], NULL, 10);
+    }
+    if (num_sizes == 0) {
+        num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        for (i=0; i<num_sizes; i++) sizes[i] = default_sizes[i];
+    }
+
+    for (i=0; i<num_sizes; i++) {
+        bench_sort(sizes[i]);
+    }
+    for (i=0; i<num_sizes; i++) {
+        for (k=4; k<=1024; k*=4) {
+            bench_merge(sizes[i], k);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/* MQBENCH.C: Scaling benchmark for the concurrent priority queue.
+
+   Keeps a queue of a fixed size while every thread repeatedly pops an element
+   and pushes it back with a later key, the way the workers of a discrete
+   event simulation would.  Runs one heap behind one global mutex, a strict
+   MultiQueue and a relaxed MultiQueue, each with 1 up to 64 threads.  The
+   largest thread count can be given on the command line, eg. "./mqbench 16". */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "./heap.h"
+#include "./multiqueue.h"
+
+#define QUEUE_SIZE 100000
+#define TOTAL_OPS 4000000
+
+enum bench_kind { GLOBAL_MUTEX, STRICT, RELAXED };
+
+struct bench_shared {
+    enum bench_kind kind;
+    Heap *heap;
+    pthread_mutex_t heap_lock;
+    MultiQueue *queue;
+    size_t ops_per_thread;
+};
+
+struct bench_thread {
+    pthread_t thread;
+    struct bench_shared *shared;
+    unsigned int rng_state;
+};
+
+/* xorshift32, seeded differently for each thread. */
+static int next_step(struct bench_thread *self) {
+    self->rng_state ^= self->rng_state << 13;
+    self->rng_state ^= self->rng_state >> 17;
+    self->rng_state ^= self->rng_state << 5;
+    return (int) (self->rng_state & 0xfff) + 1;
+}
+
+static void *bench_worker(void *arg) {
+    struct bench_thread *self;
+    struct bench_shared *shared;
+    void *data;
+    int key;
+    size_t i;
+
+    self = arg;
+    shared = self->shared;
+    for (i=0; i<shared->ops_per_thread; i++) {
+        if (shared->kind == GLOBAL_MUTEX) {
+            pthread_mutex_lock(&shared->heap_lock);
+            heap_pop_with_key(shared->heap, &data, &key);
+            heap_push(shared->heap, data, key + next_step(self));
+            pthread_mutex_unlock(&shared->heap_lock);
+        } else {
+            if (multiqueue_pop(shared->queue, &data, &key) != 0) continue;
+            multiqueue_push(shared->queue, data, key + next_step(self));
+        }
+    }
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_run(enum bench_kind kind, unsigned int threads) {
+    static const char *names[] = { "global mutex", "strict", "relaxed" };
+    struct bench_shared shared;
+    struct bench_thread *workers;
+    double start;
+    double elapsed;
+    unsigned int i;
+
+    shared.kind = kind;
+    shared.heap = NULL;
+    shared.queue = NULL;
+    shared.ops_per_thread = TOTAL_OPS / threads;
+    if (kind == GLOBAL_MUTEX) {
+        shared.heap = create_heap(QUEUE_SIZE);
+        pthread_mutex_init(&shared.heap_lock, NULL);
+        for (i=0; i<QUEUE_SIZE; i++) heap_push(shared.heap, NULL, i);
+    } else {
+        shared.queue = create_multiqueue(threads, 0, kind == STRICT ? MULTIQUEUE_STRICT : MULTIQUEUE_RELAXED);
+        for (i=0; i<QUEUE_SIZE; i++) multiqueue_push(shared.queue, NULL, i);
+    }
+
+    workers = malloc(sizeof(struct bench_thread) * threads);
+    start = now_seconds();
+    for (i=0; i<threads; i++) {
+        workers[i].shared = &shared;
+        workers[i].rng_state = 2463534242u + i * 0x9e3779b9u;
+        pthread_create(&workers[i].thread, NULL, bench_worker, &workers[i]);
+    }
+    for (i=0; i<threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    elapsed = now_seconds() - start;
+
+    printf("%-12s threads=%-3u %8.2f Mops/s\n", names[kind], threads,
+           shared.ops_per_thread * threads / elapsed / 1e6);
+    free(workers);
+    if (kind == GLOBAL_MUTEX) {
+        pthread_mutex_destroy(&shared.heap_lock);
+        destroy_heap(shared.heap, NULL);
+    } else {
+        destroy_multiqueue(shared.queue, NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned int max_threads;
+    unsigned int threads;
+    int kind;
+
+    max_threads = 64;
+    if (argc > 1) max_threads = (unsigned int) strtoul(argv[1], NULL, 10);
+
+    for (kind=GLOBAL_MUTEX; kind<=RELAXED; kind++) {
+        for (threads=1; threads<=max_threads; threads*=2) {
+            bench_run((enum bench_kind) kind, threads);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include "heap.h"
+#include "multiqueue.h"
+
+/* The top key recorded for an empty shard.  It is wider than an int so that
+   it sorts after every real key, INT_MAX included. */
+#define MQ_EMPTY LLONG_MAX
+
+/* The initial size of each shard's heap. */
+#define MQ_SHARD_INIT_SIZE 64
+
+struct __mqshard {
+    pthread_mutex_t lock;
+    Heap *heap;
+    long long top;         /* Lowest key in the heap, or MQ_EMPTY.  Written
+                              under the lock, read by pops without it. */
+};
+
+/* Each shard gets its own cache lines, so that locking one shard does not
+   take the line holding its neighbour's lock away from another core. */
+union __mqslot {
+    struct __mqshard shard;
+    unsigned char pad[(sizeof(struct __mqshard) + HEAP_CACHE_LINE - 1) / HEAP_CACHE_LINE * HEAP_CACHE_LINE];
+};
+
+struct multiqueue {
+    union __mqslot *slots;
+    size_t num_shards;
+    size_t size;           /* Elements in all shards; changed under a shard lock. */
+    int mode;
+};
+
+/* Every thread picks shards with its own xorshift32 generator, so that
+   threads do not share a cache line just to draw a random number. */
+static __thread unsigned int mq_rng_state;
+static unsigned int mq_rng_seed = 0x9e3779b9u;
+
+/* Internal functions */
+
+unsigned int mq_random(void) {
+    unsigned int x;
+
+    x = mq_rng_state;
+    if (x == 0) {
+        x = __atomic_add_fetch(&mq_rng_seed, 0x9e3779b9u, __ATOMIC_RELAXED);
+        x ^= (unsigned int) (uintptr_t) &mq_rng_state;
+        if (x == 0) x = 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    mq_rng_state = x;
+    return x;
+}
+
+/* Returns a random shard, without the modulo's division. */
+struct __mqshard *random_shard(MultiQueue *queue) {
+    size_t i;
+
+    i = (size_t) (((unsigned long long) mq_random() * queue->num_shards) >> 32);
+    return &(queue->slots)[i].shard;
+}
+
+long long load_shard_top(struct __mqshard *shard) {
+    return __atomic_load_n(&shard->top, __ATOMIC_RELAXED);
+}
+
+/* Records the lowest key of a shard for pops to look at.  The shard must be
+   locked. */
+void update_shard_top(struct __mqshard *shard) {
+    long long top;
+    int key;
+
+    top = MQ_EMPTY;
+    if (heap_peek_with_key(shard->heap, NULL, &key) == 0) top = key;
+    __atomic_store_n(&shard->top, top, __ATOMIC_RELAXED);
+}
+
+/* Locks and returns a random shard.  A shard that is already locked is
+   skipped rather than waited for, unless there is only the one. */
+struct __mqshard *lock_random_shard(MultiQueue *queue) {
+    struct __mqshard *shard;
+
+    if (queue->num_shards == 1) {
+        shard = &(queue->slots)[0].shard;
+        pthread_mutex_lock(&shard->lock);
+        return shard;
+    }
+    for (;;) {
+        shard = random_shard(queue);
+        if (pthread_mutex_trylock(&shard->lock) == 0) return shard;
+    }
+}
+
+/* Locks and returns the shard holding the lower top key of two random
+   shards, or returns NULL if the queue is empty. */
+struct __mqshard *lock_low_shard(MultiQueue *queue) {
+    struct __mqshard *shard;
+    struct __mqshard *other;
+
+    if (queue->num_shards == 1) {
+        shard = &(queue->slots)[0].shard;
+        pthread_mutex_lock(&shard->lock);
+        if (heap_get_size(shard->heap) > 0) return shard;
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+    for (;;) {
+        if (__atomic_load_n(&queue->size, __ATOMIC_RELAXED) == 0) return NULL;
+        shard = random_shard(queue);
+        other = random_shard(queue);
+        if (load_shard_top(other) < load_shard_top(shard)) shard = other;
+        if (load_shard_top(shard) == MQ_EMPTY) continue;
+        if (pthread_mutex_trylock(&shard->lock) != 0) continue;
+        /* The shard may have been emptied since its top was read. */
+        if (heap_get_size(shard->heap) > 0) return shard;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/* External functions */
+
+MultiQueue *create_multiqueue(unsigned int threads, unsigned int shards_per_thread, int mode) {
+    MultiQueue *new;
+    size_t num_shards;
+    size_t i;
+    void *block;
+
+    if (threads < 1) return NULL;
+    if (mode != MULTIQUEUE_RELAXED && mode != MULTIQUEUE_STRICT) return NULL;
+    if (shards_per_thread == 0) shards_per_thread = MULTIQUEUE_DEFAULT_SHARDS;
+    num_shards = (size_t) threads * shards_per_thread;
+    if (mode == MULTIQUEUE_STRICT) num_shards = 1;
+    if (num_shards > SIZE_MAX / sizeof(union __mqslot)) return NULL;
+
+    new = malloc(sizeof(MultiQueue));
+    if (new == NULL) return NULL;
+    if (posix_memalign(&block, HEAP_CACHE_LINE, sizeof(union __mqslot) * num_shards) != 0) {
+        free(new);
+        return NULL;
+    }
+    new->slots = block;
+    new->num_shards = num_shards;
+    new->size = 0;
+    new->mode = mode;
+
+    for (i=0; i<num_shards; i++) {
+        (new->slots)[i].shard.heap = create_heap(MQ_SHARD_INIT_SIZE);
+        (new->slots)[i].shard.top = MQ_EMPTY;
+        if ((new->slots)[i].shard.heap == NULL
+            || pthread_mutex_init(&(new->slots)[i].shard.lock, NULL) != 0) {
+            destroy_heap((new->slots)[i].shard.heap, NULL);
+            new->num_shards = i;
+            destroy_multiqueue(new, NULL);
+            return NULL;
+        }
+    }
+
+    return new;
+}
+
+void destroy_multiqueue(MultiQueue *queue, void (*__dest_func) (void*)) {
+    size_t i;
+
+    if (queue == NULL) return;
+    for (i=0; i<queue->num_shards; i++) {
+        pthread_mutex_destroy(&(queue->slots)[i].shard.lock);
+        destroy_heap((queue->slots)[i].shard.heap, __dest_func);
+    }
+    free(queue->slots);
+    free(queue);
+}
+
+int multiqueue_push(MultiQueue *queue, void *data, int key) {
+    struct __mqshard *shard;
+    int status;
+
+    if (queue == NULL) return -1;
+
+    shard = lock_random_shard(queue);
+    status = 1;
+    if (heap_push(shard->heap, data, key) != NULL) {
+        status = 0;
+        if (key < shard->top) __atomic_store_n(&shard->top, (long long) key, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&queue->size, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return status;
+}
+
+int multiqueue_pop(MultiQueue *queue, void **data, int *key) {
+    struct __mqshard *shard;
+
+    if (queue == NULL) return -1;
+
+    shard = lock_low_shard(queue);
+    if (shard == NULL) return 1;
+    heap_pop_with_key(shard->heap, data, key);
+    update_shard_top(shard);
+    __atomic_sub_fetch(&queue->size, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+size_t multiqueue_get_size(MultiQueue *queue) {
+    if (queue == NULL) return 0;
+    return __atomic_load_n(&queue->size, __ATOMIC_RELAXED);
+}
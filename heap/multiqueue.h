@@ -0,0 +1,75 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+#ifndef __MSAUND05_MULTIQUEUEH
+#define __MSAUND05_MULTIQUEUEH
+
+#include <stddef.h>
+
+typedef struct multiqueue MultiQueue;
+
+/* A priority queue that many threads can push to and pop from at once.  It
+   is spread over several heaps, or shards, each behind its own lock.  A push
+   goes to a random shard.  A pop looks at the lowest key of two random
+   shards and takes the lower of the two.  A thread that finds a shard locked
+   tries another one instead of waiting, so threads rarely block each other.
+
+   The price is that ordering is relaxed: a pop returns one of the lowest keys
+   in the queue, though not always the lowest.  On average the key it returns
+   ranks within a small multiple of the number of shards.  Callers that need
+   exact ordering can create the queue in strict mode, which keeps a single
+   heap behind a single lock. */
+
+/* Whether pops return exactly the lowest key. */
+#define MULTIQUEUE_RELAXED 0
+#define MULTIQUEUE_STRICT  1
+
+/* The number of shards per thread used when create_multiqueue() is given 0. */
+#define MULTIQUEUE_DEFAULT_SHARDS 2
+
+/* Creates a queue for use by up to threads threads, with shards_per_thread
+   heaps for each (or MULTIQUEUE_DEFAULT_SHARDS if it is 0).  More shards mean
+   less contention but looser ordering.  mode is MULTIQUEUE_RELAXED or
+   MULTIQUEUE_STRICT; a strict queue has one shard whatever the other
+   arguments say.  Returns NULL if the memory could not be allocated or the
+   arguments are invalid.  The queue must be freed with destroy_multiqueue(). */
+MultiQueue *create_multiqueue(unsigned int threads, unsigned int shards_per_thread, int mode);
+
+/* Destroys a queue and all the data it contains, passing each data pointer
+   to __dest_func unless it is NULL.  No other thread may be using the queue. */
+void destroy_multiqueue(MultiQueue *queue, void (*__dest_func) (void*));
+
+/* Adds a data and key pair to the queue.  Returns 0 on success, 1 if the
+   memory could not be allocated, or -1 if the queue is invalid. */
+int multiqueue_push(MultiQueue *queue, void *data, int key);
+
+/* Removes one of the lowest keys from the queue (the lowest, in strict mode)
+   and stores its data and key in whichever of data and key are not NULL.
+   Returns 0 on success, 1 if the queue is empty, or -1 if the queue is
+   invalid.  Like heap_pop_with_key(), it does not use LAST_KEY. */
+int multiqueue_pop(MultiQueue *queue, void **data, int *key);
+
+/* Returns the number of elements in the queue.  While other threads are
+   pushing and popping, this is only a snapshot. */
+size_t multiqueue_get_size(MultiQueue *queue);
+
+#endif
@@ -0,0 +1,161 @@
+/* SQBENCH.C: Producer/consumer throughput benchmark for the staged queue.
+
+   Producer threads push random keys as fast as they can while one consumer
+   thread pops them, the way a scheduler's submitters and dispatcher would.
+   Runs a heap behind one mutex, then a StagedQueue, each with 1 up to 8
+   producers.  Threads that find nothing to do yield the CPU rather than
+   spin, so the results mean something on machines with few cores.  The
+   largest producer count can be given on the command line,
+   eg. "./sqbench 4". */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "./heap.h"
+#include "./stagedqueue.h"
+
+#define TOTAL_ITEMS 10000000
+
+enum bench_kind { MUTEX, STAGED };
+
+struct bench_shared {
+    enum bench_kind kind;
+    Heap *heap;
+    pthread_mutex_t heap_lock;
+    StagedQueue *queue;
+    size_t items_per_producer;
+    size_t total;
+};
+
+struct bench_thread {
+    pthread_t thread;
+    struct bench_shared *shared;
+    unsigned int rng_state;
+};
+
+/* xorshift32, seeded differently for each thread. */
+static int next_key(struct bench_thread *self) {
+    self->rng_state ^= self->rng_state << 13;
+    self->rng_state ^= self->rng_state >> 17;
+    self->rng_state ^= self->rng_state << 5;
+    return (int) (self->rng_state & 0x7fffffff);
+}
+
+static void *bench_producer(void *arg) {
+    struct bench_thread *self;
+    struct bench_shared *shared;
+    int key;
+    size_t i;
+
+    self = arg;
+    shared = self->shared;
+    for (i=0; i<shared->items_per_producer; i++) {
+        key = next_key(self);
+        if (shared->kind == MUTEX) {
+            pthread_mutex_lock(&shared->heap_lock);
+            heap_push(shared->heap, NULL, key);
+            pthread_mutex_unlock(&shared->heap_lock);
+        } else {
+            /* A full ring waits on the consumer; let it run. */
+            while (stagedqueue_push(shared->queue, NULL, key) != 0) sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *bench_consumer(void *arg) {
+    struct bench_shared *shared;
+    size_t popped;
+    int status;
+
+    shared = arg;
+    popped = 0;
+    while (popped < shared->total) {
+        if (shared->kind == MUTEX) {
+            pthread_mutex_lock(&shared->heap_lock);
+            status = heap_pop_with_key(shared->heap, NULL, NULL);
+            pthread_mutex_unlock(&shared->heap_lock);
+        } else {
+            status = stagedqueue_pop(shared->queue, NULL, NULL);
+        }
+        if (status == 0) {
+            popped++;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_run(enum bench_kind kind, unsigned int producers) {
+    static const char *names[] = { "mutex", "staged" };
+    struct bench_shared shared;
+    struct bench_thread *workers;
+    pthread_t consumer;
+    double start;
+    double elapsed;
+    unsigned int i;
+
+    shared.kind = kind;
+    shared.heap = NULL;
+    shared.queue = NULL;
+    shared.items_per_producer = TOTAL_ITEMS / producers;
+    shared.total = shared.items_per_producer * producers;
+    if (kind == MUTEX) {
+        shared.heap = create_heap(STAGEDQUEUE_DEFAULT_RING);
+        pthread_mutex_init(&shared.heap_lock, NULL);
+    } else {
+        shared.queue = create_stagedqueue(0, 0);
+    }
+
+    workers = malloc(sizeof(struct bench_thread) * producers);
+    start = now_seconds();
+    pthread_create(&consumer, NULL, bench_consumer, &shared);
+    for (i=0; i<producers; i++) {
+        workers[i].shared = &shared;
+        workers[i].rng_state = 2463534242u + i * 0x9e3779b9u;
+        pthread_create(&workers[i].thread, NULL, bench_producer, &workers[i]);
+    }
+    for (i=0; i<producers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_join(consumer, NULL);
+    elapsed = now_seconds() - start;
+
+    printf("%-7s producers=%-2u %8.2f Mitems/s\n", names[kind], producers,
+           shared.total / elapsed / 1e6);
+    free(workers);
+    if (kind == MUTEX) {
+        pthread_mutex_destroy(&shared.heap_lock);
+        destroy_heap(shared.heap, NULL);
+    } else {
+        destroy_stagedqueue(shared.queue, NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned int max_producers;
+    unsigned int producers;
+    int kind;
+
+    max_producers = 8;
+    if (argc > 1) max_producers = (unsigned int) strtoul(argv[1], NULL, 10);
+
+    for (kind=MUTEX; kind<=STAGED; kind++) {
+        for (producers=1; producers<=max_producers; producers*=2) {
+            bench_run((enum bench_kind) kind, producers);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "heap.h"
+#include "stagedqueue.h"
+
+#define STAGEDQUEUE_NO_ROOM ((size_t) -1)
+
+/* The ring is a bounded multi-producer queue in which every slot carries a
+   sequence number.  A slot whose sequence equals a producer's ticket is free
+   for that ticket; once written, its sequence becomes ticket + 1, which is
+   what the consumer waits for; once read, it becomes ticket + ring_size,
+   freeing it for the producer one lap later.  Producers only contend on the
+   tail counter, and never on a slot. */
+struct __stageslot {
+    size_t sequence;
+    int key;
+    void *data;
+};
+
+struct stagedqueue {
+    /* Written by producers. */
+    size_t tail;
+    unsigned char tail_pad[HEAP_CACHE_LINE - sizeof(size_t)];
+    /* Written by the consumer. */
+    size_t head;
+    unsigned char head_pad[HEAP_CACHE_LINE - sizeof(size_t)];
+    struct __stageslot *slots;
+    size_t mask;           /* Ring size - 1. */
+    size_t batch;
+    Heap *heap;
+    size_t capacity;       /* Elements the heap has room for. */
+    int *keys;             /* Chunk being moved into the heap. */
+    void **data;
+};
+
+/* Internal functions */
+
+/* Copies up to queue->batch written slots, and no more than max, into the
+   chunk arrays and frees them for producers.  Returns the number copied. */
+size_t take_stageslots(StagedQueue *queue, size_t max) {
+    struct __stageslot *slot;
+    size_t head;
+    size_t n;
+
+    if (max > queue->batch) max = queue->batch;
+    head = queue->head;
+    for (n=0; n<max; n++) {
+        slot = &(queue->slots)[head & queue->mask];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != head + 1) break;
+        (queue->keys)[n] = slot->key;
+        (queue->data)[n] = slot->data;
+        __atomic_store_n(&slot->sequence, head + queue->mask + 1, __ATOMIC_RELEASE);
+        head++;
+    }
+    queue->head = head;
+    return n;
+}
+
+/* Moves what is in the ring into the heap, chunk by chunk, stopping after
+   one lap of the ring so that fast producers cannot keep the consumer here.
+   The heap is first given room for a full lap, so the moves themselves never
+   allocate.  Returns the number moved, or STAGEDQUEUE_NO_ROOM, taking nothing
+   from the ring, if the heap could not grow. */
+size_t drain_stageslots(StagedQueue *queue) {
+    size_t size;
+    size_t lap;
+    size_t capacity;
+    size_t moved;
+    size_t n;
+
+    size = heap_get_size(queue->heap);
+    lap = queue->mask + 1;
+    if (size > SIZE_MAX - lap) return STAGEDQUEUE_NO_ROOM;
+    if (size + lap > queue->capacity) {
+        /* Grow geometrically, as the heap itself would. */
+        capacity = queue->capacity <= SIZE_MAX / 2 ? queue->capacity * 2 : SIZE_MAX;
+        if (capacity < size + lap) capacity = size + lap;
+        if (heap_reserve(queue->heap, capacity) != 0) return STAGEDQUEUE_NO_ROOM;
+        queue->capacity = capacity;
+    }
+
+    for (moved = 0; moved < lap; moved = moved + n) {
+        n = take_stageslots(queue, lap - moved);
+        if (n == 0) break;
+        heap_push_batch(queue->heap, queue->keys, queue->data, n);
+    }
+    return moved;
+}
+
+/* External functions */
+
+StagedQueue *create_stagedqueue(size_t ring_size, size_t batch) {
+    StagedQueue *new;
+    void *block;
+    size_t size;
+    size_t i;
+
+    if (ring_size == 0) ring_size = STAGEDQUEUE_DEFAULT_RING;
+    if (batch == 0) batch = STAGEDQUEUE_DEFAULT_BATCH;
+    for (size = 2; size < ring_size; size *= 2) {
+        if (size > SIZE_MAX / 2 / sizeof(struct __stageslot)) return NULL;
+    }
+    if (batch > size) batch = size;
+
+    if (posix_memalign(&block, HEAP_CACHE_LINE, sizeof(StagedQueue)) != 0) return NULL;
+    new = block;
+    new->slots = malloc(sizeof(struct __stageslot) * size);
+    new->keys = malloc(sizeof(int) * batch);
+    new->data = malloc(sizeof(void*) * batch);
+    new->heap = create_heap(size);
+    if (new->slots == NULL || new->keys == NULL || new->data == NULL || new->heap == NULL) {
+        free(new->slots);
+        free(new->keys);
+        free(new->data);
+        destroy_heap(new->heap, NULL);
+        free(new);
+        return NULL;
+    }
+    for (i=0; i<size; i++) {
+        (new->slots)[i].sequence = i;
+    }
+    new->tail = new->head = 0;
+    new->mask = size - 1;
+    new->batch = batch;
+    new->capacity = size;
+    return new;
+}
+
+void destroy_stagedqueue(StagedQueue *queue, void (*__dest_func) (void*)) {
+    struct __stageslot *slot;
+
+    if (queue == NULL) return;
+    if (__dest_func != NULL) {
+        for (;;) {
+            slot = &(queue->slots)[queue->head & queue->mask];
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != queue->head + 1) break;
+            __dest_func(slot->data);
+            queue->head++;
+        }
+    }
+    destroy_heap(queue->heap, __dest_func);
+    free(queue->slots);
+    free(queue->keys);
+    free(queue->data);
+    free(queue);
+}
+
+int stagedqueue_push(StagedQueue *queue, void *data, int key) {
+    struct __stageslot *slot;
+    size_t tail;
+    size_t sequence;
+
+    if (queue == NULL) return -1;
+
+    tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &(queue->slots)[tail & queue->mask];
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == tail) {
+            /* The slot is free for this ticket; claim it.  A failed exchange
+               reloads tail with the ticket another producer left. */
+            if (__atomic_compare_exchange_n(&queue->tail, &tail, tail + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if ((ptrdiff_t) (sequence - tail) < 0) {
+            return 1; /* The consumer has not read this slot from the last lap. */
+        } else {
+            tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->key = key;
+    slot->data = data;
+    __atomic_store_n(&slot->sequence, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int stagedqueue_pop(StagedQueue *queue, void **data, int *key) {
+    if (queue == NULL) return -1;
+
+    drain_stageslots(queue);
+    return heap_pop_with_key(queue->heap, data, key) == 0 ? 0 : 1;
+}
+
+size_t stagedqueue_drain(StagedQueue *queue) {
+    size_t moved;
+
+    if (queue == NULL) return 0;
+    moved = drain_stageslots(queue);
+    return moved == STAGEDQUEUE_NO_ROOM ? 0 : moved;
+}
+
+size_t stagedqueue_get_size(StagedQueue *queue) {
+    size_t waiting;
+
+    if (queue == NULL) return 0;
+    waiting = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED) - queue->head;
+    return heap_get_size(queue->heap) + waiting;
+}
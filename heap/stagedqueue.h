@@ -0,0 +1,88 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+
+#ifndef __MSAUND05_STAGEDQUEUEH
+#define __MSAUND05_STAGEDQUEUEH
+
+#include <stddef.h>
+
+typedef struct stagedqueue StagedQueue;
+
+/* A priority queue for producers and a consumer on different threads.
+   Producers never take a lock: a push claims a slot in a bounded ring and
+   writes its key and data there.  Only the consumer touches the heap.  Each
+   pop first drains the ring into the heap, in chunks that heap_push_batch()
+   loads bottom-up or upheaps one by one, whichever is cheaper, and then pops
+   from the heap.  Any number of threads may push, but only one thread at a
+   time may pop, drain or get the size.
+
+   A pop returns the lowest key of everything pushed before the pop began,
+   exactly as a heap behind a mutex would, except that a push still in
+   progress on another thread holds back the pushes queued behind it in the
+   ring until a later pop.  With a single producer the order is exact.
+
+   A pushed element waits in the ring until the consumer next pops or
+   drains, so its latency is bounded by the consumer's polling interval, and
+   each pop does at most ring_size pushes of draining work before it pops.
+   When the ring is full, pushes fail until the consumer drains it, which
+   bounds memory and makes a slow consumer push back on producers. */
+
+/* The ring size and chunk size used when create_stagedqueue() is given 0. */
+#define STAGEDQUEUE_DEFAULT_RING 4096
+#define STAGEDQUEUE_DEFAULT_BATCH 256
+
+/* Creates an empty queue with a ring of ring_size slots, rounded up to a
+   power of two, that drains into its heap batch elements at a time (either
+   may be 0 for the default).  Returns NULL if the memory could not be
+   allocated.  The queue must be freed with destroy_stagedqueue(). */
+StagedQueue *create_stagedqueue(size_t ring_size, size_t batch);
+
+/* Destroys a queue and all the data it contains, in the ring or the heap,
+   passing each data pointer to __dest_func unless it is NULL.  No other
+   thread may be using the queue. */
+void destroy_stagedqueue(StagedQueue *queue, void (*__dest_func) (void*));
+
+/* Adds a data and key pair to the ring, from any thread, without locking.
+   Returns 0 on success, 1 if the ring is full, or -1 if the queue is
+   invalid. */
+int stagedqueue_push(StagedQueue *queue, void *data, int key);
+
+/* Consumer only.  Drains the ring, then removes the lowest key and stores its
+   data and key in whichever of data and key are not NULL.  Returns 0 on
+   success, 1 if the queue is empty, or -1 if the queue is invalid.  If the
+   heap cannot grow to take the ring, the ring is left as it is and the pop
+   comes from the heap alone. */
+int stagedqueue_pop(StagedQueue *queue, void **data, int *key);
+
+/* Consumer only.  Moves everything in the ring into the heap without
+   popping, so that a consumer with idle time can keep the ring empty.
+   Returns the number of elements moved, which is 0 if the heap could not
+   grow. */
+size_t stagedqueue_drain(StagedQueue *queue);
+
+/* Consumer only.  Returns the number of elements in the heap and the ring,
+   or 0 if the queue is invalid.  Pushes in progress may or may not be
+   counted. */
+size_t stagedqueue_get_size(StagedQueue *queue);
+
+#endif
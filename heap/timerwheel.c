@@ -0,0 +1,384 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+/* Ticks are handled as unsigned numbers with the sign bit flipped, which
+   sorts them the same way as ints.  A timer is kept on the level numbered by
+   the highest group of TIMERWHEEL_BITS bits in which its tick differs from
+   the clock, in the slot given by its own bits in that group; a timer whose
+   tick differs above the top level waits in the overflow heap.  So every
+   timer on level l is due in the same level l+1 slot as the clock, and on
+   levels above 0 its slot comes after the clock's.  A timer pushed with a
+   tick before the clock's also waits in the overflow heap, so that the
+   overdue timers come out in key order ahead of the ones at the clock's tick.
+
+   timerwheel_advance() jumps the clock to the next tick at which something
+   happens: the tick of the next occupied slot on level 0, the start of the
+   next occupied slot on a higher level, whose timers then move down, or the
+   start of the next span of the overflow heap, whose timers then move onto
+   the wheel.  Empty slots are skipped by scanning a bitmap per level. */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include "heap.h"
+#include "timerwheel.h"
+
+#define TW_BIAS 0x80000000u
+#define TW_SLOTS (1u << TIMERWHEEL_BITS)
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+
+/* Where an entry is, besides a slot number: waiting in the overflow heap,
+   or on the free list.  TW_OVERDUE is never an entry's; tw_next_event()
+   gives it when the top of the overflow heap is already due. */
+#define TW_IN_HEAP ((unsigned int) -1)
+#define TW_FREE ((unsigned int) -2)
+#define TW_OVERDUE ((unsigned int) -3)
+
+/* The initial number of entries, and the initial size of the heap. */
+#define TW_INIT_SIZE 64
+
+#define TW_NO_ENTRY ((size_t) -1)
+
+struct __timerentry {
+    unsigned int tick;     /* The key, biased to unsigned. */
+    unsigned int slot;     /* level * TW_SLOTS + slot, TW_IN_HEAP or TW_FREE. */
+    void *data;
+    size_t next;           /* Next entry in the slot; next free entry. */
+    size_t prev;           /* Previous entry in the slot, or TW_NO_ENTRY. */
+    heap_handle handle;    /* The entry's handle in the heap, if it is there. */
+};
+
+struct timerwheel {
+    struct __timerentry *entries;
+    size_t entry_count;    /* Entries ever given out. */
+    size_t entry_alloc;
+    size_t free_entry;     /* Head of the list of free entries. */
+    size_t size;
+    unsigned int now;      /* The clock, biased to unsigned. */
+    uint64_t occupied[TIMERWHEEL_LEVELS]; /* Bit s is set if slot s is not empty. */
+    size_t slots[TIMERWHEEL_LEVELS * TW_SLOTS]; /* First entry of each slot. */
+    Heap *overflow;        /* Entries past the top level or overdue, keyed by
+                              tick; their data is their index in entries. */
+};
+
+/* Internal functions */
+
+unsigned int tw_lowest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_ctzll(bits);
+#else
+    unsigned int bit;
+
+    for (bit = 0; (bits & 1) == 0; bits >>= 1) bit++;
+    return bit;
+#endif
+}
+
+/* Returns the level a tick belongs on while the clock reads now, or
+   TIMERWHEEL_LEVELS if it belongs in the overflow heap.  The tick must not be
+   before now. */
+unsigned int tw_level(unsigned int tick, unsigned int now) {
+    unsigned int diff;
+    unsigned int level;
+
+    diff = (tick ^ now) >> TIMERWHEEL_BITS;
+    for (level = 0; diff != 0 && level < TIMERWHEEL_LEVELS; level++) {
+        diff >>= TIMERWHEEL_BITS;
+    }
+    return level;
+}
+
+/* Links an entry into the slot or heap its tick belongs in.  Returns 1 if
+   the heap could not grow. */
+int tw_place(TimerWheel *wheel, size_t index) {
+    struct __timerentry *entry;
+    unsigned int level;
+    unsigned int slot;
+
+    entry = &(wheel->entries)[index];
+    level = entry->tick < wheel->now ? TIMERWHEEL_LEVELS : tw_level(entry->tick, wheel->now);
+    if (level == TIMERWHEEL_LEVELS) {
+        entry->handle = heap_push_tracked(wheel->overflow, (void*) (uintptr_t) index, (int) (entry->tick ^ TW_BIAS));
+        if (entry->handle == HEAP_NO_HANDLE) return 1;
+        entry->slot = TW_IN_HEAP;
+        return 0;
+    }
+
+    slot = (entry->tick >> (level * TIMERWHEEL_BITS)) & TW_SLOT_MASK;
+    entry->slot = level * TW_SLOTS + slot;
+    entry->prev = TW_NO_ENTRY;
+    entry->next = (wheel->slots)[entry->slot];
+    if (entry->next != TW_NO_ENTRY) (wheel->entries)[entry->next].prev = index;
+    (wheel->slots)[entry->slot] = index;
+    (wheel->occupied)[level] |= (uint64_t) 1 << slot;
+    return 0;
+}
+
+/* Unlinks an entry from its slot or the heap. */
+void tw_unplace(TimerWheel *wheel, size_t index) {
+    struct __timerentry *entry;
+
+    entry = &(wheel->entries)[index];
+    if (entry->slot == TW_IN_HEAP) {
+        heap_remove(wheel->overflow, entry->handle);
+        return;
+    }
+    if (entry->prev != TW_NO_ENTRY) {
+        (wheel->entries)[entry->prev].next = entry->next;
+    } else {
+        (wheel->slots)[entry->slot] = entry->next;
+        if (entry->next == TW_NO_ENTRY) {
+            (wheel->occupied)[entry->slot / TW_SLOTS] &= ~((uint64_t) 1 << (entry->slot & TW_SLOT_MASK));
+        }
+    }
+    if (entry->next != TW_NO_ENTRY) (wheel->entries)[entry->next].prev = entry->prev;
+}
+
+void tw_free_entry(TimerWheel *wheel, size_t index) {
+    (wheel->entries)[index].slot = TW_FREE;
+    (wheel->entries)[index].next = wheel->free_entry;
+    wheel->free_entry = index;
+}
+
+/* Takes an entry from the free list, or from the end of the array.  Returns
+   TW_NO_ENTRY if the array could not grow. */
+size_t tw_new_entry(TimerWheel *wheel) {
+    struct __timerentry *new_entries;
+    size_t new_alloc;
+    size_t index;
+
+    if (wheel->free_entry != TW_NO_ENTRY) {
+        index = wheel->free_entry;
+        wheel->free_entry = (wheel->entries)[index].next;
+        return index;
+    }
+    if (wheel->entry_count == wheel->entry_alloc) {
+        new_alloc = wheel->entry_alloc * 2;
+        if (new_alloc > SIZE_MAX / sizeof(struct __timerentry)) return TW_NO_ENTRY;
+        new_entries = realloc(wheel->entries, sizeof(struct __timerentry) * new_alloc);
+        if (new_entries == NULL) return TW_NO_ENTRY;
+        wheel->entries = new_entries;
+        wheel->entry_alloc = new_alloc;
+    }
+    return wheel->entry_count++;
+}
+
+/* Finds the next tick at which advancing has something to do, and the slot
+   (or TW_IN_HEAP, or TW_OVERDUE) that is due then.  Returns 0 if nothing is
+   pending. */
+int tw_next_event(TimerWheel *wheel, unsigned int *tick, unsigned int *slot) {
+    unsigned int level;
+    unsigned int shift;
+    unsigned int field;
+    unsigned int s;
+    uint64_t later;
+    int key;
+
+    /* Overdue timers are due before anything on the wheel. */
+    if (heap_peek_with_key(wheel->overflow, NULL, &key) == 0
+        && ((unsigned int) key ^ TW_BIAS) < wheel->now) {
+        *tick = wheel->now;
+        *slot = TW_OVERDUE;
+        return 1;
+    }
+
+    for (level = 0; level < TIMERWHEEL_LEVELS; level++) {
+        shift = level * TIMERWHEEL_BITS;
+        field = (wheel->now >> shift) & TW_SLOT_MASK;
+
+        /* Level 0 holds the timers due at the clock's own tick, too. */
+        if (level > 0) field++;
+        if (field == TW_SLOTS) continue;
+        later = (wheel->occupied)[level] >> field;
+        if (later == 0) continue;
+
+        s = field + tw_lowest_bit(later);
+        *tick = (wheel->now & ~((TW_SLOT_MASK << shift) | ((1u << shift) - 1))) | (s << shift);
+        *slot = level * TW_SLOTS + s;
+        return 1;
+    }
+
+    if (heap_peek_with_key(wheel->overflow, NULL, &key) != 0) return 0;
+    shift = TIMERWHEEL_LEVELS * TIMERWHEEL_BITS;
+    *tick = ((unsigned int) key ^ TW_BIAS) >> shift << shift;
+    *slot = TW_IN_HEAP;
+    return 1;
+}
+
+/* Moves every entry of a slot above level 0, or every overflow entry in the
+   clock's span, to where it belongs now that the clock has reached it.
+   Entries only move down onto lower levels, so placing them cannot fail. */
+void tw_cascade(TimerWheel *wheel, unsigned int slot) {
+    unsigned int shift;
+    size_t index;
+    size_t next;
+    void *data;
+    int key;
+
+    if (slot == TW_IN_HEAP) {
+        shift = TIMERWHEEL_LEVELS * TIMERWHEEL_BITS;
+        while (heap_peek_with_key(wheel->overflow, NULL, &key) == 0
+               && ((unsigned int) key ^ TW_BIAS) >> shift == wheel->now >> shift) {
+            heap_pop_with_key(wheel->overflow, &data, NULL);
+            tw_place(wheel, (size_t) (uintptr_t) data);
+        }
+        return;
+    }
+
+    index = (wheel->slots)[slot];
+    (wheel->slots)[slot] = TW_NO_ENTRY;
+    (wheel->occupied)[slot / TW_SLOTS] &= ~((uint64_t) 1 << (slot & TW_SLOT_MASK));
+    while (index != TW_NO_ENTRY) {
+        next = (wheel->entries)[index].next;
+        tw_place(wheel, index);
+        index = next;
+    }
+}
+
+/* Stores a due entry's key and data at position n of keys and data, and
+   frees the entry.  The entry must already be unlinked. */
+void tw_hand_out(TimerWheel *wheel, size_t index, int *keys, void **data, size_t n) {
+    if (keys != NULL) keys[n] = (int) ((wheel->entries)[index].tick ^ TW_BIAS);
+    if (data != NULL) data[n] = (wheel->entries)[index].data;
+    tw_free_entry(wheel, index);
+    wheel->size = wheel->size - 1;
+}
+
+/* External functions */
+
+TimerWheel *create_timerwheel(int now) {
+    TimerWheel *new;
+    size_t i;
+
+    new = malloc(sizeof(TimerWheel));
+    if (new == NULL) return NULL;
+    new->entries = malloc(sizeof(struct __timerentry) * TW_INIT_SIZE);
+    new->overflow = create_heap(TW_INIT_SIZE);
+    if (new->entries == NULL || new->overflow == NULL) {
+        free(new->entries);
+        destroy_heap(new->overflow, NULL);
+        free(new);
+        return NULL;
+    }
+    new->entry_count = 0;
+    new->entry_alloc = TW_INIT_SIZE;
+    new->free_entry = TW_NO_ENTRY;
+    new->size = 0;
+    new->now = (unsigned int) now ^ TW_BIAS;
+    for (i=0; i<TIMERWHEEL_LEVELS; i++) {
+        (new->occupied)[i] = 0;
+    }
+    for (i=0; i<TIMERWHEEL_LEVELS * TW_SLOTS; i++) {
+        (new->slots)[i] = TW_NO_ENTRY;
+    }
+    return new;
+}
+
+void destroy_timerwheel(TimerWheel *wheel, void (*__dest_func) (void*)) {
+    size_t i;
+
+    if (wheel == NULL) return;
+    if (__dest_func != NULL) {
+        for (i=0; i<wheel->entry_count; i++) {
+            if ((wheel->entries)[i].slot != TW_FREE) __dest_func((wheel->entries)[i].data);
+        }
+    }
+    destroy_heap(wheel->overflow, NULL);
+    free(wheel->entries);
+    free(wheel);
+}
+
+timer_handle timerwheel_push(TimerWheel *wheel, void *data, int key) {
+    size_t index;
+
+    if (wheel == NULL) return TIMER_NO_HANDLE;
+    index = tw_new_entry(wheel);
+    if (index == TW_NO_ENTRY) return TIMER_NO_HANDLE;
+
+    (wheel->entries)[index].tick = (unsigned int) key ^ TW_BIAS;
+    (wheel->entries)[index].data = data;
+    if (tw_place(wheel, index) != 0) {
+        tw_free_entry(wheel, index);
+        return TIMER_NO_HANDLE;
+    }
+    wheel->size = wheel->size + 1;
+    return index;
+}
+
+void *timerwheel_cancel(TimerWheel *wheel, timer_handle handle) {
+    void *data;
+
+    if (wheel == NULL) return NULL;
+    if (handle >= wheel->entry_count || (wheel->entries)[handle].slot == TW_FREE) return NULL;
+
+    data = (wheel->entries)[handle].data;
+    tw_unplace(wheel, handle);
+    tw_free_entry(wheel, handle);
+    wheel->size = wheel->size - 1;
+    return data;
+}
+
+size_t timerwheel_advance(TimerWheel *wheel, int now, int *keys, void **data, size_t max) {
+    unsigned int target;
+    unsigned int tick;
+    unsigned int slot;
+    size_t index;
+    void *overdue;
+    size_t n;
+
+    if (wheel == NULL) return 0;
+    target = (unsigned int) now ^ TW_BIAS;
+    if (target < wheel->now) target = wheel->now;
+
+    n = 0;
+    while (n < max) {
+        if (!tw_next_event(wheel, &tick, &slot) || tick > target) {
+            /* Nothing is due before target, so every timer still belongs
+               where it is with the clock moved there. */
+            wheel->now = target;
+            break;
+        }
+        wheel->now = tick;
+        if (slot == TW_OVERDUE) {
+            heap_pop_with_key(wheel->overflow, &overdue, NULL);
+            tw_hand_out(wheel, (size_t) (uintptr_t) overdue, keys, data, n);
+            n++;
+            continue;
+        }
+        if (slot >= TW_SLOTS) {
+            tw_cascade(wheel, slot);
+            continue;
+        }
+
+        while (n < max && (wheel->slots)[slot] != TW_NO_ENTRY) {
+            index = (wheel->slots)[slot];
+            tw_unplace(wheel, index);
+            tw_hand_out(wheel, index, keys, data, n);
+            n++;
+        }
+    }
+    return n;
+}
+
+size_t timerwheel_get_size(TimerWheel *wheel) {
+    if (wheel == NULL) return 0;
+    return wheel->size;
+}
@@ -0,0 +1,80 @@
+/* HEAP: a heap library in C. Copyright (C) 2016, 2017 Matthew Saunders.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+
+   To contact the author of this software, please e-mail:
+
+        msaund05@mail.uoguelph.ca
+*/
+
+
+#ifndef __MSAUND05_TIMERWHEELH
+#define __MSAUND05_TIMERWHEELH
+
+#include <stddef.h>
+
+typedef struct timerwheel TimerWheel;
+
+/* A handle to a pending timer, given out by timerwheel_push(). */
+typedef size_t timer_handle;
+
+#define TIMER_NO_HANDLE ((timer_handle) -1)
+
+/* A queue of timers, keyed by the int tick at which each one is due.  Timers
+   due within the next TIMERWHEEL_SPAN ticks sit in a hierarchical timing
+   wheel, where pushing and cancelling are O(1); later ones wait in a Heap
+   until the wheel reaches them.  Each timer moves down the wheel at most
+   TIMERWHEEL_LEVELS times before it is due, so the wheel suits many timers
+   that are cancelled before they fire far better than a heap does. */
+
+/* The wheel has TIMERWHEEL_LEVELS levels of 2^TIMERWHEEL_BITS slots. */
+#define TIMERWHEEL_BITS 6
+#define TIMERWHEEL_LEVELS 4
+#define TIMERWHEEL_SPAN (1L << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS))
+
+/* Creates an empty wheel whose clock reads now.  Returns NULL if the memory
+   could not be allocated.  The wheel must be freed with destroy_timerwheel(). */
+TimerWheel *create_timerwheel(int now);
+
+/* Destroys a wheel and all of its pending timers, passing each one's data to
+   __dest_func unless it is NULL. */
+void destroy_timerwheel(TimerWheel *wheel, void (*__dest_func) (void*));
+
+/* Adds a timer with the given data, due at tick key, in O(1) if it is due
+   within TIMERWHEEL_SPAN ticks, or in O(log n) if it is due later or before
+   the wheel's clock.  A timer due at or before the wheel's clock is returned
+   by the next timerwheel_advance(), in order with the other due timers.
+   Returns a handle for timerwheel_cancel(), or TIMER_NO_HANDLE if the memory
+   could not be allocated or the wheel is invalid. */
+timer_handle timerwheel_push(TimerWheel *wheel, void *data, int key);
+
+/* Removes a pending timer and returns its data, in O(1) for a timer on the
+   wheel.  The handle may be reused once its timer is cancelled or returned.
+   Returns NULL if the wheel or handle is invalid. */
+void *timerwheel_cancel(TimerWheel *wheel, timer_handle handle);
+
+/* Moves the wheel's clock forward to now, and returns the timers due by then
+   in order of their keys, storing up to max of their keys and data in keys
+   and data, either of which may be NULL.  Timers due at the same tick come
+   out in no particular order.  Returns the number of timers stored; if it is
+   max, more may be due, and the next call with the same now returns them.
+   The clock never goes backwards: an earlier now only returns the timers
+   already due. */
+size_t timerwheel_advance(TimerWheel *wheel, int now, int *keys, void **data, size_t max);
+
+/* Returns the number of pending timers, or 0 if the wheel is invalid. */
+size_t timerwheel_get_size(TimerWheel *wheel);
+
+#endif
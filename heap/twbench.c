@@ -0,0 +1,140 @@
+/* TWBENCH.C: Benchmark for the timer wheel against a plain heap.
+
+   Keeps n pending timeouts, each due up to 2n ticks ahead.  Every operation
+   cancels a random pending timeout and arms a new one, and every TICK_OPS
+   operations the clock moves on a tick and the timeouts due by then fire, so
+   most timeouts are cancelled long before they fire, the way a server's
+   connection timers behave.  The number of pending timeouts can be given
+   on the command line, eg. "./twbench 1000 1000000". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "./heap.h"
+#include "./timerwheel.h"
+
+#define TOTAL_OPS 5000000
+#define TICK_OPS 8
+
+static unsigned int rng_state = 2463534242u;
+
+/* xorshift32, so every run sees the same sequence. */
+static unsigned int next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double seconds_since(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each timer's data is its index in pending, so a fired or cancelled timer's
+   place can be given to a new one. */
+static void bench_heap(size_t n) {
+    Heap *heap;
+    heap_handle *pending;
+    clock_t start;
+    void *data;
+    int key;
+    int now;
+    size_t fired;
+    size_t i;
+    size_t j;
+
+    heap = create_heap(n);
+    pending = malloc(sizeof(heap_handle) * n);
+    now = 0;
+    for (i=0; i<n; i++) {
+        pending[i] = heap_push_tracked(heap, (void*) i, now + 1 + next_random() % (2 * n));
+    }
+
+    fired = 0;
+    start = clock();
+    for (i=0; i<TOTAL_OPS; i++) {
+        j = next_random() % n;
+        heap_remove(heap, pending[j]);
+        pending[j] = heap_push_tracked(heap, (void*) j, now + 1 + next_random() % (2 * n));
+        if (i % TICK_OPS != 0) continue;
+
+        now++;
+        while (heap_peek_with_key(heap, &data, &key) == 0 && key <= now) {
+            heap_pop(heap);
+            j = (size_t) data;
+            pending[j] = heap_push_tracked(heap, (void*) j, now + 1 + next_random() % (2 * n));
+            fired++;
+        }
+    }
+
+    printf("heap        n=%-9lu %8.2f ns/op   fired %lu\n", (unsigned long) n,
+           seconds_since(start) * 1e9 / TOTAL_OPS, (unsigned long) fired);
+    free(pending);
+    destroy_heap(heap, NULL);
+}
+
+static void bench_wheel(size_t n) {
+    TimerWheel *wheel;
+    timer_handle *pending;
+    void *expired[64];
+    clock_t start;
+    int now;
+    size_t fired;
+    size_t count;
+    size_t i;
+    size_t j;
+    size_t k;
+
+    wheel = create_timerwheel(0);
+    pending = malloc(sizeof(timer_handle) * n);
+    now = 0;
+    for (i=0; i<n; i++) {
+        pending[i] = timerwheel_push(wheel, (void*) i, now + 1 + next_random() % (2 * n));
+    }
+
+    fired = 0;
+    start = clock();
+    for (i=0; i<TOTAL_OPS; i++) {
+        j = next_random() % n;
+        timerwheel_cancel(wheel, pending[j]);
+        pending[j] = timerwheel_push(wheel, (void*) j, now + 1 + next_random() % (2 * n));
+        if (i % TICK_OPS != 0) continue;
+
+        now++;
+        do {
+            count = timerwheel_advance(wheel, now, NULL, expired, 64);
+            for (k=0; k<count; k++) {
+                j = (size_t) expired[k];
+                pending[j] = timerwheel_push(wheel, (void*) j, now + 1 + next_random() % (2 * n));
+            }
+            fired += count;
+        } while (count == 64);
+    }
+
+    printf("timer wheel n=%-9lu %8.2f ns/op   fired %lu\n", (unsigned long) n,
+           seconds_since(start) * 1e9 / TOTAL_OPS, (unsigned long) fired);
+    free(pending);
+    destroy_timerwheel(wheel, NULL);
+}
+
+int main(int argc, char **argv) {
+    size_t default_sizes[] = { 1000, 100000, 1000000 };
+    size_t sizes[16];
+    size_t num_sizes;
+    size_t i;
+
+    num_sizes = 0;
+    for (i=1; i<(size_t) argc && num_sizes < 16; i++) {
+        sizes[num_sizes++] = strtoul(argv[i], NULL, 10);
+    }
+    if (num_sizes == 0) {
+        num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        for (i=0; i<num_sizes; i++) sizes[i] = default_sizes[i];
+    }
+
+    for (i=0; i<num_sizes; i++) {
+        bench_heap(sizes[i]);
+        bench_wheel(sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* TYPECHECK.C: Correctness checks for the typed heaps of heap_type.h.
+
+   Instantiates HEAP_DEFINE_TYPE() for a few key types, orderings and
+   arities, loads each heap with random keys by pushes and by a build, and
+   checks that they pop in the order qsort() puts them in, each with its own
+   value.  It is plain C99 that is also valid C++, and "make check" builds
+   and runs it as both, since heap_type.h is meant to compile as either. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "./heap_type.h"
+
+#define CHECK_KEYS 20000
+
+#define WIDE_BEFORE(a, b) ((a) > (b))
+
+HEAP_DEFINE_TYPE(u64_heap, uint64_t, size_t, HEAP_LESS, 2)
+HEAP_DEFINE_TYPE(double_heap, double, size_t, HEAP_LESS, 4)
+HEAP_DEFINE_TYPE(max_heap, int, size_t, HEAP_GREATER, 2)
+HEAP_DEFINE_TYPE(wide_heap, uint64_t, size_t, WIDE_BEFORE, 5)
+
+static unsigned int rng_state = 2463534242u;
+static int failures = 0;
+
+#define CHECK(cond) check_that((cond), #cond, __FILE__, __LINE__)
+
+static void check_that(int cond, const char *text, const char *file, int line) {
+    if (cond) return;
+    failures++;
+    if (failures <= 20) fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+}
+
+static void report(const char *name, int failures_before) {
+    printf("%-16s %s\n", name, failures == failures_before ? "ok" : "FAILED");
+}
+
+/* xorshift32, so every run sees the same key sequence. */
+static unsigned int next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x;
+    uint64_t y;
+
+    x = *(const uint64_t*) a;
+    y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_u64_desc(const void *a, const void *b) {
+    return compare_u64(b, a);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x;
+    double y;
+
+    x = *(const double*) a;
+    y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_int_desc(const void *a, const void *b) {
+    int x;
+    int y;
+
+    x = *(const int*) a;
+    y = *(const int*) b;
+    return (x < y) - (x > y);
+}
+
+/* Writes out check_<name>(n), which pushes the first half of n keys made by
+   make_key(i) one at a time, builds the rest in, and pops them all against
+   keys sorted by compare.  Each value is the index of its key. */
+#define CHECK_TYPE(name, key_type, make_key, compare)                        \
+static void check_##name(size_t n) {                                         \
+    name heap;                                                               \
+    key_type *keys;                                                          \
+    key_type *expect;                                                        \
+    size_t *values;                                                          \
+    key_type key;                                                            \
+    size_t value;                                                            \
+    size_t i;                                                                \
+                                                                             \
+    keys = (key_type*) malloc(sizeof(key_type) * n);                         \
+    expect = (key_type*) malloc(sizeof(key_type) * n);                       \
+    values = (size_t*) malloc(sizeof(size_t) * n);                           \
+    for (i=0; i<n; i++) {                                                    \
+        keys[i] = make_key(i);                                               \
+        expect[i] = keys[i];                                                 \
+        values[i] = i;                                                       \
+    }                                                                        \
+    qsort(expect, n, sizeof(key_type), compare);                             \
+    key = expect[0];                                                         \
+    value = 0;                                                               \
+                                                                             \
+    CHECK(name##_init(&heap, 1) == 0);                                       \
+    CHECK(name##_pop(&heap, &key, &value) == 1);                             \
+    CHECK(name##_peek(&heap, &key, &value) == 1);                            \
+    for (i=0; i<n/2; i++) {                                                  \
+        CHECK(name##_push(&heap, keys[i], values[i]) == 0);                  \
+    }                                                                        \
+    CHECK(name##_reserve(&heap, n) == 0);                                    \
+    CHECK(name##_build(&heap, &keys[n/2], &values[n/2], n - n/2) == 0);      \
+    CHECK(name##_size(&heap) == n);                                          \
+    for (i=0; i<n; i++) {                                                    \
+        CHECK(name##_peek(&heap, &key, NULL) == 0 && key == expect[i]);      \
+        CHECK(name##_pop(&heap, &key, &value) == 0);                         \
+        CHECK(key == expect[i]);                                             \
+        CHECK(value < n && keys[value] == key);                              \
+    }                                                                        \
+    CHECK(name##_size(&heap) == 0);                                          \
+    CHECK(name##_pop(&heap, NULL, NULL) == 1);                               \
+    name##_free(&heap);                                                      \
+                                                                             \
+    free(keys);                                                              \
+    free(expect);                                                            \
+    free(values);                                                            \
+}
+
+/* Keys with repeats, and keys spread over the whole type. */
+#define U64_KEY(i) ((uint64_t) next_random() << 32 | next_random() % 1000)
+#define DOUBLE_KEY(i) ((double) (next_random() % 100000) / 7.0 - 5000.0)
+#define INT_KEY(i) ((int) (next_random() % 2000) - 1000)
+#define WIDE_KEY(i) ((uint64_t) (next_random() % 500) << 40 | (uint64_t) (i))
+
+CHECK_TYPE(u64_heap, uint64_t, U64_KEY, compare_u64)
+CHECK_TYPE(double_heap, double, DOUBLE_KEY, compare_double)
+CHECK_TYPE(max_heap, int, INT_KEY, compare_int_desc)
+CHECK_TYPE(wide_heap, uint64_t, WIDE_KEY, compare_u64_desc)
+
+int main(void) {
+    static const size_t sizes[] = { 1, 2, 7, 100, CHECK_KEYS };
+    size_t i;
+    int before;
+
+    before = failures;
+    for (i=0; i<sizeof(sizes) / sizeof(sizes[0]); i++) {
+        check_u64_heap(sizes[i]);
+        check_double_heap(sizes[i]);
+        check_max_heap(sizes[i]);
+        check_wide_heap(sizes[i]);
+    }
+    report("typed heaps", before);
+
+    if (failures > 0) {
+        printf("%d checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}
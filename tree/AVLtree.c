@@ -1,63 +1,415 @@
 /** The AVL Tree Library.
  ** Written by Matt Saunders for CIS*2520 **/
 
+#include <string.h>
+
 #include "AVLtree.h"
 
+/* The counts of the public call in progress on this thread, which
+ * flushAVLStats() adds to the tree.  The private functions do not know their
+ * tree, so they count here. */
+#ifdef AVL_STATS
+static __thread struct avl_stats avlCounts;
+#define AVL_COUNT(field, n) (avlCounts.field += (n))
+#else
+#define AVL_COUNT(field, n) ((void) 0)
+#endif
+
 /**********************
  ** Public functions **
  **********************/
 
 void addToTree (AVLTree *tree, void *data) {
-    AVLTreeNode *newNode;
-    AVLTreeNode *newRoot;
+    insertOrFindInTree(tree, data, NULL);
+    return;
+}
+
+int avl_build_sorted(AVLTree *tree, void **data, size_t n) {
+    size_t i;
     
-    /* check that we're getting new data */
-    if (data == NULL) {
-        return;
+    if (tree == NULL || (data == NULL && n > 0))
+        return -1;
+    
+    if (tree->root != NULL)
+        return -1; /* only an empty tree can be loaded */
+    
+    for (i=0; i<n; i++) {
+        if (data[i] == NULL)
+            return -1;
     }
-        
-    /* check that the data isn't already in the tree */
-    if (isInTree(tree, data)) {
-        return;
+    
+    for (i=1; i<n; i++) {
+        AVL_COUNT(comparisons, 1);
+        if (tree->compFunc(data[i - 1], data[i]) <= 0) {
+            flushAVLStats(tree);
+            return -1; /* not strictly ascending */
+        }
     }
     
-    /* make a new node for the data */
-    newNode = createAVLNode(data);
-    if (newNode == NULL) {
-        return;
+    tree->root = buildAVLSubTree(tree, data, n);
+    flushAVLStats(tree);
+    if (tree->root == NULL && n > 0)
+        return 1; /* malloc failure */
+    
+    return 0;
+}
+
+size_t avl_count_range(AVLTree *tree, void *low, void *high) {
+    size_t below;
+    size_t end;
+    
+    if (tree == NULL)
+        return 0;
+    
+    below = low == NULL ? 0 : avl_rank(tree, low);
+    end = high == NULL ? sizeOfSubTree(tree->root) : avl_rank(tree, high);
+    if (end < below)
+        return 0; /* high is ordered before low */
+    
+    return end - below;
+}
+
+void *avl_cursor_first(AVLCursor *cursor, AVLTree *tree) {
+    AVLTreeNode *node;
+    
+    cursor->tree = tree;
+    cursor->depth = 0;
+    if (tree == NULL)
+        return NULL;
+    
+    for (node = tree->root; node != NULL; node = node->left)
+        cursor->path[cursor->depth++] = node;
+    
+    return avl_cursor_data(cursor);
+}
+
+void *avl_cursor_last(AVLCursor *cursor, AVLTree *tree) {
+    AVLTreeNode *node;
+    
+    cursor->tree = tree;
+    cursor->depth = 0;
+    if (tree == NULL)
+        return NULL;
+    
+    for (node = tree->root; node != NULL; node = node->right)
+        cursor->path[cursor->depth++] = node;
+    
+    return avl_cursor_data(cursor);
+}
+
+void *avl_cursor_seek(AVLCursor *cursor, AVLTree *tree, void *data) {
+    cursor->tree = tree;
+    cursor->depth = 0;
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    cursor->depth = descendAVLPath(tree, cursor->path, data, TRUE);
+    flushAVLStats(tree);
+    return avl_cursor_data(cursor);
+}
+
+void *avl_cursor_data(AVLCursor *cursor) {
+    if (cursor == NULL || cursor->depth == 0)
+        return NULL;
+    
+    return cursor->path[cursor->depth - 1]->data;
+}
+
+void *avl_cursor_next(AVLCursor *cursor) {
+    AVLTreeNode *node;
+    AVLTreeNode *child;
+    
+    if (cursor == NULL || cursor->depth == 0)
+        return NULL;
+    
+    node = cursor->path[cursor->depth - 1];
+    if (node->right != NULL) { /* the next data is the lowest on the right */
+        for (node = node->right; node != NULL; node = node->left)
+            cursor->path[cursor->depth++] = node;
+    } else { /* climb until we come up from a left branch */
+        do {
+            child = cursor->path[--cursor->depth];
+        } while (cursor->depth > 0 && cursor->path[cursor->depth - 1]->right == child);
     }
     
-    /* insert the new node into the tree */
-    newRoot = insertAVLNode(tree->root, newNode, tree->compFunc);
-    tree->root = newRoot;
-    return;
+    return avl_cursor_data(cursor);
+}
+
+void *avl_cursor_prev(AVLCursor *cursor) {
+    AVLTreeNode *node;
+    AVLTreeNode *child;
+    
+    if (cursor == NULL || cursor->depth == 0)
+        return NULL;
+    
+    node = cursor->path[cursor->depth - 1];
+    if (node->left != NULL) { /* the previous data is the highest on the left */
+        for (node = node->left; node != NULL; node = node->right)
+            cursor->path[cursor->depth++] = node;
+    } else { /* climb until we come up from a right branch */
+        do {
+            child = cursor->path[--cursor->depth];
+        } while (cursor->depth > 0 && cursor->path[cursor->depth - 1]->left == child);
+    }
+    
+    return avl_cursor_data(cursor);
+}
+
+int avl_get_stats(AVLTree *tree, struct avl_stats *stats) {
+    if (tree == NULL || stats == NULL)
+        return -1;
+    
+    memset(stats, 0, sizeof(*stats));
+#ifdef AVL_STATS
+    stats->comparisons = __atomic_load_n(&tree->stats.comparisons, __ATOMIC_RELAXED);
+    stats->rotations = __atomic_load_n(&tree->stats.rotations, __ATOMIC_RELAXED);
+    stats->allocations = __atomic_load_n(&tree->stats.allocations, __ATOMIC_RELAXED);
+    stats->maxHeight = __atomic_load_n(&tree->stats.maxHeight, __ATOMIC_RELAXED);
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+int avl_join(AVLTree *left, void *data, AVLTree *right) {
+    AVLTreeNode *node;
+    AVLTreeNode *highest;
+    AVLTreeNode *lowest;
+    
+    if (left == NULL || right == NULL || data == NULL || left == right)
+        return -1;
+    
+    if (!isAVLTreeCompatible(left, right))
+        return -1;
+    
+    /* Only the ends next to the data need checking. */
+    for (highest = left->root; highest != NULL && highest->right != NULL; highest = highest->right);
+    for (lowest = right->root; lowest != NULL && lowest->left != NULL; lowest = lowest->left);
+    if (highest != NULL) {
+        AVL_COUNT(comparisons, 1);
+        if (left->compFunc(highest->data, data) <= 0) {
+            flushAVLStats(left);
+            return -1;
+        }
+    }
+    if (lowest != NULL) {
+        AVL_COUNT(comparisons, 1);
+        if (left->compFunc(data, lowest->data) <= 0) {
+            flushAVLStats(left);
+            return -1;
+        }
+    }
+    
+    node = createAVLNode(left, data);
+    if (node == NULL) {
+        flushAVLStats(left);
+        return 1; /* malloc failure */
+    }
+    
+    left->root = joinAVLNodes(left->root, node, right->root);
+    right->root = NULL;
+    flushAVLStats(left);
+    return 0;
+}
+
+void *avl_lower_bound(AVLTree *tree, void *data) {
+    AVLTreeNode *path[AVL_MAX_HEIGHT];
+    int depth;
+    
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    depth = descendAVLPath(tree, path, data, TRUE);
+    flushAVLStats(tree);
+    if (depth == 0)
+        return NULL;
+    
+    return path[depth - 1]->data;
+}
+
+void *avl_upper_bound(AVLTree *tree, void *data) {
+    AVLTreeNode *path[AVL_MAX_HEIGHT];
+    int depth;
+    
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    depth = descendAVLPath(tree, path, data, FALSE);
+    flushAVLStats(tree);
+    if (depth == 0)
+        return NULL;
+    
+    return path[depth - 1]->data;
+}
+
+size_t avl_rank(AVLTree *tree, void *data) {
+    AVLTreeNode *root;
+    size_t rank;
+    
+    if (tree == NULL || data == NULL)
+        return 0;
+    
+    rank = 0;
+    root = tree->root;
+    while (root != NULL) {
+        AVL_COUNT(comparisons, 1);
+        if (tree->compFunc(root->data, data) > 0) { /* root before data; it and its left branch count */
+            rank += sizeOfSubTree(root->left) + 1;
+            root = root->right;
+        } else {
+            root = root->left;
+        }
+    }
+    
+    flushAVLStats(tree);
+    return rank;
+}
+
+void *avl_select(AVLTree *tree, size_t k) {
+    AVLTreeNode *root;
+    size_t leftSize;
+    
+    if (tree == NULL)
+        return NULL;
+    
+    root = tree->root;
+    while (root != NULL) {
+        leftSize = sizeOfSubTree(root->left);
+        if (k == leftSize)
+            return root->data;
+        if (k < leftSize) {
+            root = root->left;
+        } else {
+            k -= leftSize + 1;
+            root = root->right;
+        }
+    }
+    
+    return NULL; /* k is past the end */
+}
+
+int avl_split(AVLTree *tree, void *data, AVLTree *right) {
+    AVLTreeNode *before;
+    AVLTreeNode *rest;
+    
+    if (tree == NULL || right == NULL || data == NULL || tree == right)
+        return -1;
+    
+    if (right->root != NULL || !isAVLTreeCompatible(tree, right))
+        return -1;
+    
+    splitAVLSubTree(tree, tree->root, data, &before, &rest);
+    tree->root = before;
+    right->root = rest;
+    flushAVLStats(tree);
+    return 0;
+}
+
+size_t avl_visit_range(AVLTree *tree, void *low, void *high, bool (*__visit_function) (void*, void*), void *context) {
+    AVLCursor cursor;
+    void *data;
+    size_t visited;
+    
+    if (tree == NULL || __visit_function == NULL)
+        return 0;
+    
+    if (low == NULL)
+        data = avl_cursor_first(&cursor, tree);
+    else
+        data = avl_cursor_seek(&cursor, tree, low);
+    
+    visited = 0;
+    while (data != NULL) {
+        if (high != NULL) {
+            AVL_COUNT(comparisons, 1);
+            if (tree->compFunc(data, high) <= 0)
+                break; /* data is not before high */
+        }
+        visited++;
+        if (!__visit_function(data, context))
+            break;
+        data = avl_cursor_next(&cursor);
+    }
+    
+    flushAVLStats(tree);
+    return visited;
 }
 
 AVLTree *createAVLTree(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*) ) {
+    return createAVLTreeWithAllocator(__comparison_func, __destroy_func, NULL);
+}
+
+AVLTree *createAVLTreeWithAllocator(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*),
+                                    const struct allocator *allocator) {
     AVLTree *newTree = NULL;
     
     if (__comparison_func == NULL || __destroy_func == NULL)
         return NULL;
     
-    newTree = malloc(sizeof(AVLTree));
+    if (allocator != NULL && (allocator->allocate == NULL || allocator->reallocate == NULL
+                              || allocator->release == NULL))
+        return NULL; /* its blocks could not go back to free() */
+    
+    if (allocator == NULL)
+        newTree = malloc(sizeof(AVLTree));
+    else
+        newTree = allocator->allocate(allocator->context, sizeof(AVLTree));
     if (newTree == NULL)
         return NULL;
-        
+    
+    if (allocator == NULL) {
+        newTree->allocator.allocate = NULL;
+        newTree->allocator.reallocate = NULL;
+        newTree->allocator.release = NULL;
+        newTree->allocator.context = NULL;
+    } else {
+        newTree->allocator = *allocator;
+    }
+
+    newTree->nodePool = NULL;
     newTree->root = NULL;
     newTree->compFunc = __comparison_func;
     newTree->destFunc = __destroy_func;
+#ifdef AVL_STATS
+    memset(&newTree->stats, 0, sizeof(newTree->stats));
+    newTree->stats.allocations = 1;
+#endif
     
     return newTree;
 }
 
+AVLTree *createPooledAVLTree(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*) ) {
+    AVLTree *newTree;
+    struct allocator allocator;
+    Pool *pool;
+    
+    pool = create_pool(sizeof(AVLTreeNode), 0);
+    if (pool == NULL)
+        return NULL;
+    
+    allocator = pool_allocator(pool);
+    newTree = createAVLTreeWithAllocator(__comparison_func, __destroy_func, &allocator);
+    if (newTree == NULL) {
+        destroy_pool(pool);
+        return NULL;
+    }
+    
+    newTree->nodePool = pool;
+    return newTree;
+}
+
 void destroyAVLTree(AVLTree *tree) {
+    Pool *pool;
+    
     if (tree == NULL) {
         return;
     }
     
-    destroyAVLSubTree(tree->root, tree->destFunc);
+    destroyAVLSubTree(tree, tree->root, tree->destFunc);
     
-    free(tree);
+    pool = tree->nodePool;
+    releaseAVLMemory(tree, tree, sizeof(AVLTree));
+    destroy_pool(pool);
     return;
 }
 
@@ -71,6 +423,7 @@ void *findInTree(AVLTree *tree, void *data) {
         return NULL;
         
     node = findAVLNode(tree->root, data, tree->compFunc);
+    flushAVLStats(tree);
     if (node == NULL)
         return NULL;
         
@@ -86,7 +439,10 @@ struct List *getValidDataList(AVLTree *tree, void *criteria, bool (*__validate_f
     if (tree->root == NULL)
         return NULL; /* empty tree */
     
-    list = newList(tree->compFunc, tree->destFunc);
+    if (tree->allocator.allocate == NULL || tree->nodePool != NULL) /* the list may outlive the pool */
+        list = newList(tree->compFunc, tree->destFunc);
+    else
+        list = newListWithAllocator(tree->compFunc, tree->destFunc, &tree->allocator);
     if (list == NULL)
         return NULL; /* malloc failure */
     
@@ -95,6 +451,26 @@ struct List *getValidDataList(AVLTree *tree, void *criteria, bool (*__validate_f
     return list;
 }
 
+void *insertOrFindInTree(AVLTree *tree, void *data, bool *found) {
+    AVLTreeNode *resident;
+    bool wasFound;
+    
+    if (found != NULL)
+        *found = FALSE;
+    
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    tree->root = insertAVLNode(tree, tree->root, data, &resident, &wasFound);
+    flushAVLStats(tree);
+    if (resident == NULL)
+        return NULL; /* malloc failure */
+    
+    if (found != NULL)
+        *found = wasFound;
+    return resident->data;
+}
+
 bool isInTree(AVLTree *tree, void *data) {
     AVLTreeNode *root; 
     int comp;
@@ -105,14 +481,18 @@ bool isInTree(AVLTree *tree, void *data) {
     root = tree->root;
     while (root != NULL) {
         comp = tree->compFunc(root->data, data);
-        if (comp == 0)
+        AVL_COUNT(comparisons, 1);
+        if (comp == 0) {
+            flushAVLStats(tree);
             return TRUE;
+        }
         if (comp < 0) /* root greater than data; going left */
             root = root->left;
         else /* root less than data, going right */
             root = root->right;
     }
     
+    flushAVLStats(tree);
     return FALSE;
 }
 
@@ -133,11 +513,13 @@ void *removeFromTree (AVLTree *tree, void *data) {
         
     foundData = removeData(tree, tree->root, data, NULL, 0, tree->compFunc);
     if (foundData == NULL) {
+        flushAVLStats(tree);
         return NULL;
     }
     tree->root = balanceAVLTree(tree->root);
+    flushAVLStats(tree);
     toReturn = foundData->data;
-    free(foundData);
+    releaseAVLMemory(tree, foundData, sizeof(AVLTreeNode));
     
     return toReturn;
 }
@@ -185,31 +567,95 @@ AVLTreeNode *balanceAVLTree(AVLTreeNode *root) {
     return newRoot;
 }
 
-AVLTreeNode *createAVLNode(void *data) {
+void *allocateAVLMemory(AVLTree *tree, size_t size) {
+    AVL_COUNT(allocations, 1);
+    if (tree->allocator.allocate == NULL)
+        return malloc(size);
+    return tree->allocator.allocate(tree->allocator.context, size);
+}
+
+AVLTreeNode *buildAVLSubTree(AVLTree *tree, void **data, size_t n) {
+    AVLTreeNode *root;
+    AVLTreeNode *left;
+    size_t middle;
+    
+    if (n == 0)
+        return NULL;
+    
+    /* The middle data is the root; each half is a branch. */
+    middle = n / 2;
+    left = buildAVLSubTree(tree, data, middle);
+    if (left == NULL && middle > 0)
+        return NULL;
+    
+    root = createAVLNode(tree, data[middle]);
+    if (root == NULL) {
+        releaseAVLSubTree(tree, left);
+        return NULL;
+    }
+    root->left = left;
+    
+    root->right = buildAVLSubTree(tree, data + middle + 1, n - middle - 1);
+    if (root->right == NULL && n - middle - 1 > 0) {
+        releaseAVLSubTree(tree, root);
+        return NULL;
+    }
+    
+    recalcHeight(root);
+    return root;
+}
+
+AVLTreeNode *createAVLNode(AVLTree *tree, void *data) {
     AVLTreeNode *newNode = NULL;
     
-    newNode = malloc(sizeof(AVLTreeNode));
+    newNode = allocateAVLMemory(tree, sizeof(AVLTreeNode));
     if (newNode == NULL)
         return NULL;
         
     newNode->left = NULL;
     newNode->right = NULL;
     newNode->height = 1;
+    newNode->size = 1;
     newNode->data = data;
     
     return newNode;
 }
 
-void destroyAVLSubTree(AVLTreeNode *root, void (*__destroy_func) (void*)) {
+int descendAVLPath(AVLTree *tree, AVLTreeNode **path, void *data, bool inclusive) {
+    AVLTreeNode *root;
+    int depth;
+    int found;
+    int comp;
+    
+    depth = 0;
+    found = 0;
+    root = tree->root;
+    while (root != NULL) {
+        path[depth++] = root;
+        comp = tree->compFunc(root->data, data);
+        AVL_COUNT(comparisons, 1);
+        if (comp < 0 || (comp == 0 && inclusive)) { /* root qualifies; look for a lower one on the left */
+            found = depth;
+            root = root->left;
+        } else { /* root is too low; going right */
+            root = root->right;
+        }
+    }
+    
+    /* The path to the last qualifying node is a prefix of the path walked. */
+    return found;
+}
+
+void destroyAVLSubTree(AVLTree *tree, AVLTreeNode *root, void (*__destroy_func) (void*)) {
     if (root == NULL)
         return;
     
     __destroy_func(root->data);
     
-    destroyAVLSubTree(root->left, __destroy_func);
-    destroyAVLSubTree(root->right, __destroy_func);
+    destroyAVLSubTree(tree, root->left, __destroy_func);
+    destroyAVLSubTree(tree, root->right, __destroy_func);
     
-    free(root);
+    releaseAVLMemory(tree, root, sizeof(AVLTreeNode));
     
     return;
 }
@@ -225,6 +671,7 @@ AVLTreeNode *findAVLNode(AVLTreeNode *root, void *data, int (*__comparison_func)
     curData = root->data;
     
     comp = __comparison_func(data, curData);
+    AVL_COUNT(comparisons, 1);
     if (comp == 0) { /* found the data */
         foundNode = root;
     } else if (comp > 0) { /* heading left */
@@ -236,50 +683,74 @@ AVLTreeNode *findAVLNode(AVLTreeNode *root, void *data, int (*__comparison_func)
     return foundNode;
 }
 
-AVLTreeNode *insertAVLNode(AVLTreeNode *root, AVLTreeNode *newNode, int (*__comparison_func) (void*, void*) ) {
-    AVLTreeNode *newRoot;
-    AVLTreeNode *newLeft;
-    AVLTreeNode *newRight;
-    int comp;
+AVLTreeNode *joinAVLNodes(AVLTreeNode *left, AVLTreeNode *node, AVLTreeNode *right) {
+    int lh;
+    int rh;
     
-    newRoot = root;
+    lh = left == NULL ? 0 : left->height;
+    rh = right == NULL ? 0 : right->height;
     
-    if (isAVLTreeEmpty(root)) {
-        newNode->height = 1;
-        return newNode; /* tree empty */
+    if (lh > rh + 1) { /* left is taller; hang the rest off its right edge */
+        left->right = joinAVLNodes(left->right, node, right);
+        recalcHeight(left);
+        return balanceAVLTree(left);
+    }
+    if (rh > lh + 1) { /* right is taller; hang the rest off its left edge */
+        right->left = joinAVLNodes(left, node, right->left);
+        recalcHeight(right);
+        return balanceAVLTree(right);
     }
     
-    newLeft = root->left;
-    newRight = root->right;
+    /* Close enough in height to sit side by side under the node. */
+    node->left = left;
+    node->right = right;
+    recalcHeight(node);
+    return node;
+}
+
+bool isAVLTreeCompatible(AVLTree *one, AVLTree *two) {
+    if (one->compFunc != two->compFunc)
+        return FALSE;
+    
+    if (one->nodePool != two->nodePool)
+        return FALSE;
+    
+    if (one->allocator.allocate != two->allocator.allocate
+            || one->allocator.release != two->allocator.release
+            || one->allocator.context != two->allocator.context)
+        return FALSE;
     
-    if (newNode == NULL) {
-        return root; /* new data nonexistent */
+    return TRUE;
+}
+
+AVLTreeNode *insertAVLNode(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNode **resident, bool *found) {
+    int comp;
+    
+    if (isAVLTreeEmpty(root)) { /* the data belongs here */
+        *found = FALSE;
+        *resident = createAVLNode(tree, data);
+        return *resident; /* NULL leaves the subtree empty */
     }
     
-    comp = __comparison_func(root->data, newNode->data);
-    /* insertAVLnode() only gets called if the data is not a duplicate of data
-     * already in the tree -- so no need to check for comp == 0. */
+    comp = tree->compFunc(root->data, data);
+    AVL_COUNT(comparisons, 1);
+    if (comp == 0) { /* already in the tree; nothing below changes */
+        *found = TRUE;
+        *resident = root;
+        return root;
+    }
     
     if (comp > 0) { /* adding new data to right branch */
-        if (newRight == NULL) { /* base case */
-            newRight = newNode;
-        } else {
-            newRight = insertAVLNode(root->right, newNode, __comparison_func);
-        }
+        root->right = insertAVLNode(tree, root->right, data, resident, found);
     } else { /* comp < 0, adding new data to left branch */
-        if (newLeft == NULL) {
-            newLeft = newNode;
-        } else {
-            newLeft = insertAVLNode(root->left, newNode, __comparison_func);
-        }
+        root->left = insertAVLNode(tree, root->left, data, resident, found);
     }
     
-    root->left = newLeft;
-    root->right = newRight;
-    recalcHeight(root);
-    newRoot = balanceAVLTree(root);
+    if (*found || *resident == NULL)
+        return root; /* no new node, so no heights changed */
     
-    return newRoot;
+    recalcHeight(root);
+    return balanceAVLTree(root);
 }
 
 bool isAVLTreeEmpty(AVLTreeNode *root) {
@@ -290,6 +761,24 @@ bool isAVLTreeEmpty(AVLTreeNode *root) {
     return FALSE;
 }
 
+void flushAVLStats(AVLTree *tree) {
+#ifdef AVL_STATS
+    int height;
+    
+    __atomic_add_fetch(&tree->stats.comparisons, avlCounts.comparisons, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tree->stats.rotations, avlCounts.rotations, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tree->stats.allocations, avlCounts.allocations, __ATOMIC_RELAXED);
+    /* Only the thread changing the tree stores the height. */
+    height = tree->root == NULL ? 0 : tree->root->height;
+    if (height > __atomic_load_n(&tree->stats.maxHeight, __ATOMIC_RELAXED))
+        __atomic_store_n(&tree->stats.maxHeight, height, __ATOMIC_RELAXED);
+    memset(&avlCounts, 0, sizeof(avlCounts));
+#else
+    (void) tree;
+#endif
+    return;
+}
+
 int max(int one, int two) {
     if (one > two) return one;
     else return two;
@@ -324,6 +813,27 @@ void recalcHeight(AVLTreeNode *root) {
     } else rh = 0;
     
     root->height = max(lh, rh) + 1;
+    root->size = sizeOfSubTree(root->left) + sizeOfSubTree(root->right) + 1;
+    return;
+}
+
+void releaseAVLMemory(AVLTree *tree, void *block, size_t size) {
+    if (block == NULL)
+        return;
+    if (tree->allocator.release == NULL)
+        free(block);
+    else
+        tree->allocator.release(tree->allocator.context, block, size);
+    return;
+}
+
+void releaseAVLSubTree(AVLTree *tree, AVLTreeNode *root) {
+    if (root == NULL)
+        return;
+    
+    releaseAVLSubTree(tree, root->left);
+    releaseAVLSubTree(tree, root->right);
+    releaseAVLMemory(tree, root, sizeof(AVLTreeNode));
     return;
 }
 
@@ -342,6 +852,7 @@ AVLTreeNode *removeData(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNod
     thisLevelData = root->data;
     
     comp = __compare_func(data, thisLevelData);
+    AVL_COUNT(comparisons, 1);
     if (comp == 0) { /* Found the data! */
         /* Checking for edge cases (found node has one or zero branches) */
         foundData = root;
@@ -365,7 +876,12 @@ AVLTreeNode *removeData(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNod
             nextLowest = removeNextLowest(root->left, root, -1); /* Can never return NULL from this function call -- that case is checked above */
             /* This function call returns the next lowest value from the subtree
              * rooted at the value we're deleting. Now that we have it, we can
-             * substitute in the next lowest for the data we are removing.*/
+             * substitute in the next lowest for the data we are removing.
+             * The left branch lost a node, so the substitute may need a rotation. */
+            nextLowest->left = foundData->left;
+            nextLowest->right = foundData->right;
+            recalcHeight(nextLowest);
+            nextLowest = balanceAVLTree(nextLowest);
             if (direc == 1) {
                 parent->right = nextLowest;
             } else if (direc == -1) {
@@ -373,9 +889,6 @@ AVLTreeNode *removeData(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNod
             } else { /* the found node is the parent of the entire tree */
                 tree->root = nextLowest;
             }
-            nextLowest->left = foundData->left;
-            nextLowest->right = foundData->right;
-            recalcHeight(nextLowest);
         }
         foundData->left = NULL;
         foundData->right = NULL;
@@ -414,9 +927,16 @@ AVLTreeNode *removeNextLowest(AVLTreeNode *root, AVLTreeNode *parent, int direct
         } else {
             parent->left = root->left;
         }
+        return foundMax;
     } 
+    /* Rebalancing may change the root of this subtree, so the parent has to
+     * point at whatever comes back. */
     recalcHeight(root);
-    root = balanceAVLTree(root);
+    if (direction == 1) {
+        parent->right = balanceAVLTree(root);
+    } else {
+        parent->left = balanceAVLTree(root);
+    }
     return foundMax;
 }
 
@@ -441,6 +961,7 @@ AVLTreeNode *rotLeftAVL(AVLTreeNode *root) {
     } else rl = 0;
     
     if (rl > rr) { /* Right-Left Case, "oldRight" is the pivot */
+        AVL_COUNT(rotations, 1);
         newRight = oldRight->left;
         oldRight->left = newRight->right;
         recalcHeight(oldRight);
@@ -451,6 +972,7 @@ AVLTreeNode *rotLeftAVL(AVLTreeNode *root) {
         root->right = newRight;
     }
     
+    AVL_COUNT(rotations, 1);
     newRoot = root->right;
     root->right = newRoot->left;
     
@@ -483,6 +1005,7 @@ AVLTreeNode *rotRightAVL(AVLTreeNode *root) {
     } else ll = 0;
     
     if (lr > ll) { /* Left-Right Case, "oldLeft" is the pivot */
+        AVL_COUNT(rotations, 1);
         newLeft = oldLeft->right;
         oldLeft->right = newLeft->left;
         recalcHeight(oldLeft);
@@ -493,6 +1016,7 @@ AVLTreeNode *rotRightAVL(AVLTreeNode *root) {
         root->left = newLeft;
     }
     
+    AVL_COUNT(rotations, 1);
     newRoot = root->left;
     root->left = newRoot->right;
     
@@ -504,6 +1028,38 @@ AVLTreeNode *rotRightAVL(AVLTreeNode *root) {
     return newRoot;
 }
 
+size_t sizeOfSubTree(AVLTreeNode *root) {
+    if (root == NULL)
+        return 0;
+    
+    return root->size;
+}
+
+void splitAVLSubTree(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNode **left, AVLTreeNode **right) {
+    AVLTreeNode *lower;
+    AVLTreeNode *upper;
+    
+    if (root == NULL) {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+    
+    /* The root and one branch stay on one side; the other branch is split, and
+     * the side of it that belongs with the root is joined back under the root. */
+    AVL_COUNT(comparisons, 1);
+    if (tree->compFunc(root->data, data) > 0) { /* root before data; going right */
+        splitAVLSubTree(tree, root->right, data, &lower, &upper);
+        *left = joinAVLNodes(root->left, root, lower);
+        *right = upper;
+    } else {
+        splitAVLSubTree(tree, root->left, data, &lower, &upper);
+        *left = lower;
+        *right = joinAVLNodes(upper, root, root->right);
+    }
+    return;
+}
+
 void printWithoutSpaces(AVLTreeNode *root, void (*__printFunc) (void*) ) {
     if (root == NULL)
         return;
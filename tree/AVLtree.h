@@ -8,6 +8,8 @@
 #include <stdlib.h>
 
 #include "linkedlist.h"
+#include "../alloc/allocator.h"
+#include "../alloc/pool.h"
 
 typedef enum bool {
     FALSE,
@@ -19,23 +21,146 @@ typedef struct AVLTreeNode {
     struct AVLTreeNode *right;
     void *data;
     int height;
+    size_t size; /* Nodes in the subtree rooted here, this one included. */
 } AVLTreeNode;
 
+/* Counters kept by a tree when AVLtree.c is built with AVL_STATS defined.
+ * Without it nothing is counted.  With it, each public call counts into
+ * per-thread counters and adds them to the tree once, with relaxed atomic
+ * adds, before it returns; another thread may read them with avl_get_stats().
+ * A double rotation counts as two rotations. */
+struct avl_stats {
+    unsigned long long comparisons;
+    unsigned long long rotations;
+    unsigned long long allocations; /* Nodes and trees allocated. */
+    int maxHeight; /* Greatest height the tree has reached. */
+};
+
 typedef struct AVLTree {
     AVLTreeNode *root;
     void (*destFunc) (void *data);
     int (*compFunc) (void*, void*);
+    struct allocator allocator; /* All NULL to use malloc(). */
+    Pool *nodePool; /* The tree's own pool of nodes, or NULL. */
+#ifdef AVL_STATS
+    struct avl_stats stats;
+#endif
 } AVLTree;
 
+/* The most nodes on a path from the root.  An AVL tree of height h holds at
+ * least fib(h + 2) - 1 nodes, so no tree that fits in memory is taller. */
+#define AVL_MAX_HEIGHT 96
+
+/* A position in a tree's in-order sequence, kept as the path from the root to
+ * the current node so that stepping allocates nothing.  Cursors live wherever
+ * the caller puts them, usually on the stack.  Adding to or removing from the
+ * tree invalidates every cursor on it. */
+typedef struct AVLCursor {
+    AVLTree *tree;
+    AVLTreeNode *path[AVL_MAX_HEIGHT];
+    int depth; /* Nodes on the path; 0 once the cursor has run off either end. */
+} AVLCursor;
+
 /** Public Functions **/
 
 /* Adds a data pointer to the tree.  Rebalances the tree after addition. */
 void addToTree (AVLTree *tree, void *data);
 
+/* Loads n data, which must be in strictly ascending order, into an empty tree,
+ * building a perfectly balanced tree in O(n) with no rotations.  Returns 0 on
+ * success, 1 if a node could not be allocated, leaving the tree empty, or -1 if
+ * the arguments are invalid, the tree is not empty or the data are not in order.
+ * The tree takes ownership of the data only on success. */
+int avl_build_sorted(AVLTree *tree, void **data, size_t n);
+
+/* Returns the number of data in the range from low up to but not including
+ * high.  A NULL low counts from the lowest data, and a NULL high to the end, so
+ * avl_count_range(tree, NULL, NULL) is the size of the tree.  O(log n). */
+size_t avl_count_range(AVLTree *tree, void *low, void *high);
+
+/* Each of these sets a cursor on a tree and returns the data there, or NULL if
+ * there is none.  avl_cursor_first() and avl_cursor_last() go to the lowest and
+ * highest data.  avl_cursor_seek() goes to the first data not ordered before
+ * the given data, like avl_lower_bound(). */
+void *avl_cursor_first(AVLCursor *cursor, AVLTree *tree);
+void *avl_cursor_last(AVLCursor *cursor, AVLTree *tree);
+void *avl_cursor_seek(AVLCursor *cursor, AVLTree *tree, void *data);
+
+/* Return the data under a cursor, or NULL if it has run off the tree. */
+void *avl_cursor_data(AVLCursor *cursor);
+
+/* Move a cursor to the next or previous data in order and return it.  Return
+ * NULL, leaving the cursor off the tree, when there is none.  Each step is O(1)
+ * amortized. */
+void *avl_cursor_next(AVLCursor *cursor);
+void *avl_cursor_prev(AVLCursor *cursor);
+
+/* Copies a snapshot of a tree's counters into stats.  Returns 0 on success,
+ * 1 if AVLtree.c was built without AVL_STATS, in which case stats is zeroed,
+ * or -1 if the arguments are invalid. */
+int avl_get_stats(AVLTree *tree, struct avl_stats *stats);
+
+/* Joins two trees around a piece of data.  Every data in left must be ordered
+ * before the given data, and every data in right after it.  Afterwards left
+ * holds all of it and right is empty, but must still be destroyed.  Both trees
+ * must use the same comparison function and take their nodes from the same
+ * allocator; two pooled trees each have their own pool, so cannot be joined.
+ * Takes O(log n).  Returns 0 on success, 1 if a node could not be allocated,
+ * or -1 if the arguments are invalid or out of order, leaving both trees
+ * unchanged. */
+int avl_join(AVLTree *left, void *data, AVLTree *right);
+
+/* Return the first data in order that is not ordered before the given data
+ * (avl_lower_bound), or that is ordered after it (avl_upper_bound).  Return
+ * NULL if there is none.  Both are O(log n). */
+void *avl_lower_bound(AVLTree *tree, void *data);
+void *avl_upper_bound(AVLTree *tree, void *data);
+
+/* Returns the number of data in the tree ordered before the given data, which
+ * need not be in the tree.  O(log n). */
+size_t avl_rank(AVLTree *tree, void *data);
+
+/* Returns the data at position k of the tree's in-order sequence, counting from
+ * 0, or NULL if the tree holds k data or fewer.  avl_select(tree, avl_rank(tree, d))
+ * is d when d is in the tree.  O(log n). */
+void *avl_select(AVLTree *tree, size_t k);
+
+/* Splits a tree at a piece of data, which need not be in the tree.  Afterwards
+ * the tree holds the data ordered before it, and right, which must be empty,
+ * holds the rest.  The same conditions on right apply as for avl_join().  Takes
+ * O(log n).  Returns 0 on success or -1 if the arguments are invalid.
+ *
+ * With avl_join(), this gives union, intersection and difference of trees
+ * without going through them one data at a time. */
+int avl_split(AVLTree *tree, void *data, AVLTree *right);
+
+/* Visits, in order, the data from low up to but not including high, passing
+ * each with the context to the visit function.  A NULL low starts at the lowest
+ * data, and a NULL high runs to the end.  The visit function returns TRUE to go
+ * on or FALSE to stop; it must not change the tree.  Returns the number of data
+ * visited.  Takes O(log n + k) for k data visited.
+ *
+ * The visit function MUST have the prototype:
+ * bool __visit_function(void *data, void *context); */
+size_t avl_visit_range(AVLTree *tree, void *low, void *high, bool (*__visit_function) (void*, void*), void *context);
+
 /* Creates a new AVL Tree.  Requires a comparison function and a destruction function
  * for the type of data being held in the tree. */
 AVLTree *createAVLTree(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*) );
 
+/* Works like createAVLTree(), but takes the tree, every node and the lists made
+ * by getValidDataList() from the given allocator (see allocator.h) instead of
+ * malloc().  A NULL allocator means malloc().  Returns NULL if the allocator
+ * lacks any of its functions. */
+AVLTree *createAVLTreeWithAllocator(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*),
+                                    const struct allocator *allocator);
+
+/* Works like createAVLTree(), but gives the tree a pool of its own (see pool.h)
+ * to take its nodes from, so that they are packed together in large chunks
+ * instead of each being malloc()'d.  The pool goes when the tree is destroyed.
+ * For the smallest nodes, see compactAVLtree.h. */
+AVLTree *createPooledAVLTree(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*) );
+
 /* Destroys an AVL tree.  Frees all of the data inside the tree recursively. */
 void destroyAVLTree(AVLTree *tree);
 
@@ -55,6 +180,13 @@ void *findInTree(AVLTree *tree, void *data);
  * It MUST return TRUE if the data fits the criteria, or FALSE if not. */
 struct List *getValidDataList(AVLTree *tree, void *criteria, bool (*__validate_function) (void*, void*) );
 
+/* Adds a data pointer to the tree unless equal data is already there, finding
+ * its place with a single descent.  Returns the data the tree holds afterwards:
+ * the data already there if there was some, or the given data.  If found is
+ * not NULL, sets it to TRUE if equal data was already in the tree.  Returns NULL
+ * if the data is NULL or a node could not be allocated. */
+void *insertOrFindInTree(AVLTree *tree, void *data, bool *found);
+
 /* Checks if a piece of data is inside a tree, using its previously-defined comparison function. */
 bool isInTree(AVLTree *tree, void *data);
 
@@ -72,23 +204,51 @@ void *removeFromTree (AVLTree *tree, void *data);
 /* Balances a given subtree.  Returns the new root. */
 AVLTreeNode *balanceAVLTree(AVLTreeNode *root);
 
+/* Allocates memory from the tree's allocator, or malloc() if it has none. */
+void *allocateAVLMemory(AVLTree *tree, size_t size);
+
+/* Builds a perfectly balanced subtree from n sorted data and returns its root.
+ * Returns NULL, having released every node it made, if a node could not be
+ * allocated. */
+AVLTreeNode *buildAVLSubTree(AVLTree *tree, void **data, size_t n);
+
 /* Allocates the memory for a new node. */
-AVLTreeNode *createAVLNode(void *data);
+AVLTreeNode *createAVLNode(AVLTree *tree, void *data);
+
+/* Fills path with the nodes from the root down to the first data ordered after
+ * the given data, or, if inclusive is TRUE, not ordered before it.  Returns the
+ * number of nodes on the path, 0 if there is no such data. */
+int descendAVLPath(AVLTree *tree, AVLTreeNode **path, void *data, bool inclusive);
 
 /* Given a subtree and a destroy function, recursively destroys each tree node
  * and the data inside of it. */
-void destroyAVLSubTree(AVLTreeNode *root, void (*__destroy_func) (void*));
+void destroyAVLSubTree(AVLTree *tree, AVLTreeNode *root, void (*__destroy_func) (void*));
 
 /* Finds a node inside a tree and returns a pointer to it. */
 AVLTreeNode *findAVLNode(AVLTreeNode *root, void *data, int (*__comparison_func) (void*, void*) );
 
-/* Inserts a node inside a tree and returns a pointer to the new root.
- * Must only be called if we have already determined new data is not in tree. */
-AVLTreeNode *insertAVLNode(AVLTreeNode *root, AVLTreeNode *newNode, int (*__comparison_func) (void*, void*) );
+/* Joins two subtrees under a node, which must order after everything in left
+ * and before everything in right.  Returns the new root.  Takes time in
+ * proportion to the difference in height of the subtrees. */
+AVLTreeNode *joinAVLNodes(AVLTreeNode *left, AVLTreeNode *node, AVLTreeNode *right);
+
+/* Tells whether two trees can trade nodes: they compare alike and take their
+ * nodes from the same place. */
+bool isAVLTreeCompatible(AVLTree *one, AVLTree *two);
+
+/* Inserts data into a subtree unless equal data is already in it, and returns
+ * the new root.  Only allocates a node once the descent has found the data is
+ * missing.  Sets resident to the node holding equal data, or to the new node
+ * (NULL if it could not be allocated), and found to whether the data was there. */
+AVLTreeNode *insertAVLNode(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNode **resident, bool *found);
 
 /* Checks if a subtree has any children. Returns TRUE if empty, FALSE if not. */
 bool isAVLTreeEmpty (AVLTreeNode *root);
 
+/* Adds the counts of the current call to the tree's counters, and clears them.
+ * Does nothing without AVL_STATS. */
+void flushAVLStats(AVLTree *tree);
+
 /* Takes two ints, returns their maximum */
 int max(int one, int two);
 
@@ -97,9 +257,16 @@ int max(int one, int two);
  * The criteria is given by the user and passed into the validation function. */
 void populateList (AVLTreeNode *root, struct List *list, void *criteria, bool (*valFunc) (void*, void*) );
 
-/* Given a root node, recalculates its height based on its branch nodes + 1 */
+/* Given a root node, recalculates its height based on its branch nodes + 1,
+ * and its size as the sizes of its branches + 1 */
 void recalcHeight(AVLTreeNode *root);
 
+/* Gives memory back to the tree's allocator, or free() if it has none. */
+void releaseAVLMemory(AVLTree *tree, void *block, size_t size);
+
+/* Gives back every node of a subtree, but NOT its data. */
+void releaseAVLSubTree(AVLTree *tree, AVLTreeNode *root);
+
 /* Removes a piece of data from the tree, rebalancing the tree in the process. 
  * Direc tells the function the direction that the parent traversed.  -1 for left, 1 for right.
  * 0 is a special value denoting the root of the entire tree.*/
@@ -115,6 +282,13 @@ AVLTreeNode *rotLeftAVL(AVLTreeNode *root);
 /* Rotates a given subtree right.  Returns the new root. */
 AVLTreeNode *rotRightAVL(AVLTreeNode *root);
 
+/* Splits a subtree into the nodes ordered before the given data, put in left,
+ * and the rest, put in right. */
+void splitAVLSubTree(AVLTree *tree, AVLTreeNode *root, void *data, AVLTreeNode **left, AVLTreeNode **right);
+
+/* Returns the number of nodes in a subtree, 0 if it is empty. */
+size_t sizeOfSubTree(AVLTreeNode *root);
+
 /* Prints a subtree recursively, in order. */
 void printWithoutSpaces(AVLTreeNode *root, void (*__printFunc) (void*) );
 
@@ -0,0 +1,351 @@
+/** The Compact AVL Tree Library.
+ ** An AVL tree whose nodes sit in one array and link by index **/
+
+#include <string.h>
+
+#include "compactAVLtree.h"
+
+/* The slab's size when the tree is created, in nodes. */
+#define COMPACT_AVL_INIT_NODES 16
+
+/**********************
+ ** Public functions **
+ **********************/
+
+CompactAVLTree *createCompactAVLTree(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*) ) {
+    CompactAVLTree *newTree;
+    
+    if (__comparison_func == NULL || __destroy_func == NULL)
+        return NULL;
+    
+    newTree = malloc(sizeof(CompactAVLTree));
+    if (newTree == NULL)
+        return NULL;
+    
+    newTree->nodes = calloc(COMPACT_AVL_INIT_NODES, sizeof(CompactAVLNode));
+    if (newTree->nodes == NULL) {
+        free(newTree);
+        return NULL;
+    }
+    
+    newTree->root = 0;
+    newTree->freeNode = 0;
+    newTree->used = 1; /* nodes[0] stands for no node */
+    newTree->capacity = COMPACT_AVL_INIT_NODES;
+    newTree->size = 0;
+    newTree->compFunc = __comparison_func;
+    newTree->destFunc = __destroy_func;
+    
+    return newTree;
+}
+
+void destroyCompactAVLTree(CompactAVLTree *tree) {
+    if (tree == NULL)
+        return;
+    
+    destroyCompactSubTree(tree, tree->root);
+    free(tree->nodes);
+    free(tree);
+    return;
+}
+
+void *findInCompactTree(CompactAVLTree *tree, void *data) {
+    CompactAVLNode *nodes;
+    uint32_t root;
+    int comp;
+    
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    nodes = tree->nodes;
+    root = tree->root;
+    while (root != 0) {
+        comp = tree->compFunc(nodes[root].data, data);
+        if (comp == 0)
+            return nodes[root].data;
+        if (comp < 0) /* root greater than data; going left */
+            root = nodes[root].left;
+        else /* root less than data, going right */
+            root = nodes[root].right;
+    }
+    
+    return NULL;
+}
+
+size_t getCompactTreeSize(CompactAVLTree *tree) {
+    if (tree == NULL)
+        return 0;
+    
+    return tree->size;
+}
+
+void *insertOrFindInCompactTree(CompactAVLTree *tree, void *data, bool *found) {
+    uint32_t resident;
+    bool wasFound;
+    
+    if (found != NULL)
+        *found = FALSE;
+    
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    /* Growing first means no node moves while the descent holds indices into
+     * the slab, at the price of sometimes growing for data already there. */
+    if (!growCompactSlab(tree))
+        return NULL;
+    
+    tree->root = insertCompactNode(tree, tree->root, data, &resident, &wasFound);
+    if (!wasFound)
+        tree->size++;
+    
+    if (found != NULL)
+        *found = wasFound;
+    return tree->nodes[resident].data;
+}
+
+void *removeFromCompactTree(CompactAVLTree *tree, void *data) {
+    uint32_t removed;
+    
+    if (tree == NULL || data == NULL)
+        return NULL;
+    
+    removed = 0;
+    tree->root = removeCompactNode(tree, tree->root, data, &removed);
+    if (removed == 0)
+        return NULL;
+    
+    tree->nodes[removed].left = tree->freeNode;
+    tree->freeNode = removed;
+    tree->size--;
+    return tree->nodes[removed].data;
+}
+
+size_t visitCompactTreeRange(CompactAVLTree *tree, void *low, void *high, bool (*__visit_function) (void*, void*), void *context) {
+    uint32_t path[AVL_MAX_HEIGHT];
+    CompactAVLNode *nodes;
+    uint32_t root;
+    size_t visited;
+    int depth;
+    
+    if (tree == NULL || __visit_function == NULL)
+        return 0;
+    
+    /* Keep the nodes not before low whose left branch we went down; they are
+     * the ones still to visit, the lowest on top. */
+    nodes = tree->nodes;
+    depth = 0;
+    root = tree->root;
+    while (root != 0) {
+        if (low == NULL || tree->compFunc(nodes[root].data, low) <= 0) {
+            path[depth++] = root;
+            root = nodes[root].left;
+        } else { /* root is before low; going right */
+            root = nodes[root].right;
+        }
+    }
+    
+    visited = 0;
+    while (depth > 0) {
+        root = path[--depth];
+        if (high != NULL && tree->compFunc(nodes[root].data, high) <= 0)
+            break; /* data is not before high */
+        visited++;
+        if (!__visit_function(nodes[root].data, context))
+            break;
+        for (root = nodes[root].right; root != 0; root = nodes[root].left)
+            path[depth++] = root;
+    }
+    
+    return visited;
+}
+
+
+
+
+
+
+
+
+/***********************
+ ** Private functions **
+ ***********************/
+
+uint32_t balanceCompactNode(CompactAVLNode *nodes, uint32_t root) {
+    uint32_t branch;
+    int balance;
+    
+    balance = nodes[nodes[root].left].height - nodes[nodes[root].right].height;
+    if (balance > 1) { /* imbalanced, left-heavy */
+        branch = nodes[root].left;
+        if (nodes[nodes[branch].right].height > nodes[nodes[branch].left].height) /* Left-Right Case */
+            nodes[root].left = rotLeftCompact(nodes, branch);
+        return rotRightCompact(nodes, root);
+    }
+    if (balance < -1) { /* imbalanced, right-heavy */
+        branch = nodes[root].right;
+        if (nodes[nodes[branch].left].height > nodes[nodes[branch].right].height) /* Right-Left Case */
+            nodes[root].right = rotRightCompact(nodes, branch);
+        return rotLeftCompact(nodes, root);
+    }
+    
+    return root;
+}
+
+void destroyCompactSubTree(CompactAVLTree *tree, uint32_t root) {
+    if (root == 0)
+        return;
+    
+    tree->destFunc(tree->nodes[root].data);
+    destroyCompactSubTree(tree, tree->nodes[root].left);
+    destroyCompactSubTree(tree, tree->nodes[root].right);
+    return;
+}
+
+bool growCompactSlab(CompactAVLTree *tree) {
+    CompactAVLNode *grown;
+    uint32_t capacity;
+    
+    if (tree->freeNode != 0 || tree->used < tree->capacity)
+        return TRUE;
+    
+    if (tree->capacity == UINT32_MAX)
+        return FALSE; /* every index is taken */
+    capacity = tree->capacity > UINT32_MAX / 2 ? UINT32_MAX : tree->capacity * 2;
+#if SIZE_MAX / 24 < UINT32_MAX
+    /* only where size_t is narrow enough for the byte count to overflow */
+    if (capacity > SIZE_MAX / sizeof(CompactAVLNode))
+        return FALSE;
+#endif
+    
+    grown = realloc(tree->nodes, sizeof(CompactAVLNode) * capacity);
+    if (grown == NULL)
+        return FALSE;
+    
+    tree->nodes = grown;
+    tree->capacity = capacity;
+    return TRUE;
+}
+
+uint32_t insertCompactNode(CompactAVLTree *tree, uint32_t root, void *data, uint32_t *resident, bool *found) {
+    CompactAVLNode *nodes;
+    uint32_t node;
+    int comp;
+    
+    nodes = tree->nodes;
+    if (root == 0) { /* the data belongs here; take a free node */
+        if (tree->freeNode != 0) {
+            node = tree->freeNode;
+            tree->freeNode = nodes[node].left;
+        } else {
+            node = tree->used++;
+        }
+        nodes[node].data = data;
+        nodes[node].left = 0;
+        nodes[node].right = 0;
+        nodes[node].height = 1;
+        *found = FALSE;
+        *resident = node;
+        return node;
+    }
+    
+    comp = tree->compFunc(nodes[root].data, data);
+    if (comp == 0) { /* already in the tree; nothing below changes */
+        *found = TRUE;
+        *resident = root;
+        return root;
+    }
+    
+    if (comp > 0) /* adding new data to right branch */
+        nodes[root].right = insertCompactNode(tree, nodes[root].right, data, resident, found);
+    else /* comp < 0, adding new data to left branch */
+        nodes[root].left = insertCompactNode(tree, nodes[root].left, data, resident, found);
+    
+    if (*found)
+        return root;
+    
+    recalcCompactHeight(nodes, root);
+    return balanceCompactNode(nodes, root);
+}
+
+void recalcCompactHeight(CompactAVLNode *nodes, uint32_t root) {
+    unsigned char lh;
+    unsigned char rh;
+    
+    lh = nodes[nodes[root].left].height;
+    rh = nodes[nodes[root].right].height;
+    nodes[root].height = (lh > rh ? lh : rh) + 1;
+    return;
+}
+
+uint32_t removeCompactMax(CompactAVLNode *nodes, uint32_t root, uint32_t *highest) {
+    if (nodes[root].right == 0) { /* We're at the maximum */
+        *highest = root;
+        return nodes[root].left;
+    }
+    
+    nodes[root].right = removeCompactMax(nodes, nodes[root].right, highest);
+    recalcCompactHeight(nodes, root);
+    return balanceCompactNode(nodes, root);
+}
+
+uint32_t removeCompactNode(CompactAVLTree *tree, uint32_t root, void *data, uint32_t *removed) {
+    CompactAVLNode *nodes;
+    uint32_t left;
+    uint32_t highest;
+    int comp;
+    
+    if (root == 0)
+        return 0; /* Data does not exist in tree. */
+    
+    nodes = tree->nodes;
+    comp = tree->compFunc(data, nodes[root].data);
+    if (comp == 0) { /* Found the data! */
+        *removed = root;
+        if (nodes[root].left == 0)
+            return nodes[root].right;
+        if (nodes[root].right == 0)
+            return nodes[root].left;
+        
+        /* Put the next lowest node in the removed one's place. */
+        left = removeCompactMax(nodes, nodes[root].left, &highest);
+        nodes[highest].left = left;
+        nodes[highest].right = nodes[root].right;
+        root = highest;
+    } else if (comp > 0) { /* Need to head left */
+        nodes[root].left = removeCompactNode(tree, nodes[root].left, data, removed);
+    } else { /* Need to head right */
+        nodes[root].right = removeCompactNode(tree, nodes[root].right, data, removed);
+    }
+    
+    if (*removed == 0)
+        return root; /* nothing was removed, so no heights changed */
+    
+    recalcCompactHeight(nodes, root);
+    return balanceCompactNode(nodes, root);
+}
+
+uint32_t rotLeftCompact(CompactAVLNode *nodes, uint32_t root) {
+    uint32_t newRoot;
+    
+    newRoot = nodes[root].right; /* must exist for this subroutine to be called */
+    nodes[root].right = nodes[newRoot].left;
+    recalcCompactHeight(nodes, root);
+    
+    nodes[newRoot].left = root;
+    recalcCompactHeight(nodes, newRoot);
+    
+    return newRoot;
+}
+
+uint32_t rotRightCompact(CompactAVLNode *nodes, uint32_t root) {
+    uint32_t newRoot;
+    
+    newRoot = nodes[root].left; /* must exist for this subroutine to be called */
+    nodes[root].left = nodes[newRoot].right;
+    recalcCompactHeight(nodes, root);
+    
+    nodes[newRoot].right = root;
+    recalcCompactHeight(nodes, newRoot);
+    
+    return newRoot;
+}
@@ -0,0 +1,104 @@
+/** Compact AVL Tree Library
+ ** An AVL tree whose nodes sit in one array and link by index **/
+
+#ifndef __MSAUND05_COMPACTAVLTREEH
+#define __MSAUND05_COMPACTAVLTREEH
+
+#include <stdint.h>
+
+#include "AVLtree.h"
+
+/* A compact tree keeps its nodes in one array, the slab, and links them by
+ * 32-bit index instead of by pointer, with the height in a single byte.  A node
+ * takes 24 bytes on a 64-bit machine where an AVLTreeNode takes 40, and the
+ * nodes sit together instead of wherever malloc() put them.  Index 0 stands for
+ * no node.  Removed nodes go on a free list for reuse; a full slab doubles,
+ * which moves the nodes but not their indices.  Data are compared as in an
+ * AVLTree.  There are no subtree sizes, so no rank or select. */
+
+/* The most data a compact tree can hold. */
+#define COMPACT_AVL_MAX_NODES (UINT32_MAX - 1)
+
+typedef struct CompactAVLNode {
+    void *data;
+    uint32_t left;
+    uint32_t right;
+    unsigned char height;
+} CompactAVLNode;
+
+typedef struct CompactAVLTree {
+    CompactAVLNode *nodes; /* The slab.  nodes[0] is never used and stays zeroed. */
+    uint32_t root;
+    uint32_t freeNode; /* First removed node, linked through left, or 0. */
+    uint32_t used; /* Nodes handed out from the slab so far, counting nodes[0]. */
+    uint32_t capacity;
+    size_t size;
+    void (*destFunc) (void *data);
+    int (*compFunc) (void*, void*);
+} CompactAVLTree;
+
+/** Public Functions **/
+
+/* Creates a new compact tree.  Requires a comparison function and a destruction
+ * function for the type of data being held in the tree. */
+CompactAVLTree *createCompactAVLTree(int (*__comparison_func) (void*, void*), void (*__destroy_func) (void*) );
+
+/* Destroys a compact tree, and all of the data inside it. */
+void destroyCompactAVLTree(CompactAVLTree *tree);
+
+/* Finds a piece of data in a compact tree.  Returns a pointer to the data, or
+ * NULL if the data is not found. */
+void *findInCompactTree(CompactAVLTree *tree, void *data);
+
+/* Returns the number of data in a compact tree. */
+size_t getCompactTreeSize(CompactAVLTree *tree);
+
+/* Works like insertOrFindInTree(): adds the data unless equal data is already
+ * there, in a single descent, and returns the data the tree holds afterwards.
+ * Returns NULL if the data is NULL, the slab could not grow, or the tree is full. */
+void *insertOrFindInCompactTree(CompactAVLTree *tree, void *data, bool *found);
+
+/* Removes a piece of data from a compact tree and returns it, or NULL if it is
+ * not in the tree. */
+void *removeFromCompactTree(CompactAVLTree *tree, void *data);
+
+/* Works like avl_visit_range(): visits, in order, the data from low up to but
+ * not including high, until the visit function returns FALSE.  Returns the
+ * number of data visited. */
+size_t visitCompactTreeRange(CompactAVLTree *tree, void *low, void *high, bool (*__visit_function) (void*, void*), void *context);
+
+
+
+/** Private functions **/
+
+/* Balances the subtree under a node.  Returns the index of the new root. */
+uint32_t balanceCompactNode(CompactAVLNode *nodes, uint32_t root);
+
+/* Recursively destroys the data in a subtree. */
+void destroyCompactSubTree(CompactAVLTree *tree, uint32_t root);
+
+/* Makes sure there is a node free for an insertion, doubling the slab if needed.
+ * Returns FALSE if the slab could not grow. */
+bool growCompactSlab(CompactAVLTree *tree);
+
+/* Inserts data into a subtree unless equal data is already in it, and returns
+ * the index of the new root.  Sets resident and found as insertAVLNode() does.
+ * Must only be called once growCompactSlab() has made room. */
+uint32_t insertCompactNode(CompactAVLTree *tree, uint32_t root, void *data, uint32_t *resident, bool *found);
+
+/* Given a node, recalculates its height based on its branch nodes + 1 */
+void recalcCompactHeight(CompactAVLNode *nodes, uint32_t root);
+
+/* Takes the highest node out of a subtree, sets highest to it, and returns the
+ * index of the new root. */
+uint32_t removeCompactMax(CompactAVLNode *nodes, uint32_t root, uint32_t *highest);
+
+/* Takes the node holding data out of a subtree, sets removed to it (it is left
+ * alone if the data is not there), and returns the index of the new root. */
+uint32_t removeCompactNode(CompactAVLTree *tree, uint32_t root, void *data, uint32_t *removed);
+
+/* Rotate the subtree under a node left or right.  Return the new root. */
+uint32_t rotLeftCompact(CompactAVLNode *nodes, uint32_t root);
+uint32_t rotRightCompact(CompactAVLNode *nodes, uint32_t root);
+
+#endif
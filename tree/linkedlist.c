@@ -4,13 +4,35 @@
 #include "linkedlist.h"
 
 struct List *newList(int (*__compare_function) (void*, void*), void (*__destroy_function) (void*)) {
+    return newListWithAllocator(__compare_function, __destroy_function, NULL);
+}
+
+struct List *newListWithAllocator(int (*__compare_function) (void*, void*), void (*__destroy_function) (void*),
+                                  const struct allocator *allocator) {
     struct List *list = NULL;
     
-    list = malloc(sizeof(struct List));
+    if (allocator != NULL && (allocator->allocate == NULL || allocator->reallocate == NULL
+                              || allocator->release == NULL))
+        return NULL; /* its blocks could not go back to free() */
+    
+    if (allocator == NULL)
+        list = malloc(sizeof(struct List));
+    else
+        list = allocator->allocate(allocator->context, sizeof(struct List));
     if (list == NULL) {
         return NULL;
     }
     
+    if (allocator == NULL) {
+        list->allocator.allocate = NULL;
+        list->allocator.reallocate = NULL;
+        list->allocator.release = NULL;
+        list->allocator.context = NULL;
+    } else {
+        list->allocator = *allocator;
+    }
+
+    list->nodePool = NULL;
     list->head = NULL;
     list->tail = NULL;
     list->length = 0;
@@ -20,6 +42,26 @@ struct List *newList(int (*__compare_function) (void*, void*), void (*__destroy_
     return list;
 }
 
+struct List *newPooledList(int (*__compare_function) (void*, void*), void (*__destroy_function) (void*)) {
+    struct List *list;
+    struct allocator allocator;
+    Pool *pool;
+    
+    pool = create_pool(sizeof(struct ListNode), 0);
+    if (pool == NULL)
+        return NULL;
+    
+    allocator = pool_allocator(pool);
+    list = newListWithAllocator(__compare_function, __destroy_function, &allocator);
+    if (list == NULL) {
+        destroy_pool(pool);
+        return NULL;
+    }
+    
+    list->nodePool = pool;
+    return list;
+}
+
 void addToList(struct List *list, void *data) {
     struct ListNode *new;
     
@@ -28,7 +70,7 @@ void addToList(struct List *list, void *data) {
     if (data == NULL)
         return; /* cannot add no data to list */
     
-    new = newListNode(data);
+    new = newListNode(list, data);
     if (new == NULL)
         return; /* failed to allocate memory */
     
@@ -46,6 +88,7 @@ void addToList(struct List *list, void *data) {
 void destroyListNotData(struct List *list) {
     struct ListNode *cur;
     struct ListNode *next;
+    Pool *pool;
     
     if (list == NULL)
         return;
@@ -54,11 +97,13 @@ void destroyListNotData(struct List *list) {
     
     while (cur != NULL) {
         next = cur->next;
-        killListNodeNotData(cur);
+        killListNodeNotData(list, cur);
         cur = next;
     }
     
-    free(list);
+    pool = list->nodePool;
+    releaseListMemory(list, list, sizeof(struct List));
+    destroy_pool(pool);
     return;
 }
 
@@ -91,24 +136,40 @@ void *removeFromList(struct List *list, void *data) {
 /** Private Functions **/
 /***********************/
 
-void killListNode(struct ListNode *node, void (*destFunc) (void*)) {
+void killListNode(struct List *list, struct ListNode *node, void (*destFunc) (void*)) {
     if (node == NULL)
         return;
         
     destFunc(node->data);
-    free(node);
+    releaseListMemory(list, node, sizeof(struct ListNode));
     return;
 }
  
-void killListNodeNotData(struct ListNode *node) {
-    free(node);
+void killListNodeNotData(struct List *list, struct ListNode *node) {
+    releaseListMemory(list, node, sizeof(struct ListNode));
+    return;
+}
+
+void *allocateListMemory(struct List *list, size_t size) {
+    if (list->allocator.allocate == NULL)
+        return malloc(size);
+    return list->allocator.allocate(list->allocator.context, size);
+}
+
+void releaseListMemory(struct List *list, void *block, size_t size) {
+    if (block == NULL)
+        return;
+    if (list->allocator.release == NULL)
+        free(block);
+    else
+        list->allocator.release(list->allocator.context, block, size);
     return;
 }
 
-struct ListNode *newListNode(void *data) {
+struct ListNode *newListNode(struct List *list, void *data) {
     struct ListNode *node;
     
-    node = malloc(sizeof(struct ListNode));
+    node = allocateListMemory(list, sizeof(struct ListNode));
     if (node == NULL)
         return NULL;
         
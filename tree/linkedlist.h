@@ -7,6 +7,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../alloc/allocator.h"
+#include "../alloc/pool.h"
+
 struct ListNode {
     void *data;
     struct ListNode *next;
@@ -18,6 +21,8 @@ struct List {
     unsigned int length;
     void (*destFunc) (void *data);
     int (*compFunc) (void*, void*);
+    struct allocator allocator; /* All NULL to use malloc(). */
+    Pool *nodePool; /* The list's own pool of nodes, or NULL. */
 };
 
 /**********************/
@@ -28,6 +33,17 @@ struct List {
  * to compare its data type, and a function to destroy its data type. */
 struct List *newList(int (*__compare_function) (void*, void*), void (*__destroy_function) (void*));
 
+/* Works like newList(), but takes the list and every node from the given
+ * allocator (see allocator.h) instead of malloc().  A NULL allocator means
+ * malloc().  Returns NULL if the allocator lacks any of its functions. */
+struct List *newListWithAllocator(int (*__compare_function) (void*, void*), void (*__destroy_function) (void*),
+                                  const struct allocator *allocator);
+
+/* Works like newList(), but gives the list a pool of its own (see pool.h) to
+ * take its nodes from, so that they are packed together in large chunks instead
+ * of each being malloc()'d.  The pool goes when the list is destroyed. */
+struct List *newPooledList(int (*__compare_function) (void*, void*), void (*__destroy_function) (void*));
+
 /* Adds a piece of data to the list. */
 void addToList(struct List *list, void *data);
 
@@ -47,14 +63,20 @@ void *removeFromList(struct List *list, void *data);
 /***********************/
 
 /* Deallocates the memory for the node and its data. */
-void killListNode(struct ListNode *node, void (*__destFunc) (void*));
+void killListNode(struct List *list, struct ListNode *node, void (*__destFunc) (void*));
 
 /* Deallocates the memory for the node but NOT its data.  Used if the data is
  * still being held elsewhere (like in a tree). */
-void killListNodeNotData(struct ListNode *node);
+void killListNodeNotData(struct List *list, struct ListNode *node);
+
+/* Allocates memory from the list's allocator, or malloc() if it has none. */
+void *allocateListMemory(struct List *list, size_t size);
+
+/* Gives memory back to the list's allocator, or free() if it has none. */
+void releaseListMemory(struct List *list, void *block, size_t size);
 
 /* Allocates the memory for a new node. */
-struct ListNode *newListNode(void *data);
+struct ListNode *newListNode(struct List *list, void *data);
 
 /* Prints an entire list, given a function to print the type of data it holds. */
 int printList(struct List *list, void (*__print_function) (void*) );
@@ -0,0 +1,566 @@
+/** Correctness checks for the AVL tree libraries.
+ ** Runs random inserts, removals, splits, joins and bulk loads on trees made
+ ** with createAVLTree() and createPooledAVLTree(), and inserts and removals on
+ ** a CompactAVLTree, checking after each step that every node is balanced and
+ ** holds the right height and size, and that the tree's order, ranks, bounds
+ ** and ranges match a sorted reference array.  Prints each failed check and
+ ** exits with status 1 if any failed.  Build and run it with "make check". **/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "AVLtree.h"
+#include "compactAVLtree.h"
+
+/* Data are the keys 2 to CHECK_KEYS - 1, cast to pointers, so that probes one
+ * below the lowest and one above the highest are never NULL. */
+#define CHECK_KEYS 3000
+
+#define CHECK(cond) checkThat((cond), #cond, __FILE__, __LINE__)
+
+typedef struct Reference {
+    intptr_t keys[CHECK_KEYS]; /* The data the tree should hold, in order. */
+    size_t size;
+} Reference;
+
+typedef struct Collected {
+    intptr_t keys[CHECK_KEYS];
+    size_t size;
+    size_t limit; /* Stop visiting once this many are collected. */
+} Collected;
+
+static int failures = 0;
+static unsigned int rngState = 2463534242u;
+
+static void checkThat(int cond, const char *text, const char *file, int line) {
+    if (cond)
+        return;
+
+    failures++;
+    if (failures <= 20)
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+}
+
+static void report(const char *name, int failuresBefore) {
+    printf("%-16s %s\n", name, failures == failuresBefore ? "ok" : "FAILED");
+}
+
+/* xorshift32, so every run sees the same sequence. */
+static int nextRandom(int range) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return (int) (rngState % (unsigned int) range);
+}
+
+static void *keyData(intptr_t key) {
+    return (void*) key;
+}
+
+/* Orders lower keys first, the way every tree here is sorted. */
+static int compareKeys(void *a, void *b) {
+    intptr_t x = (intptr_t) a;
+    intptr_t y = (intptr_t) b;
+
+    return (y > x) - (y < x);
+}
+
+static void keepData(void *data) {
+    (void) data;
+}
+
+static bool collectKey(void *data, void *context) {
+    Collected *collected = context;
+
+    collected->keys[collected->size++] = (intptr_t) data;
+    return collected->size < collected->limit ? TRUE : FALSE;
+}
+
+/** Reference **/
+
+/* Returns the index of the first key in the reference not below key. */
+static size_t referenceLowerBound(Reference *ref, intptr_t key) {
+    size_t low = 0;
+    size_t high = ref->size;
+    size_t mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (ref->keys[mid] < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+static bool referenceHas(Reference *ref, intptr_t key) {
+    size_t i = referenceLowerBound(ref, key);
+
+    return i < ref->size && ref->keys[i] == key ? TRUE : FALSE;
+}
+
+static void referenceInsert(Reference *ref, intptr_t key) {
+    size_t i = referenceLowerBound(ref, key);
+
+    memmove(&ref->keys[i + 1], &ref->keys[i], sizeof(intptr_t) * (ref->size - i));
+    ref->keys[i] = key;
+    ref->size++;
+}
+
+static void referenceRemove(Reference *ref, intptr_t key) {
+    size_t i = referenceLowerBound(ref, key);
+
+    memmove(&ref->keys[i], &ref->keys[i + 1], sizeof(intptr_t) * (ref->size - i - 1));
+    ref->size--;
+}
+
+/** AVLTree checks **/
+
+/* Checks that a subtree is balanced, holds its true height and size, and
+ * orders every key strictly between low and high.  Returns its height. */
+static int checkAVLSubTree(AVLTreeNode *root, intptr_t low, intptr_t high) {
+    int left;
+    int right;
+
+    if (root == NULL)
+        return 0;
+
+    left = checkAVLSubTree(root->left, low, (intptr_t) root->data);
+    right = checkAVLSubTree(root->right, (intptr_t) root->data, high);
+    CHECK((intptr_t) root->data > low && (intptr_t) root->data < high);
+    CHECK(left - right <= 1 && right - left <= 1);
+    CHECK(root->height == max(left, right) + 1);
+    CHECK(root->size == sizeOfSubTree(root->left) + sizeOfSubTree(root->right) + 1);
+    return max(left, right) + 1;
+}
+
+/* Checks a tree's shape, then its sequence both ways, and every query at
+ * each key from one below the lowest to one above the highest. */
+static void checkAVLTree(AVLTree *tree, Reference *ref) {
+    static Collected collected;
+    AVLCursor cursor;
+    intptr_t key;
+    intptr_t high;
+    size_t i;
+    void *data;
+
+    checkAVLSubTree(tree->root, 0, CHECK_KEYS + 1);
+    CHECK(avl_count_range(tree, NULL, NULL) == ref->size);
+
+    i = 0;
+    for (data = avl_cursor_first(&cursor, tree); data != NULL; data = avl_cursor_next(&cursor)) {
+        CHECK(i < ref->size && (intptr_t) data == ref->keys[i]);
+        i++;
+    }
+    CHECK(i == ref->size);
+    for (data = avl_cursor_last(&cursor, tree); data != NULL; data = avl_cursor_prev(&cursor)) {
+        CHECK(i > 0 && (intptr_t) data == ref->keys[i - 1]);
+        i--;
+    }
+    CHECK(i == 0);
+
+    for (i=0; i<ref->size; i++) {
+        CHECK(avl_select(tree, i) == keyData(ref->keys[i]));
+        CHECK(avl_rank(tree, keyData(ref->keys[i])) == i);
+    }
+    CHECK(avl_select(tree, ref->size) == NULL);
+
+    for (key=1; key<=CHECK_KEYS; key++) {
+        i = referenceLowerBound(ref, key);
+        CHECK(avl_rank(tree, keyData(key)) == i);
+        CHECK(avl_lower_bound(tree, keyData(key)) == (i < ref->size ? keyData(ref->keys[i]) : NULL));
+        if (i < ref->size && ref->keys[i] == key)
+            i++;
+        CHECK(avl_upper_bound(tree, keyData(key)) == (i < ref->size ? keyData(ref->keys[i]) : NULL));
+        CHECK((findInTree(tree, keyData(key)) != NULL) == referenceHas(ref, key));
+
+        i = referenceLowerBound(ref, key);
+        data = avl_cursor_seek(&cursor, tree, keyData(key));
+        CHECK(data == avl_lower_bound(tree, keyData(key)));
+        if (data != NULL && i > 0)
+            CHECK(avl_cursor_prev(&cursor) == keyData(ref->keys[i - 1]));
+    }
+
+    /* A few ranges, one of them cut short by the visit function. */
+    for (i=0; i<4; i++) {
+        key = 1 + nextRandom(CHECK_KEYS);
+        high = key + nextRandom(CHECK_KEYS / 4);
+        collected.size = 0;
+        collected.limit = i == 0 ? 5 : CHECK_KEYS;
+        CHECK(avl_visit_range(tree, keyData(key), keyData(high), collectKey, &collected) == collected.size);
+        CHECK(avl_count_range(tree, keyData(key), keyData(high)) ==
+              referenceLowerBound(ref, high) - referenceLowerBound(ref, key));
+        if (collected.size < collected.limit)
+            CHECK(collected.size == referenceLowerBound(ref, high) - referenceLowerBound(ref, key));
+        CHECK(memcmp(collected.keys, &ref->keys[referenceLowerBound(ref, key)],
+                     sizeof(intptr_t) * collected.size) == 0);
+    }
+}
+
+/* Inserts and removes random keys, checking the tree now and then, and
+ * rebuilding it from the reference with avl_build_sorted() a few times. */
+static void checkAVLUpdates(AVLTree *(*create) (int (*) (void*, void*), void (*) (void*))) {
+    static Reference ref;
+    static void *data[CHECK_KEYS];
+    AVLTree *tree;
+    intptr_t key;
+    bool found;
+    size_t i;
+    int op;
+
+    tree = create(compareKeys, keepData);
+    ref.size = 0;
+    for (op=0; op<30000; op++) {
+        key = 2 + nextRandom(CHECK_KEYS - 2);
+        if (nextRandom(op < 15000 ? 3 : 5) != 0) {
+            CHECK(insertOrFindInTree(tree, keyData(key), &found) == keyData(key));
+            CHECK(found == referenceHas(&ref, key));
+            if (!found)
+                referenceInsert(&ref, key);
+        } else {
+            CHECK(removeFromTree(tree, keyData(key)) == (referenceHas(&ref, key) ? keyData(key) : NULL));
+            if (referenceHas(&ref, key))
+                referenceRemove(&ref, key);
+        }
+
+        if (op % 1500 == 0)
+            checkAVLTree(tree, &ref);
+
+        if (op % 7000 == 6999) {
+            destroyAVLTree(tree);
+            tree = create(compareKeys, keepData);
+            for (i=0; i<ref.size; i++)
+                data[i] = keyData(ref.keys[i]);
+            CHECK(avl_build_sorted(tree, data, ref.size) == 0);
+            checkAVLTree(tree, &ref);
+            if (ref.size > 1) {
+                CHECK(avl_build_sorted(tree, data, ref.size) == -1);
+                checkAVLTree(tree, &ref);
+            }
+        }
+    }
+
+    /* Out of order, repeated or NULL data are refused. */
+    destroyAVLTree(tree);
+    tree = create(compareKeys, keepData);
+    data[0] = keyData(5);
+    data[1] = keyData(5);
+    CHECK(avl_build_sorted(tree, data, 2) == -1);
+    data[1] = keyData(4);
+    CHECK(avl_build_sorted(tree, data, 2) == -1);
+    data[1] = NULL;
+    CHECK(avl_build_sorted(tree, data, 2) == -1);
+    CHECK(tree->root == NULL);
+    CHECK(avl_build_sorted(tree, data, 0) == 0);
+    CHECK(insertOrFindInTree(tree, NULL, &found) == NULL && !found);
+    destroyAVLTree(tree);
+}
+
+/* Splits a tree at every few keys, checking both halves, and joins them back
+ * around the lowest data of the right half. */
+static void checkAVLSplitJoin(size_t n, int stride) {
+    static Reference ref;
+    static Reference part;
+    static void *data[CHECK_KEYS];
+    AVLTree *tree;
+    AVLTree *right;
+    void *middle;
+    intptr_t key;
+    size_t cut;
+    size_t i;
+
+    ref.size = 0;
+    for (key=2; key<CHECK_KEYS && ref.size < n; key+=stride)
+        ref.keys[ref.size++] = key;
+    for (i=0; i<ref.size; i++)
+        data[i] = keyData(ref.keys[i]);
+    tree = createAVLTree(compareKeys, keepData);
+    CHECK(avl_build_sorted(tree, data, ref.size) == 0);
+
+    for (key=1; key<=(ref.size > 0 ? ref.keys[ref.size - 1] + 1 : 2); key+=1 + nextRandom(40)) {
+        right = createAVLTree(compareKeys, keepData);
+        CHECK(avl_split(tree, keyData(key), right) == 0);
+
+        cut = referenceLowerBound(&ref, key);
+        part.size = cut;
+        memcpy(part.keys, ref.keys, sizeof(intptr_t) * cut);
+        checkAVLSubTree(tree->root, 0, key);
+        CHECK(avl_count_range(tree, NULL, NULL) == cut);
+        if (key % 7 == 0)
+            checkAVLTree(tree, &part);
+        CHECK(avl_select(tree, cut) == NULL);
+        if (cut > 0)
+            CHECK(avl_select(tree, cut - 1) == keyData(ref.keys[cut - 1]));
+
+        part.size = ref.size - cut;
+        memcpy(part.keys, &ref.keys[cut], sizeof(intptr_t) * part.size);
+        checkAVLSubTree(right->root, key - 1, CHECK_KEYS + 1);
+        CHECK(avl_count_range(right, NULL, NULL) == part.size);
+        if (key % 7 == 0)
+            checkAVLTree(right, &part);
+
+        if (part.size > 0) {
+            middle = avl_select(right, 0);
+            CHECK(removeFromTree(right, middle) == middle);
+            CHECK(avl_join(tree, middle, right) == 0);
+            CHECK(right->root == NULL);
+        }
+        destroyAVLTree(right);
+        checkAVLSubTree(tree->root, 0, CHECK_KEYS + 1);
+        CHECK(avl_count_range(tree, NULL, NULL) == ref.size);
+    }
+    checkAVLTree(tree, &ref);
+    destroyAVLTree(tree);
+}
+
+/* Joins trees of every pair of sizes from a short list, so that the heights
+ * differ by anything from nothing to a dozen levels. */
+static void checkAVLJoinSizes(void) {
+    static const size_t sizes[] = { 0, 1, 2, 3, 7, 40, 100, 1000, 1400 };
+    static Reference ref;
+    static void *data[CHECK_KEYS];
+    AVLTree *left;
+    AVLTree *right;
+    size_t count = sizeof(sizes) / sizeof(sizes[0]);
+    size_t a;
+    size_t b;
+    size_t i;
+
+    for (a=0; a<count; a++) {
+        for (b=0; b<count; b++) {
+            left = createAVLTree(compareKeys, keepData);
+            right = createAVLTree(compareKeys, keepData);
+            ref.size = sizes[a] + 1 + sizes[b];
+            for (i=0; i<ref.size; i++) {
+                ref.keys[i] = (intptr_t) (2 + i);
+                data[i] = keyData(ref.keys[i]);
+            }
+            CHECK(avl_build_sorted(left, data, sizes[a]) == 0);
+            CHECK(avl_build_sorted(right, &data[sizes[a] + 1], sizes[b]) == 0);
+
+            /* A middle that is out of order leaves both trees alone. */
+            if (sizes[a] > 0) {
+                CHECK(avl_join(left, data[0], right) == -1);
+                CHECK(avl_count_range(left, NULL, NULL) == sizes[a]);
+                CHECK(avl_count_range(right, NULL, NULL) == sizes[b]);
+            }
+
+            CHECK(avl_join(left, data[sizes[a]], right) == 0);
+            CHECK(right->root == NULL);
+            checkAVLTree(left, &ref);
+            destroyAVLTree(left);
+            destroyAVLTree(right);
+        }
+    }
+}
+
+/* Pooled trees cannot trade nodes with trees outside their pool. */
+static void checkAVLIncompatible(void) {
+    AVLTree *pooled = createPooledAVLTree(compareKeys, keepData);
+    AVLTree *other = createPooledAVLTree(compareKeys, keepData);
+    AVLTree *plain = createAVLTree(compareKeys, keepData);
+
+    addToTree(pooled, keyData(10));
+    addToTree(other, keyData(30));
+    CHECK(avl_join(pooled, keyData(20), other) == -1);
+    CHECK(avl_join(plain, keyData(5), pooled) == -1);
+    CHECK(avl_split(pooled, keyData(10), other) == -1);
+    CHECK(avl_split(pooled, keyData(10), plain) == -1);
+    CHECK(avl_count_range(pooled, NULL, NULL) == 1 && avl_count_range(other, NULL, NULL) == 1);
+    destroyAVLTree(pooled);
+    destroyAVLTree(other);
+    destroyAVLTree(plain);
+}
+
+/** Allocator checks **/
+
+/* An allocator over malloc() that counts the blocks it has out, so a tree or
+ * list can be seen to give back everything it took. */
+static void *countedAllocate(void *context, size_t size) {
+    void *block = malloc(size);
+
+    if (block != NULL)
+        (*(long*) context)++;
+    return block;
+}
+
+static void *countedReallocate(void *context, void *block, size_t oldSize, size_t newSize) {
+    (void) context;
+    (void) oldSize;
+    return realloc(block, newSize);
+}
+
+static void countedRelease(void *context, void *block, size_t size) {
+    (void) size;
+    (*(long*) context)--;
+    free(block);
+}
+
+/* Fills and empties a tree and a list on a counting allocator, and checks
+ * that an allocator missing any of its functions is refused. */
+static void checkAllocators(void) {
+    struct allocator allocator;
+    struct allocator partial;
+    struct List *list;
+    AVLTree *tree;
+    long blocks = 0;
+    intptr_t key;
+
+    allocator.allocate = countedAllocate;
+    allocator.reallocate = countedReallocate;
+    allocator.release = countedRelease;
+    allocator.context = &blocks;
+    tree = createAVLTreeWithAllocator(compareKeys, keepData, &allocator);
+    list = newListWithAllocator(compareKeys, keepData, &allocator);
+    CHECK(tree != NULL && list != NULL);
+    for (key=2; key<500; key++) {
+        addToTree(tree, keyData(key));
+        addToList(list, keyData(key));
+    }
+    for (key=2; key<500; key+=2)
+        CHECK(removeFromTree(tree, keyData(key)) == keyData(key));
+    CHECK(blocks > 0);
+    destroyAVLTree(tree);
+    destroyListNotData(list);
+    CHECK(blocks == 0);
+
+    partial = allocator;
+    partial.reallocate = NULL;
+    CHECK(createAVLTreeWithAllocator(compareKeys, keepData, &partial) == NULL);
+    CHECK(newListWithAllocator(compareKeys, keepData, &partial) == NULL);
+    partial = allocator;
+    partial.allocate = NULL;
+    CHECK(createAVLTreeWithAllocator(compareKeys, keepData, &partial) == NULL);
+    CHECK(newListWithAllocator(compareKeys, keepData, &partial) == NULL);
+    partial = allocator;
+    partial.release = NULL;
+    CHECK(createAVLTreeWithAllocator(compareKeys, keepData, &partial) == NULL);
+    CHECK(newListWithAllocator(compareKeys, keepData, &partial) == NULL);
+    CHECK(blocks == 0);
+}
+
+/** CompactAVLTree checks **/
+
+/* Checks a compact subtree as checkAVLSubTree() does, and returns its height
+ * after adding its size to count. */
+static int checkCompactSubTree(CompactAVLNode *nodes, uint32_t root, intptr_t low, intptr_t high, size_t *count) {
+    int left;
+    int right;
+
+    if (root == 0)
+        return 0;
+
+    left = checkCompactSubTree(nodes, nodes[root].left, low, (intptr_t) nodes[root].data, count);
+    right = checkCompactSubTree(nodes, nodes[root].right, (intptr_t) nodes[root].data, high, count);
+    CHECK((intptr_t) nodes[root].data > low && (intptr_t) nodes[root].data < high);
+    CHECK(left - right <= 1 && right - left <= 1);
+    CHECK(nodes[root].height == max(left, right) + 1);
+    (*count)++;
+    return max(left, right) + 1;
+}
+
+static void checkCompactTree(CompactAVLTree *tree, Reference *ref) {
+    static Collected collected;
+    intptr_t key;
+    intptr_t high;
+    size_t count = 0;
+    int i;
+
+    checkCompactSubTree(tree->nodes, tree->root, 0, CHECK_KEYS + 1, &count);
+    CHECK(count == ref->size);
+    CHECK(getCompactTreeSize(tree) == ref->size);
+
+    collected.size = 0;
+    collected.limit = CHECK_KEYS;
+    CHECK(visitCompactTreeRange(tree, NULL, NULL, collectKey, &collected) == ref->size);
+    CHECK(collected.size == ref->size);
+    CHECK(memcmp(collected.keys, ref->keys, sizeof(intptr_t) * ref->size) == 0);
+
+    for (key=1; key<=CHECK_KEYS; key++)
+        CHECK((findInCompactTree(tree, keyData(key)) != NULL) == referenceHas(ref, key));
+
+    for (i=0; i<4; i++) {
+        key = 1 + nextRandom(CHECK_KEYS);
+        high = key + nextRandom(CHECK_KEYS / 4);
+        collected.size = 0;
+        collected.limit = i == 0 ? 5 : CHECK_KEYS;
+        CHECK(visitCompactTreeRange(tree, keyData(key), keyData(high), collectKey, &collected) == collected.size);
+        if (collected.size < collected.limit)
+            CHECK(collected.size == referenceLowerBound(ref, high) - referenceLowerBound(ref, key));
+        CHECK(memcmp(collected.keys, &ref->keys[referenceLowerBound(ref, key)],
+                     sizeof(intptr_t) * collected.size) == 0);
+    }
+}
+
+static void checkCompactUpdates(void) {
+    static Reference ref;
+    CompactAVLTree *tree;
+    intptr_t key;
+    bool found;
+    int op;
+
+    tree = createCompactAVLTree(compareKeys, keepData);
+    ref.size = 0;
+    for (op=0; op<30000; op++) {
+        key = 2 + nextRandom(CHECK_KEYS - 2);
+        if (nextRandom(op < 15000 ? 3 : 5) != 0) {
+            CHECK(insertOrFindInCompactTree(tree, keyData(key), &found) == keyData(key));
+            CHECK(found == referenceHas(&ref, key));
+            if (!found)
+                referenceInsert(&ref, key);
+        } else {
+            CHECK(removeFromCompactTree(tree, keyData(key)) == (referenceHas(&ref, key) ? keyData(key) : NULL));
+            if (referenceHas(&ref, key))
+                referenceRemove(&ref, key);
+        }
+
+        if (op % 1500 == 0)
+            checkCompactTree(tree, &ref);
+    }
+    checkCompactTree(tree, &ref);
+    while (ref.size > 0) {
+        key = ref.keys[nextRandom((int) ref.size)];
+        CHECK(removeFromCompactTree(tree, keyData(key)) == keyData(key));
+        referenceRemove(&ref, key);
+    }
+    checkCompactTree(tree, &ref);
+    destroyCompactAVLTree(tree);
+}
+
+int main(void) {
+    int before;
+
+    before = failures;
+    checkAVLUpdates(createAVLTree);
+    report("AVLTree", before);
+
+    before = failures;
+    checkAVLUpdates(createPooledAVLTree);
+    checkAVLIncompatible();
+    report("pooled AVLTree", before);
+
+    before = failures;
+    checkAVLSplitJoin(0, 1);
+    checkAVLSplitJoin(1, 1);
+    checkAVLSplitJoin(100, 3);
+    checkAVLSplitJoin(CHECK_KEYS, 1);
+    checkAVLSplitJoin(CHECK_KEYS, 2);
+    checkAVLJoinSizes();
+    report("split and join", before);
+
+    before = failures;
+    checkAllocators();
+    report("allocators", before);
+
+    before = failures;
+    checkCompactUpdates();
+    report("CompactAVLTree", before);
+
+    if (failures > 0) {
+        printf("%d checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}